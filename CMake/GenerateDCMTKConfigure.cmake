@@ -362,6 +362,7 @@ endif()
   CHECK_INCLUDE_FILE_CXX("sys/time.h" HAVE_SYS_TIME_H)
   CHECK_INCLUDE_FILE_CXX("sys/timeb.h" HAVE_SYS_TIMEB_H)
   CHECK_INCLUDE_FILE_CXX("sys/types.h" HAVE_SYS_TYPES_H)
+  CHECK_INCLUDE_FILE_CXX("sys/uio.h" HAVE_SYS_UIO_H)
   CHECK_INCLUDE_FILE_CXX("sys/un.h" HAVE_SYS_UN_H)
   CHECK_INCLUDE_FILE_CXX("sys/utime.h" HAVE_SYS_UTIME_H)
   CHECK_INCLUDE_FILE_CXX("sys/utsname.h" HAVE_SYS_UTSNAME_H)
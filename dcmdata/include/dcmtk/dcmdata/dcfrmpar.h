@@ -0,0 +1,191 @@
+/*
+ *
+ *  Module:  dcmdata
+ *
+ *  Purpose: helper classes for compressing and decompressing the frames
+ *           of a multi-frame image on multiple threads
+ *
+ */
+
+#ifndef DCFRMPAR_H
+#define DCFRMPAR_H
+
+#include "dcmtk/config/osconfig.h"    /* make sure OS specific configuration is included first */
+
+#include "dcmtk/ofstd/ofcond.h"
+#include "dcmtk/ofstd/ofthread.h"
+#include "dcmtk/ofstd/ofvector.h"
+#include "dcmtk/dcmdata/dcdefine.h"
+#include "dcmtk/dcmdata/dcofsetl.h"   /* for class DcmOffsetList */
+
+class DcmPixelSequence;
+
+
+/** helper class that distributes the frames of a multi-frame image
+ *  to a number of worker threads. Codecs use this class to compress or
+ *  decompress the frames of an image in parallel, since each frame is
+ *  encoded independently.
+ */
+class DCMTK_DCMDATA_EXPORT DcmFrameProcessor
+{
+public:
+
+  /** interface for the per-frame work. For each frame, prepareFrame() is
+   *  called first and then processFrame(). Calls to prepareFrame() are
+   *  serialized and made in increasing frame order, so this is the place
+   *  for work that must not run concurrently, like reading the compressed
+   *  fragments from the pixel sequence. Calls to processFrame() may run
+   *  concurrently for different frames and may only modify state that
+   *  belongs to the given frame.
+   */
+  class DCMTK_DCMDATA_EXPORT Task
+  {
+  public:
+
+    /// destructor
+    virtual ~Task() {}
+
+    /** prepares a single frame for processing
+     *  @param frameNo number of the frame, starting with 0
+     *  @return EC_Normal if successful, an error code otherwise
+     */
+    virtual OFCondition prepareFrame(Uint32 /* frameNo */)
+    {
+      return EC_Normal;
+    }
+
+    /** processes a single frame
+     *  @param frameNo number of the frame, starting with 0
+     *  @return EC_Normal if successful, an error code otherwise
+     */
+    virtual OFCondition processFrame(Uint32 frameNo) = 0;
+  };
+
+  /** base class for encoder tasks. Frames are compressed concurrently and
+   *  each compressed frame is stored in the pixel sequence as soon as all
+   *  preceding frames have been stored, so that the pixel sequence and the
+   *  offset list are always built in frame order.
+   */
+  class DCMTK_DCMDATA_EXPORT CompressionTask : public Task
+  {
+  public:
+
+    /** constructor
+     *  @param pixelSequence pixel sequence the compressed frames are added to
+     *  @param offsetList offset list updated for each stored frame
+     *  @param fragmentSize maximum fragment size (in kbytes), 0 for unlimited
+     *  @param numberOfFrames number of frames to be compressed
+     */
+    CompressionTask(
+      DcmPixelSequence *pixelSequence,
+      DcmOffsetList& offsetList,
+      Uint32 fragmentSize,
+      Uint32 numberOfFrames);
+
+    /// destructor, deletes compressed frames that were not stored
+    virtual ~CompressionTask();
+
+    /** compresses the given frame and stores it in frame order
+     *  @param frameNo number of the frame, starting with 0
+     *  @return EC_Normal if successful, an error code otherwise
+     */
+    virtual OFCondition processFrame(Uint32 frameNo);
+
+    /** returns the total size of all compressed frames stored so far
+     *  @return compressed size in bytes
+     */
+    unsigned long getCompressedSize() const
+    {
+      return compressedSize_;
+    }
+
+  protected:
+
+    /** compresses a single frame, called concurrently for different frames
+     *  @param frameNo number of the frame, starting with 0
+     *  @param compressedData compressed frame returned in this parameter,
+     *    allocated with new[]. Ownership is transferred to this class.
+     *  @param compressedSize size of the compressed frame in bytes
+     *  @return EC_Normal if successful, an error code otherwise
+     */
+    virtual OFCondition compressFrame(
+      Uint32 frameNo,
+      Uint8 *& compressedData,
+      Uint32& compressedSize) = 0;
+
+  private:
+
+    /// private undefined copy constructor
+    CompressionTask(const CompressionTask&);
+
+    /// private undefined copy assignment operator
+    CompressionTask& operator=(const CompressionTask&);
+
+    /// pixel sequence the compressed frames are added to
+    DcmPixelSequence *pixelSequence_;
+
+    /// offset list updated for each stored frame
+    DcmOffsetList& offsetList_;
+
+    /// maximum fragment size (in kbytes), 0 for unlimited
+    Uint32 fragmentSize_;
+
+    /// compressed frames waiting for their predecessors, NULL if not available
+    OFVector<Uint8 *> frames_;
+
+    /// sizes of the compressed frames waiting for their predecessors
+    OFVector<Uint32> frameSizes_;
+
+    /// number of the next frame to be stored in the pixel sequence
+    Uint32 nextFrame_;
+
+    /// total size of the stored frames
+    unsigned long compressedSize_;
+
+    /// mutex protecting the pixel sequence and the waiting frames
+    OFMutex mutex_;
+  };
+
+  /** processes all frames of the given task. If numberOfThreads is less than
+   *  two, if there is only one frame or if DCMTK was compiled without thread
+   *  support, the frames are processed sequentially in the calling thread.
+   *  Otherwise, up to numberOfThreads threads (including the calling one)
+   *  fetch the next unprocessed frame until all frames are done. The
+   *  additional threads are limited by setMaxWorkerThreads(). After the
+   *  first error no further frames are started.
+   *  @param task per-frame work
+   *  @param numberOfFrames number of frames to be processed
+   *  @param numberOfThreads maximum number of threads to be used
+   *  @return EC_Normal if all frames were processed successfully, otherwise
+   *    the error of the failed frame with the lowest frame number
+   */
+  static OFCondition run(
+    Task& task,
+    Uint32 numberOfFrames,
+    Uint32 numberOfThreads);
+
+  /** sets the maximum number of worker threads that all calls of run()
+   *  in this process may use at the same time, in addition to the calling
+   *  threads. Images processed concurrently share these threads, so the
+   *  total number of threads does not grow with the number of images.
+   *  Calls that find no free worker process their frames in the calling
+   *  thread. Running calls are not affected by a change.
+   *  @param maxWorkerThreads maximum number of worker threads, 0 for no limit (default)
+   */
+  static void setMaxWorkerThreads(Uint32 maxWorkerThreads);
+
+private:
+
+  /** reserves up to the given number of worker threads
+   *  @param wanted number of worker threads requested
+   *  @return number of worker threads reserved, to be returned with releaseWorkers()
+   */
+  static Uint32 reserveWorkers(Uint32 wanted);
+
+  /** returns worker threads reserved by reserveWorkers()
+   *  @param count number of worker threads to be returned
+   */
+  static void releaseWorkers(Uint32 count);
+};
+
+#endif
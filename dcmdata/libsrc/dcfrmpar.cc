@@ -0,0 +1,265 @@
+/*
+ *
+ *  Module:  dcmdata
+ *
+ *  Purpose: Implementation of DcmFrameProcessor
+ *
+ */
+
+
+#include "dcmtk/config/osconfig.h"    /* make sure OS specific configuration is included first */
+
+#include "dcmtk/dcmdata/dcfrmpar.h"
+#include "dcmtk/dcmdata/dcerror.h"
+#include "dcmtk/dcmdata/dcpixseq.h"
+
+
+#ifdef WITH_THREADS
+
+/// protects the worker thread counters of all frame processors
+static OFMutex workerMutex;
+
+/// maximum number of worker threads of all frame processors, 0 for no limit
+static Uint32 maxWorkers = 0;
+
+/// number of worker threads currently reserved by frame processors
+static Uint32 runningWorkers = 0;
+
+/** state shared by all threads processing the frames of one task.
+ *  Frame numbers are handed out in increasing order.
+ */
+class DcmFrameProcessorState
+{
+public:
+
+  DcmFrameProcessorState(DcmFrameProcessor::Task& task, Uint32 numberOfFrames)
+  : task_(task)
+  , numberOfFrames_(numberOfFrames)
+  , nextFrame_(0)
+  , failedFrame_(numberOfFrames)
+  , result_(EC_Normal)
+  , mutex_()
+  {
+  }
+
+  /// processes frames until all frames are done or a frame failed
+  void work()
+  {
+    Uint32 frameNo;
+    while (nextFrameNo(frameNo))
+    {
+      OFCondition cond = task_.processFrame(frameNo);
+      if (cond.bad())
+      {
+        mutex_.lock();
+        setFailed(frameNo, cond);
+        mutex_.unlock();
+      }
+    }
+  }
+
+  OFCondition result() const
+  {
+    return result_;
+  }
+
+private:
+
+  /** fetches and prepares the next unprocessed frame
+   *  @return OFFalse if all frames are done or a frame failed
+   */
+  OFBool nextFrameNo(Uint32& frameNo)
+  {
+    OFBool found = OFFalse;
+    mutex_.lock();
+    if ((nextFrame_ < numberOfFrames_) && (failedFrame_ == numberOfFrames_))
+    {
+      frameNo = nextFrame_++;
+      OFCondition cond = task_.prepareFrame(frameNo);
+      if (cond.good()) found = OFTrue;
+      else setFailed(frameNo, cond);
+    }
+    mutex_.unlock();
+    return found;
+  }
+
+  /// records the error of a frame, must be called with the mutex locked
+  void setFailed(Uint32 frameNo, const OFCondition& cond)
+  {
+    if (frameNo < failedFrame_)
+    {
+      failedFrame_ = frameNo;
+      result_ = cond;
+    }
+  }
+
+  DcmFrameProcessor::Task& task_;
+  Uint32 numberOfFrames_;
+  Uint32 nextFrame_;
+  Uint32 failedFrame_;
+  OFCondition result_;
+  OFMutex mutex_;
+};
+
+/// worker thread processing the frames of a shared state
+class DcmFrameProcessorThread : public OFThread
+{
+public:
+
+  DcmFrameProcessorThread(DcmFrameProcessorState& state)
+  : OFThread()
+  , state_(state)
+  {
+  }
+
+protected:
+
+  virtual void run()
+  {
+    state_.work();
+  }
+
+private:
+
+  DcmFrameProcessorState& state_;
+};
+
+#endif
+
+
+DcmFrameProcessor::CompressionTask::CompressionTask(
+  DcmPixelSequence *pixelSequence,
+  DcmOffsetList& offsetList,
+  Uint32 fragmentSize,
+  Uint32 numberOfFrames)
+: pixelSequence_(pixelSequence)
+, offsetList_(offsetList)
+, fragmentSize_(fragmentSize)
+, frames_(numberOfFrames, OFstatic_cast(Uint8 *, NULL))
+, frameSizes_(numberOfFrames, 0)
+, nextFrame_(0)
+, compressedSize_(0)
+, mutex_()
+{
+}
+
+
+DcmFrameProcessor::CompressionTask::~CompressionTask()
+{
+  for (size_t i = 0; i < frames_.size(); ++i) delete[] frames_[i];
+}
+
+
+OFCondition DcmFrameProcessor::CompressionTask::processFrame(Uint32 frameNo)
+{
+  Uint8 *compressedData = NULL;
+  Uint32 compressedSize = 0;
+  OFCondition result = compressFrame(frameNo, compressedData, compressedSize);
+  if (result.bad())
+  {
+    delete[] compressedData;
+    return result;
+  }
+
+  mutex_.lock();
+  frames_[frameNo] = compressedData;
+  frameSizes_[frameNo] = compressedSize;
+
+  // store this frame and all waiting successors once their predecessors are stored
+  while (result.good() && (nextFrame_ < frames_.size()) && frames_[nextFrame_])
+  {
+    result = pixelSequence_->storeCompressedFrame(offsetList_, frames_[nextFrame_], frameSizes_[nextFrame_], fragmentSize_);
+    compressedSize_ += frameSizes_[nextFrame_];
+    delete[] frames_[nextFrame_];
+    frames_[nextFrame_++] = NULL;
+  }
+  mutex_.unlock();
+  return result;
+}
+
+
+OFCondition DcmFrameProcessor::run(
+  Task& task,
+  Uint32 numberOfFrames,
+  Uint32 numberOfThreads)
+{
+  if (numberOfThreads > numberOfFrames) numberOfThreads = numberOfFrames;
+
+#ifdef WITH_THREADS
+  // the calling thread is one of the workers
+  Uint32 workers = (numberOfThreads > 1) ? reserveWorkers(numberOfThreads - 1) : 0;
+  if (workers > 0)
+  {
+    DcmFrameProcessorState state(task, numberOfFrames);
+
+    OFVector<DcmFrameProcessorThread *> threads;
+    for (Uint32 i = 0; i < workers; ++i)
+    {
+      DcmFrameProcessorThread *thread = new DcmFrameProcessorThread(state);
+      if (thread->start() == 0) threads.push_back(thread);
+      else delete thread;
+    }
+
+    state.work();
+
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+      threads[i]->join();
+      delete threads[i];
+    }
+    releaseWorkers(workers);
+    return state.result();
+  }
+#endif
+
+  OFCondition result = EC_Normal;
+  for (Uint32 frameNo = 0; (frameNo < numberOfFrames) && result.good(); ++frameNo)
+  {
+    result = task.prepareFrame(frameNo);
+    if (result.good()) result = task.processFrame(frameNo);
+  }
+  return result;
+}
+
+
+void DcmFrameProcessor::setMaxWorkerThreads(Uint32 maxWorkerThreads)
+{
+#ifdef WITH_THREADS
+  workerMutex.lock();
+  maxWorkers = maxWorkerThreads;
+  workerMutex.unlock();
+#else
+  (void) maxWorkerThreads;
+#endif
+}
+
+
+Uint32 DcmFrameProcessor::reserveWorkers(Uint32 wanted)
+{
+#ifdef WITH_THREADS
+  workerMutex.lock();
+  if (maxWorkers > 0)
+  {
+    Uint32 available = (maxWorkers > runningWorkers) ? maxWorkers - runningWorkers : 0;
+    if (wanted > available) wanted = available;
+  }
+  runningWorkers += wanted;
+  workerMutex.unlock();
+  return wanted;
+#else
+  (void) wanted;
+  return 0;
+#endif
+}
+
+
+void DcmFrameProcessor::releaseWorkers(Uint32 count)
+{
+#ifdef WITH_THREADS
+  workerMutex.lock();
+  runningWorkers -= count;
+  workerMutex.unlock();
+#else
+  (void) count;
+#endif
+}
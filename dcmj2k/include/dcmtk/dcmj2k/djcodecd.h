@@ -248,8 +248,55 @@ public:
     DcmItem *dataset,
     OFString &decompressedColorModel) const;
 
+  /** decompresses a region of a single frame at reduced resolution, e.g.\ for
+   *  previews of large images. Only the code-blocks needed for the requested
+   *  region and resolution are decoded, which is much cheaper than decoding
+   *  the full frame.
+   *  @param fromPixSeq compressed pixel sequence
+   *  @param cp codec parameters for this codec, may be NULL for default settings
+   *  @param dataset pointer to dataset in which pixel data element is contained
+   *  @param frameNo number of frame, starting with 0 for the first frame
+   *  @param startFragment index of the compressed fragment that contains
+   *    all or the first part of the compressed bitstream for the given frameNo,
+   *    zero if unknown. Upon successful return this parameter is updated to
+   *    contain the index of the first compressed fragment of the next frame.
+   *  @param reduceFactor number of highest resolution levels to discard. Each
+   *    level halves the number of columns and rows, 0 decodes at full resolution.
+   *    Must be less than the number of resolution levels of the bitstream.
+   *  @param left left edge of the region in full resolution coordinates
+   *  @param top top edge of the region in full resolution coordinates
+   *  @param width width of the region in full resolution coordinates,
+   *    0 extends the region to the right edge of the image
+   *  @param height height of the region in full resolution coordinates,
+   *    0 extends the region to the bottom edge of the image
+   *  @param buffer decompressed region returned in this parameter, allocated
+   *    with new[]. Samples are stored like those of the full frame.
+   *  @param bufSize size of buffer in bytes
+   *  @param columns number of columns of the decompressed region
+   *  @param rows number of rows of the decompressed region
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  static OFCondition decodeFrameRegion(
+    DcmPixelSequence *fromPixSeq,
+    const DJPEG2KCodecParameter *cp,
+    DcmItem *dataset,
+    Uint32 frameNo,
+    Uint32& startFragment,
+    Uint32 reduceFactor,
+    Uint16 left,
+    Uint16 top,
+    Uint16 width,
+    Uint16 height,
+    Uint8 *& buffer,
+    Uint32& bufSize,
+    Uint16& columns,
+    Uint16& rows);
+
 private:
 
+  /// frame task of the decoder, decompresses the frames of a multi-frame image in parallel
+  class FrameTask;
+
   // static private helper methods
 
   /** decompresses a single frame from the given pixel sequence and
@@ -291,6 +338,65 @@ private:
     Uint16 imageSamplesPerPixel,
     Uint16 bytesPerSample);
 
+  /** determines the planar configuration of the decompressed image
+   *  @param cp codec parameters for this codec
+   *  @param dataset pointer to dataset in which pixel data element is contained
+   *  @param imageSamplesPerPixel number of samples per pixel
+   *  @return planar configuration, 0 for color-by-pixel, 1 for color-by-plane
+   */
+  static Uint16 decompressedPlanarConfiguration(
+    const DJPEG2KCodecParameter *cp,
+    DcmItem *dataset,
+    Uint16 imageSamplesPerPixel);
+
+  /** reads the compressed bitstream of a single frame from the given pixel
+   *  sequence. Accesses the pixel items, so must not run concurrently for
+   *  the same pixel sequence.
+   *  @param fromPixSeq compressed pixel sequence
+   *  @param cp codec parameters for this codec
+   *  @param frameNo number of frame, starting with 0 for the first frame
+   *  @param startFragment index of the compressed fragment the frame starts with,
+   *    updated to the first fragment of the next frame upon successful return
+   *  @param imageFrames number of frames in this image
+   *  @param compressedData compressed bitstream returned in this parameter, allocated with new[]
+   *  @param compressedSize size of the compressed bitstream returned in this parameter
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  static OFCondition readCompressedFrame(
+    DcmPixelSequence * fromPixSeq,
+    const DJPEG2KCodecParameter *cp,
+    Uint32 frameNo,
+    Uint32& startFragment,
+    Sint32 imageFrames,
+    Uint8 *& compressedData,
+    size_t& compressedSize);
+
+  /** decompresses the bitstream of a single frame and stores the result in
+   *  the given buffer. Different frames may be decompressed concurrently.
+   *  @param compressedData compressed bitstream
+   *  @param compressedSize size of the compressed bitstream
+   *  @param buffer pointer to buffer where frame is to be stored
+   *  @param bufSize size of buffer in bytes
+   *  @param imageColumns number of columns for each frame
+   *  @param imageRows number of rows for each frame
+   *  @param imageSamplesPerPixel number of samples per pixel
+   *  @param bytesPerSample number of bytes per sample
+   *  @param imagePlanarConfiguration planar configuration of the decompressed image
+   *  @param codecThreads number of threads OpenJPEG uses for this frame, 1 for none
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  static OFCondition decodeCompressedFrame(
+    Uint8 *compressedData,
+    size_t compressedSize,
+    void *buffer,
+    Uint32 bufSize,
+    Uint16 imageColumns,
+    Uint16 imageRows,
+    Uint16 imageSamplesPerPixel,
+    Uint16 bytesPerSample,
+    Uint16 imagePlanarConfiguration,
+    Uint32 codecThreads);
+
   /** determines if a given image requires color-by-plane planar configuration
    *  depending on SOP Class UID (DICOM IOD) and photometric interpretation.
    *  All SOP classes defined in the 2003 edition of the DICOM standard or earlier
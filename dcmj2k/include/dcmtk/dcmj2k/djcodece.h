@@ -252,6 +252,12 @@ public:
 
 private:
 
+  /// frame task of the raw encoder, compresses the frames of a multi-frame image in parallel
+  class RawFrameTask;
+
+  /// frame task of the rendered encoder, compresses the frames of a multi-frame image in parallel
+  class RenderedFrameTask;
+
   /** returns the transfer syntax that this particular codec
    *  is able to encode
    *  @return supported transfer syntax
@@ -342,10 +348,10 @@ private:
    *  @param samplesPerPixel image samples per pixel
    *  @param planarConfiguration image planar configuration
    *  @param photometricInterpretation photometric interpretation of the DICOM dataset
-   *  @param pixelSequence object in which the compressed frame is stored
-   *  @param offsetList list of frame offsets updated in this parameter
+   *  @param compressedFrame compressed frame returned in this parameter, allocated with new[]
    *  @param compressedSize size of compressed frame returned in this parameter
    *  @param djcp parameters for the codec
+   *  @param codecThreads number of threads OpenJPEG uses for this frame, 1 for none
    *  @return EC_Normal if successful, an error code otherwise
    */
   OFCondition compressRawFrame(
@@ -357,31 +363,33 @@ private:
     Uint16 planarConfiguration,
 	OFBool pixelRepresentation,
     const OFString& photometricInterpretation,
-    DcmPixelSequence *pixelSequence,
-    DcmOffsetList &offsetList,
-    unsigned long &compressedSize,
-    const DJPEG2KCodecParameter *djcp) const;
+    Uint8 *&compressedFrame,
+    Uint32 &compressedSize,
+    const DJPEG2KCodecParameter *djcp,
+    Uint32 codecThreads) const;
 
-  /** perform the lossless compression of a single rendered frame
-   *  @param pixelSequence object in which the compressed frame is stored
+  /** perform the lossless compression of a single rendered frame.
+   *  Only reads the intermediate representation of the image, so different
+   *  frames may be compressed concurrently.
    *  @param dimage DicomImage instance used to process frame
    *  @param photometricInterpretation photometric interpretation of the DICOM dataset
-   *  @param offsetList list of frame offsets updated in this parameter
+   *  @param compressedFrame compressed frame returned in this parameter, allocated with new[]
    *  @param compressedSize size of compressed frame returned in this parameter
    *  @param djcp parameters for the codec
    *  @param frame frame index
    *  @param nearLosslessDeviation maximum deviation for near-lossless encoding
+   *  @param codecThreads number of threads OpenJPEG uses for this frame, 1 for none
    *  @return EC_Normal if successful, an error code otherwise
    */
   OFCondition compressRenderedFrame(
-    DcmPixelSequence *pixelSequence,
-    DicomImage *dimage,
+    const DicomImage *dimage,
     const OFString& photometricInterpretation,
-    DcmOffsetList &offsetList,
-    unsigned long &compressedSize,
+    Uint8 *&compressedFrame,
+    Uint32 &compressedSize,
     const DJPEG2KCodecParameter *djcp,
     Uint32 frame,
-    const FMJPEG2KRepresentationParameter *djrp) const;
+    const FMJPEG2KRepresentationParameter *djrp,
+    Uint32 codecThreads) const;
 
   /** Convert an image from sample interleaved to uninterleaved.
    *  @param target A buffer where the converted image will be stored
@@ -20,6 +20,7 @@
 
 #include "dcmtk/config/osconfig.h"
 #include "dcmtk/dcmdata/dccodec.h" /* for DcmCodecParameter */
+#include "dcmtk/ofstd/ofthread.h"  /* for OFMutex */
 #include "djlsutil.h" /* for enums */
 
 /** codec parameter for JPEG-2000 codecs
@@ -40,6 +41,8 @@ public:
    *  @param convertToSC               flag indicating whether image should be converted to Secondary Capture upon compression
    *  @param planarConfiguration       flag describing how planar configuration of decompressed color images should be handled
    *  @param ignoreOffsetTable         flag indicating whether to ignore the offset table when decompressing multiframe images
+   *  @param frameThreads              maximum number of threads compressing or decompressing the frames of a multi-frame image
+   *  @param codecThreads              number of threads OpenJPEG uses within a single frame, 1 for none
    */
    DJPEG2KCodecParameter(
      OFBool jp2k_optionsEnabled,
@@ -51,17 +54,23 @@ public:
      J2K_UIDCreation uidCreation = EJ2KUC_default,
      OFBool convertToSC = OFFalse,
      J2K_PlanarConfiguration planarConfiguration = EJ2KPC_restore,
-     OFBool ignoreOffsetTable = OFFalse);
+     OFBool ignoreOffsetTable = OFFalse,
+     Uint32 frameThreads = 1,
+     Uint32 codecThreads = 1);
 
   /** constructor, for use with decoders. Initializes all encoder options to defaults.
    *  @param uidCreation               mode for SOP Instance UID creation (used both for encoding and decoding)
    *  @param planarConfiguration       flag describing how planar configuration of decompressed color images should be handled
    *  @param ignoreOffsetTable         flag indicating whether to ignore the offset table when decompressing multiframe images
+   *  @param frameThreads              maximum number of threads compressing or decompressing the frames of a multi-frame image
+   *  @param codecThreads              number of threads OpenJPEG uses within a single frame, 1 for none
    */
   DJPEG2KCodecParameter(
     J2K_UIDCreation uidCreation = EJ2KUC_default,
     J2K_PlanarConfiguration planarConfiguration = EJ2KPC_restore,
-    OFBool ignoreOffsetTable = OFFalse);
+    OFBool ignoreOffsetTable = OFFalse,
+    Uint32 frameThreads = 1,
+    Uint32 codecThreads = 1);
 
   /// copy constructor
   DJPEG2KCodecParameter(const DJPEG2KCodecParameter& arg);
@@ -161,6 +170,30 @@ public:
     return ignoreOffsetTable_;
   } 
 
+  /** returns the maximum number of threads compressing or decompressing
+   *  the frames of a multi-frame image, 1 for sequential processing
+   *  @return maximum number of frame threads
+   */
+  Uint32 getFrameThreads() const
+  {
+    return frameThreads_;
+  }
+
+  /** returns the number of threads OpenJPEG uses within a single frame.
+   *  Frames that are already processed in parallel are not split further,
+   *  which keeps the total number of threads bounded by the frame threads.
+   *  @param numberOfFrames number of frames of the image
+   *  @return number of OpenJPEG threads, 1 for none
+   */
+  Uint32 getCodecThreads(Uint32 numberOfFrames) const;
+
+  /** sets the number of threads OpenJPEG uses within a single frame.
+   *  May be called while the codecs are in use, frames started afterwards
+   *  use the new value.
+   *  @param codecThreads number of OpenJPEG threads, 1 for none
+   */
+  void setCodecThreads(Uint32 codecThreads);
+
 private:
 
   /// private undefined copy assignment operator
@@ -202,6 +235,18 @@ private:
   /// flag indicating if temporary files should be kept, false if they should be deleted after use
   OFBool ignoreOffsetTable_;
 
+  // ****************************************************
+  // **** Parameters used for encoding and decoding ****
+
+  /// maximum number of threads processing the frames of a multi-frame image
+  Uint32 frameThreads_;
+
+  /// number of threads OpenJPEG uses within a single frame
+  Uint32 codecThreads_;
+
+  /// protects codecThreads_, which may change while the codecs are in use
+  mutable OFMutex codecThreadsMutex_;
+
 };
 
 
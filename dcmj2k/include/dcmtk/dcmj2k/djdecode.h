@@ -39,11 +39,22 @@ public:
    *  @param planarconfig flag indicating how planar configuration
    *    of color images should be encoded upon decompression.
    *  @param ignoreOffsetTable flag indicating whether to ignore the offset table when decompressing multiframe images
+   *  @param frameThreads maximum number of threads decompressing the frames of a multi-frame image
+   *  @param codecThreads number of threads OpenJPEG uses to decompress a single frame
    */
   static void registerCodecs(
     J2K_UIDCreation uidcreation = EJ2KUC_default,
     J2K_PlanarConfiguration planarconfig = EJ2KPC_restore,
-    OFBool ignoreOffsetTable = OFFalse);
+    OFBool ignoreOffsetTable = OFFalse,
+    Uint32 frameThreads = 1,
+    Uint32 codecThreads = 1);
+
+  /** sets the number of threads OpenJPEG uses to decompress a single frame.
+   *  In contrast to cleanup() and registerCodecs(), this may be called while
+   *  other threads use the codecs. Ignored if the codecs are not registered.
+   *  @param codecThreads number of OpenJPEG threads, 1 for none
+   */
+  static void setCodecThreads(Uint32 codecThreads);
 
   /** deregisters decoders.
    *  Attention: Must not be called while other threads might still use
@@ -46,6 +46,8 @@ public:
    *  @param uidCreation               mode for SOP Instance UID creation
    *  @param convertToSC               flag indicating whether image should be converted to Secondary Capture upon compression
    *  @param jplsInterleaveMode        flag describing which interleave the JPEG-LS datastream should use
+   *  @param frameThreads              maximum number of threads compressing the frames of a multi-frame image
+   *  @param codecThreads              number of threads OpenJPEG uses to compress a single frame
    */
   static void registerCodecs(
     OFBool jp2k_optionsEnabled = OFFalse,
@@ -55,7 +57,16 @@ public:
     Uint32 fragmentSize = 0,
     OFBool createOffsetTable = OFTrue,
     J2K_UIDCreation uidCreation = EJ2KUC_default,
-    OFBool convertToSC = OFFalse);
+    OFBool convertToSC = OFFalse,
+    Uint32 frameThreads = 1,
+    Uint32 codecThreads = 1);
+
+  /** sets the number of threads OpenJPEG uses to compress a single frame.
+   *  In contrast to cleanup() and registerCodecs(), this may be called while
+   *  other threads use the codecs. Ignored if the codecs are not registered.
+   *  @param codecThreads number of OpenJPEG threads, 1 for none
+   */
+  static void setCodecThreads(Uint32 codecThreads);
 
   /** deregisters encoders.
    *  Attention: Must not be called while other threads might still use
@@ -37,6 +37,7 @@
 #include "dcmtk/dcmdata/dcvrpobw.h"  /* for class DcmPolymorphOBOW */
 #include "dcmtk/dcmdata/dcswap.h"    /* for swapIfNecessary() */
 #include "dcmtk/dcmdata/dcuid.h"     /* for dcmGenerateUniqueIdentifer()*/
+#include "dcmtk/dcmdata/dcfrmpar.h"  /* for class DcmFrameProcessor */
 #include "dcmtk/dcmj2k/djcparam.h"  /* for class DJP2KCodecParameter */
 #include "dcmtk/dcmj2k/djerror.h"                 /* for private class DJLSError */
 
@@ -46,7 +47,77 @@
 #include "dcmtk/dcmj2k/memory_file.h"
 
 
+class DJPEG2KDecoderBase::FrameTask : public DcmFrameProcessor::Task
+{
+public:
+
+  FrameTask(
+    DcmPixelSequence *pixSeq,
+    const DJPEG2KCodecParameter *djcp,
+    Uint8 *pixelData,
+    Uint32 frameSize,
+    Sint32 imageFrames,
+    Uint16 imageColumns,
+    Uint16 imageRows,
+    Uint16 imageSamplesPerPixel,
+    Uint16 bytesPerSample,
+    Uint16 imagePlanarConfiguration)
+  : pixSeq_(pixSeq)
+  , djcp_(djcp)
+  , pixelData_(pixelData)
+  , frameSize_(frameSize)
+  , imageFrames_(imageFrames)
+  , imageColumns_(imageColumns)
+  , imageRows_(imageRows)
+  , imageSamplesPerPixel_(imageSamplesPerPixel)
+  , bytesPerSample_(bytesPerSample)
+  , imagePlanarConfiguration_(imagePlanarConfiguration)
+  , currentItem_(1) // item 0 contains the offset table
+  , compressedData_(imageFrames, OFstatic_cast(Uint8 *, NULL))
+  , compressedSize_(imageFrames, 0)
+  {
+  }
+
+  virtual ~FrameTask()
+  {
+    for (size_t i = 0; i < compressedData_.size(); ++i) delete[] compressedData_[i];
+  }
+
+  virtual OFCondition prepareFrame(Uint32 frameNo)
+  {
+    // fragments are read in frame order, each frame starts where the previous one ended
+    return readCompressedFrame(pixSeq_, djcp_, frameNo, currentItem_, imageFrames_,
+      compressedData_[frameNo], compressedSize_[frameNo]);
+  }
+
+  virtual OFCondition processFrame(Uint32 frameNo)
+  {
+    FMJPEG2K_DEBUG("JPEG-2000 decoder processes frame " << (frameNo+1));
+    OFCondition result = decodeCompressedFrame(compressedData_[frameNo], compressedSize_[frameNo],
+      pixelData_ + frameNo * frameSize_, frameSize_, imageColumns_, imageRows_,
+      imageSamplesPerPixel_, bytesPerSample_, imagePlanarConfiguration_,
+      djcp_->getCodecThreads(OFstatic_cast(Uint32, imageFrames_)));
+    delete[] compressedData_[frameNo];
+    compressedData_[frameNo] = NULL;
+    return result;
+  }
+
+private:
 
+  DcmPixelSequence *pixSeq_;
+  const DJPEG2KCodecParameter *djcp_;
+  Uint8 *pixelData_;
+  Uint32 frameSize_;
+  Sint32 imageFrames_;
+  Uint16 imageColumns_;
+  Uint16 imageRows_;
+  Uint16 imageSamplesPerPixel_;
+  Uint16 bytesPerSample_;
+  Uint16 imagePlanarConfiguration_;
+  Uint32 currentItem_;
+  OFVector<Uint8 *> compressedData_;
+  OFVector<size_t> compressedSize_;
+};
 
 
 DJPEG2KDecoderBase::DJPEG2KDecoderBase()
@@ -152,25 +223,11 @@ OFCondition DJPEG2KDecoderBase::decode(
   OFCondition result = uncompressedPixelData.createUint16Array(totalSize/sizeof(Uint16), pixeldata16);
   if (result.bad()) return result;
 
-  Uint8 *pixeldata8 = OFreinterpret_cast(Uint8 *, pixeldata16);
-  Sint32 currentFrame = 0;
-  Uint32 currentItem = 1; // item 0 contains the offset table
-  OFBool done = OFFalse;
-
-  while (result.good() && !done)
-  {
-      FMJPEG2K_DEBUG("JPEG-2000 decoder processes frame " << (currentFrame+1));
-
-      result = decodeFrame(pixSeq, djcp, dataset, currentFrame, currentItem, pixeldata8, frameSize,
-          imageFrames, imageColumns, imageRows, imageSamplesPerPixel, bytesPerSample);
-
-      if (result.good())
-      {
-        // increment frame number, check if we're finished
-        if (++currentFrame == imageFrames) done = OFTrue;
-        pixeldata8 += frameSize;
-      }
-  }
+  // frames are independent, decompress them in parallel into their slice of the pixel data
+  FrameTask task(pixSeq, djcp, OFreinterpret_cast(Uint8 *, pixeldata16), frameSize,
+      imageFrames, imageColumns, imageRows, imageSamplesPerPixel, bytesPerSample,
+      decompressedPlanarConfiguration(djcp, dataset, imageSamplesPerPixel));
+  result = DcmFrameProcessor::run(task, OFstatic_cast(Uint32, imageFrames), djcp->getFrameThreads());
 
   // Number of Frames might have changed in case the previous value was wrong
   if (result.good() && (numberOfFramesPresent || (imageFrames > 1)))
@@ -325,19 +382,27 @@ OFCondition DJPEG2KDecoderBase::decodeFrame(
     Uint16 imageSamplesPerPixel,
     Uint16 bytesPerSample)
 {
-  DcmPixelItem *pixItem = NULL;
-  Uint8 * jlsData = NULL;
-  Uint8 * jlsFragmentData = NULL;
-  Uint32 fragmentLength = 0;
+  Uint8 *jlsData = NULL;
   size_t compressedSize = 0;
-  Uint32 fragmentsForThisFrame = 0;
-  OFCondition result = EC_Normal;
-  OFBool ignoreOffsetTable = cp->ignoreOffsetTable();
+  Uint16 imagePlanarConfiguration = decompressedPlanarConfiguration(cp, dataset, imageSamplesPerPixel);
+
+  OFCondition result = readCompressedFrame(fromPixSeq, cp, frameNo, currentItem, imageFrames, jlsData, compressedSize);
+  if (result.good())
+  {
+    result = decodeCompressedFrame(jlsData, compressedSize, buffer, bufSize,
+        imageColumns, imageRows, imageSamplesPerPixel, bytesPerSample, imagePlanarConfiguration,
+        cp->getCodecThreads(OFstatic_cast(Uint32, imageFrames)));
+  }
+  delete[] jlsData;
+  return result;
+}
 
-  // compute the number of JPEG-LS fragments we need in order to decode the next frame
-  fragmentsForThisFrame = computeNumberOfFragments(imageFrames, frameNo, currentItem, ignoreOffsetTable, fromPixSeq);
-  if (fragmentsForThisFrame == 0) result = EC_J2KCannotComputeNumberOfFragments;
 
+Uint16 DJPEG2KDecoderBase::decompressedPlanarConfiguration(
+    const DJPEG2KCodecParameter *cp,
+    DcmItem *dataset,
+    Uint16 imageSamplesPerPixel)
+{
   // determine planar configuration for uncompressed data
   OFString imageSopClass;
   OFString imagePhotometricInterpretation;
@@ -368,6 +433,33 @@ OFCondition DJPEG2KDecoderBase::decodeFrame(
         break;
     }
   }
+  return imagePlanarConfiguration;
+}
+
+
+OFCondition DJPEG2KDecoderBase::readCompressedFrame(
+    DcmPixelSequence * fromPixSeq,
+    const DJPEG2KCodecParameter *cp,
+    Uint32 frameNo,
+    Uint32& currentItem,
+    Sint32 imageFrames,
+    Uint8 *& compressedData,
+    size_t& compressedSize)
+{
+  DcmPixelItem *pixItem = NULL;
+  Uint8 * jlsData = NULL;
+  Uint8 * jlsFragmentData = NULL;
+  Uint32 fragmentLength = 0;
+  Uint32 fragmentsForThisFrame = 0;
+  OFCondition result = EC_Normal;
+  OFBool ignoreOffsetTable = cp->ignoreOffsetTable();
+
+  compressedData = NULL;
+  compressedSize = 0;
+
+  // compute the number of JPEG-LS fragments we need in order to decode the next frame
+  fragmentsForThisFrame = computeNumberOfFragments(imageFrames, frameNo, currentItem, ignoreOffsetTable, fromPixSeq);
+  if (fragmentsForThisFrame == 0) result = EC_J2KCannotComputeNumberOfFragments;
 
   // get the size of all the fragments
   if (result.good())
@@ -410,8 +502,47 @@ OFCondition DJPEG2KDecoderBase::decodeFrame(
     } /* while */
   }
 
-  if (result.good())
-  {
+  if (result.good()) compressedData = jlsData;
+  else delete[] jlsData;
+
+  return result;
+}
+
+
+/** decodes a JPEG 2000 bitstream with OpenJPEG.
+ *  @param jlsData compressed bitstream
+ *  @param compressedSize size of the compressed bitstream
+ *  @param imageColumns number of columns of the full resolution image
+ *  @param imageRows number of rows of the full resolution image
+ *  @param imageSamplesPerPixel number of samples per pixel
+ *  @param codecThreads number of threads OpenJPEG uses, 1 for none
+ *  @param reduceFactor number of highest resolution levels to discard
+ *  @param left left edge of the decoded region
+ *  @param top top edge of the decoded region
+ *  @param right right edge of the decoded region (exclusive), 0 to decode the full image
+ *  @param bottom bottom edge of the decoded region (exclusive)
+ *  @param image decoded image returned in this parameter, to be destroyed with opj_image_destroy()
+ *  @return EC_Normal if successful, an error code otherwise.
+ */
+static OFCondition decodeJ2KBitstream(
+    Uint8 *jlsData,
+    size_t compressedSize,
+    Uint16 imageColumns,
+    Uint16 imageRows,
+    Uint16 imageSamplesPerPixel,
+    Uint32 codecThreads,
+    Uint32 reduceFactor,
+    Uint16 left,
+    Uint16 top,
+    Uint16 right,
+    Uint16 bottom,
+    opj_image_t *& image)
+{
+  image = NULL;
+  if ((jlsData == NULL) || (compressedSize == 0)) return EC_CorruptedData;
+
+  OFCondition result = EC_Normal;
+
 	// see if the last byte is a padding, otherwise, it should be 0xd9
 	if(jlsData[compressedSize - 1] == 0)
 		compressedSize--;
@@ -422,7 +553,6 @@ OFCondition DJPEG2KDecoderBase::decodeFrame(
 	opj_dparameters_t parameters;
 	opj_codec_t* l_codec = NULL;
 	opj_stream_t *l_stream = NULL;
-	opj_image_t *image = NULL;
 	
 	l_stream = opj_stream_create_memory_stream(&mysrc, OPJ_J2K_STREAM_CHUNK_SIZE, true);
 
@@ -455,6 +585,10 @@ OFCondition DJPEG2KDecoderBase::decodeFrame(
 		result = EC_CorruptedData;
 	}
 
+	// let OpenJPEG decode code-blocks and tiles of this frame on worker threads
+	if(result.good() && (codecThreads > 1) && !opj_codec_set_threads(l_codec, OFstatic_cast(int, codecThreads)))
+		FMJPEG2K_DEBUG("JPEG-2000 decoder: OpenJPEG was built without thread support, decoding frame on a single thread");
+
 	if(result.good() && !opj_read_header(l_stream, l_codec, &image))
 	{
 		opj_stream_destroy(l_stream); l_stream = NULL;
@@ -472,59 +606,230 @@ OFCondition DJPEG2KDecoderBase::decodeFrame(
       //else if ((bytesPerSample == 2) && (image->bitspersample <= 8)) result = EC_J2KImageDataMismatch;
     }
 
-    if (!result.good())
+    // discard the highest resolution levels, each level halves width and height.
+    // This fails if no resolution level would be left.
+    if (result.good() && (reduceFactor > 0) && !opj_set_decoded_resolution_factor(l_codec, reduceFactor))
+      result = EC_IllegalParameter;
+
+    // restrict decoding to the code-blocks of the requested region and resolution
+    if (result.good() && ((reduceFactor > 0) || (right > 0)))
     {
-       delete[] jlsData;
+      if (!opj_set_decode_area(l_codec, image, left, top, right, bottom)) result = EC_IllegalParameter;
     }
-    else
+
+    if (result.good())
     {
 	  if (!(opj_decode(l_codec, l_stream, image) && opj_end_decompress(l_codec,	l_stream))) {				
-		opj_stream_destroy(l_stream); l_stream = NULL;
-		opj_destroy_codec(l_codec); l_codec = NULL;
-		opj_image_destroy(image); image = NULL;
 		result = EC_CorruptedData;
 	  }
-            	   	        
-	  if(result.good())
-	  {
+    }
+
+	opj_stream_destroy(l_stream); l_stream = NULL;
+	opj_destroy_codec(l_codec); l_codec = NULL;
+	if (result.bad())
+	{
+	  opj_image_destroy(image); image = NULL;
+	}
+
+  return result;
+}
+
+
+/** copies a decoded image into a frame buffer
+ *  @param image decoded image
+ *  @param buffer pointer to buffer where frame is to be stored
+ *  @param bufSize size of buffer in bytes
+ *  @param columns number of columns of the decoded image
+ *  @param rows number of rows of the decoded image
+ *  @param bytesPerSample number of bytes per sample
+ *  @param imagePlanarConfiguration planar configuration of the decompressed image
+ *  @return EC_Normal if successful, an error code otherwise.
+ */
+static OFCondition copyJ2KImage(
+    opj_image_t *image,
+    void *buffer,
+    Uint32 bufSize,
+    Uint16 columns,
+    Uint16 rows,
+    Uint16 bytesPerSample,
+    Uint16 imagePlanarConfiguration)
+{
+  OFCondition result = EC_Normal;
+
 		  // copy the image depending on planer configuration and bits
 		  if(image->numcomps == 1)	// Greyscale
 		  {
 			  if(image->comps[0].prec <= 8)
-				copyUint32ToUint8(image, OFreinterpret_cast(Uint8*, buffer), imageColumns, imageRows);
+				copyUint32ToUint8(image, OFreinterpret_cast(Uint8*, buffer), columns, rows);
 			  if(image->comps[0].prec > 8)
-				copyUint32ToUint16(image, OFreinterpret_cast(Uint16*, buffer), imageColumns, imageRows);
+				copyUint32ToUint16(image, OFreinterpret_cast(Uint16*, buffer), columns, rows);
 		  }
 		  else if(image->numcomps == 3)
 		  {
 			  if(imagePlanarConfiguration == 0)
 			  {
-				  copyRGBUint8ToRGBUint8(image, OFreinterpret_cast(Uint8*, buffer), imageColumns, imageRows);
+				  copyRGBUint8ToRGBUint8(image, OFreinterpret_cast(Uint8*, buffer), columns, rows);
 			  }
 			  else if(imagePlanarConfiguration == 1)
 			  {
-				  copyRGBUint8ToRGBUint8Planar(image, OFreinterpret_cast(Uint8*, buffer), imageColumns, imageRows);
+				  copyRGBUint8ToRGBUint8Planar(image, OFreinterpret_cast(Uint8*, buffer), columns, rows);
 			  }
 		  }
-	  }
 
-	  opj_stream_destroy(l_stream); l_stream = NULL;
-	  opj_destroy_codec(l_codec); l_codec = NULL;
-	  opj_image_destroy(image); image = NULL;
-	  delete[] jlsData;
-      
-      if (result.good())
+      // decompression is complete, finally adjust byte order if necessary
+      if (bytesPerSample == 1) // we're writing bytes into words
       {
-          // decompression is complete, finally adjust byte order if necessary
-          if (bytesPerSample == 1) // we're writing bytes into words
-          {
-              result = swapIfNecessary(gLocalByteOrder, EBO_LittleEndian, buffer,
-                      bufSize, sizeof(Uint16));
-          }
+          result = swapIfNecessary(gLocalByteOrder, EBO_LittleEndian, buffer,
+                  bufSize, sizeof(Uint16));
       }
+
+  return result;
+}
+
+
+OFCondition DJPEG2KDecoderBase::decodeCompressedFrame(
+    Uint8 *jlsData,
+    size_t compressedSize,
+    void * buffer,
+    Uint32 bufSize,
+    Uint16 imageColumns,
+    Uint16 imageRows,
+    Uint16 imageSamplesPerPixel,
+    Uint16 bytesPerSample,
+    Uint16 imagePlanarConfiguration,
+    Uint32 codecThreads)
+{
+  opj_image_t *image = NULL;
+  OFCondition result = decodeJ2KBitstream(jlsData, compressedSize, imageColumns, imageRows,
+      imageSamplesPerPixel, codecThreads, 0, 0, 0, 0, 0, image);
+  if (result.good())
+  {
+    result = copyJ2KImage(image, buffer, bufSize, imageColumns, imageRows, bytesPerSample, imagePlanarConfiguration);
+    opj_image_destroy(image);
+  }
+  return result;
+}
+
+
+OFCondition DJPEG2KDecoderBase::decodeFrameRegion(
+    DcmPixelSequence *fromPixSeq,
+    const DJPEG2KCodecParameter *cp,
+    DcmItem *dataset,
+    Uint32 frameNo,
+    Uint32& startFragment,
+    Uint32 reduceFactor,
+    Uint16 left,
+    Uint16 top,
+    Uint16 width,
+    Uint16 height,
+    Uint8 *& buffer,
+    Uint32& bufSize,
+    Uint16& columns,
+    Uint16& rows)
+{
+  buffer = NULL;
+  bufSize = 0;
+  columns = 0;
+  rows = 0;
+  if ((fromPixSeq == NULL) || (dataset == NULL)) return EC_IllegalCall;
+
+  // use the default decoder settings if no codec parameters are given
+  DJPEG2KCodecParameter defaultParameters;
+  if (cp == NULL) cp = &defaultParameters;
+
+  // determine properties of uncompressed dataset
+  Uint16 imageSamplesPerPixel = 0;
+  if (dataset->findAndGetUint16(DCM_SamplesPerPixel, imageSamplesPerPixel).bad()) return EC_TagNotFound;
+  // we only handle one or three samples per pixel
+  if ((imageSamplesPerPixel != 3) && (imageSamplesPerPixel != 1)) return EC_InvalidTag;
+
+  Uint16 imageRows = 0;
+  if (dataset->findAndGetUint16(DCM_Rows, imageRows).bad()) return EC_TagNotFound;
+  if (imageRows < 1) return EC_InvalidTag;
+
+  Uint16 imageColumns = 0;
+  if (dataset->findAndGetUint16(DCM_Columns, imageColumns).bad()) return EC_TagNotFound;
+  if (imageColumns < 1) return EC_InvalidTag;
+
+  Uint16 imageBitsStored = 0;
+  if (dataset->findAndGetUint16(DCM_BitsStored, imageBitsStored).bad()) return EC_TagNotFound;
+
+  Uint16 imageBitsAllocated = 0;
+  if (dataset->findAndGetUint16(DCM_BitsAllocated, imageBitsAllocated).bad()) return EC_TagNotFound;
+
+  //we only support up to 16 bits per sample
+  if ((imageBitsStored < 1) || (imageBitsStored > 16)) return EC_J2KUnsupportedBitDepth;
+
+  // determine the number of bytes per sample (bits allocated) for the de-compressed object.
+  Uint16 bytesPerSample = 1;
+  if (imageBitsStored > 8) bytesPerSample = 2;
+  else if (imageBitsAllocated > 8) bytesPerSample = 2;
+
+  // number of frames is an optional attribute - we don't mind if it isn't present.
+  Sint32 imageFrames = 0;
+  dataset->findAndGetSint32(DCM_NumberOfFrames, imageFrames);
+
+  if (imageFrames >= OFstatic_cast(Sint32, fromPixSeq->card()))
+    imageFrames = fromPixSeq->card() - 1; // limit number of frames to number of pixel items - 1
+  if (imageFrames < 1)
+    imageFrames = 1; // default in case the number of frames attribute is absent or contains garbage
+  if (frameNo >= OFstatic_cast(Uint32, imageFrames)) return EC_IllegalParameter;
+
+  // the region must lie within the image, a width or height of 0 extends it to the image border
+  if ((left >= imageColumns) || (top >= imageRows)) return EC_IllegalParameter;
+  Uint16 right = ((width == 0) || (width > imageColumns - left)) ? imageColumns : OFstatic_cast(Uint16, left + width);
+  Uint16 bottom = ((height == 0) || (height > imageRows - top)) ? imageRows : OFstatic_cast(Uint16, top + height);
+
+  OFCondition result = EC_Normal;
+
+  // if the user has provided this information, we trust him.
+  // If the user has passed a zero, try to find out ourselves.
+  if (startFragment == 0)
+  {
+    result = determineStartFragment(frameNo, imageFrames, fromPixSeq, startFragment);
+  }
+
+  Uint8 *jlsData = NULL;
+  size_t compressedSize = 0;
+  if (result.good())
+  {
+    FMJPEG2K_DEBUG("Starting to decode region of frame " << frameNo << " with fragment " << startFragment
+        << " at reduction factor " << reduceFactor);
+    result = readCompressedFrame(fromPixSeq, cp, frameNo, startFragment, imageFrames, jlsData, compressedSize);
+  }
+
+  opj_image_t *image = NULL;
+  if (result.good())
+  {
+    result = decodeJ2KBitstream(jlsData, compressedSize, imageColumns, imageRows, imageSamplesPerPixel,
+        cp->getCodecThreads(1), reduceFactor, left, top, right, bottom, image);
+  }
+  delete[] jlsData;
+
+  if (result.good())
+  {
+    // the size of the decoded region depends on the reduction factor and the code-block grid
+    columns = OFstatic_cast(Uint16, image->comps[0].w);
+    rows = OFstatic_cast(Uint16, image->comps[0].h);
+    bufSize = bytesPerSample * columns * rows * imageSamplesPerPixel;
+    if (bufSize & 1) bufSize++; // align on 16-bit word boundary
+    if (bufSize == 0) result = EC_CorruptedData;
+    else
+    {
+      buffer = new Uint8[bufSize];
+      buffer[bufSize - 1] = 0;
+      result = copyJ2KImage(image, buffer, bufSize, columns, rows, bytesPerSample,
+          decompressedPlanarConfiguration(cp, dataset, imageSamplesPerPixel));
     }
+    opj_image_destroy(image);
   }
 
+  if (result.bad())
+  {
+    delete[] buffer;
+    buffer = NULL;
+    bufSize = 0;
+  }
   return result;
 }
 
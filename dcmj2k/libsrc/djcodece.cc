@@ -48,6 +48,7 @@
 #include "dcmtk/dcmdata/dcvrst.h"    /* for class DcmShortText */
 #include "dcmtk/dcmdata/dcvrus.h"    /* for class DcmUnsignedShort */
 #include "dcmtk/dcmdata/dcswap.h"    /* for swapIfNecessary */
+#include "dcmtk/dcmdata/dcfrmpar.h"  /* for class DcmFrameProcessor */
 
 // dcmjpls includes
 #include "dcmtk/dcmj2k/djcparam.h"  /* for class DJP2KCodecParameter */
@@ -74,6 +75,111 @@ BEGIN_EXTERN_C
 	END_EXTERN_C
 
 
+class DJPEG2KEncoderBase::RawFrameTask : public DcmFrameProcessor::CompressionTask
+{
+public:
+
+	RawFrameTask(
+		const DJPEG2KEncoderBase& encoder,
+		const Uint8 *pixelData,
+		unsigned long frameSize,
+		Uint32 frameCount,
+		Uint16 bitsAllocated,
+		Uint16 columns,
+		Uint16 rows,
+		Uint16 samplesPerPixel,
+		Uint16 planarConfiguration,
+		OFBool pixelRepresentation,
+		const OFString& photometricInterpretation,
+		DcmPixelSequence *pixelSequence,
+		DcmOffsetList &offsetList,
+		const DJPEG2KCodecParameter *djcp)
+	: DcmFrameProcessor::CompressionTask(pixelSequence, offsetList, djcp->getFragmentSize(), frameCount)
+	, encoder_(encoder)
+	, pixelData_(pixelData)
+	, frameSize_(frameSize)
+	, frameCount_(frameCount)
+	, bitsAllocated_(bitsAllocated)
+	, columns_(columns)
+	, rows_(rows)
+	, samplesPerPixel_(samplesPerPixel)
+	, planarConfiguration_(planarConfiguration)
+	, pixelRepresentation_(pixelRepresentation)
+	, photometricInterpretation_(photometricInterpretation)
+	, djcp_(djcp)
+	{
+	}
+
+protected:
+
+	virtual OFCondition compressFrame(Uint32 frameNo, Uint8 *&compressedData, Uint32 &compressedSize)
+	{
+		FMJPEG2K_DEBUG("JPEG-2000 encoder processes frame " << (frameNo+1) << " of " << frameCount_);
+		return encoder_.compressRawFrame(pixelData_ + frameNo * frameSize_, bitsAllocated_, columns_, rows_,
+			samplesPerPixel_, planarConfiguration_, pixelRepresentation_, photometricInterpretation_,
+			compressedData, compressedSize, djcp_, djcp_->getCodecThreads(frameCount_));
+	}
+
+private:
+
+	const DJPEG2KEncoderBase& encoder_;
+	const Uint8 *pixelData_;
+	unsigned long frameSize_;
+	Uint32 frameCount_;
+	Uint16 bitsAllocated_;
+	Uint16 columns_;
+	Uint16 rows_;
+	Uint16 samplesPerPixel_;
+	Uint16 planarConfiguration_;
+	OFBool pixelRepresentation_;
+	OFString photometricInterpretation_;
+	const DJPEG2KCodecParameter *djcp_;
+};
+
+
+class DJPEG2KEncoderBase::RenderedFrameTask : public DcmFrameProcessor::CompressionTask
+{
+public:
+
+	RenderedFrameTask(
+		const DJPEG2KEncoderBase& encoder,
+		const DicomImage *dimage,
+		Uint32 frameCount,
+		const OFString& photometricInterpretation,
+		DcmPixelSequence *pixelSequence,
+		DcmOffsetList &offsetList,
+		const DJPEG2KCodecParameter *djcp,
+		const FMJPEG2KRepresentationParameter *djrp)
+	: DcmFrameProcessor::CompressionTask(pixelSequence, offsetList, djcp->getFragmentSize(), frameCount)
+	, encoder_(encoder)
+	, dimage_(dimage)
+	, frameCount_(frameCount)
+	, photometricInterpretation_(photometricInterpretation)
+	, djcp_(djcp)
+	, djrp_(djrp)
+	{
+	}
+
+protected:
+
+	virtual OFCondition compressFrame(Uint32 frameNo, Uint8 *&compressedData, Uint32 &compressedSize)
+	{
+		FMJPEG2K_DEBUG("JPEG-2000 encoder processes frame " << (frameNo+1) << " of " << frameCount_);
+		return encoder_.compressRenderedFrame(dimage_, photometricInterpretation_,
+			compressedData, compressedSize, djcp_, frameNo, djrp_, djcp_->getCodecThreads(frameCount_));
+	}
+
+private:
+
+	const DJPEG2KEncoderBase& encoder_;
+	const DicomImage *dimage_;
+	Uint32 frameCount_;
+	OFString photometricInterpretation_;
+	const DJPEG2KCodecParameter *djcp_;
+	const FMJPEG2KRepresentationParameter *djrp_;
+};
+
+
 E_TransferSyntax DJPEG2KLosslessEncoder::supportedTransferSyntax() const
 {
 	return EXS_JPEG2000LosslessOnly;
@@ -536,10 +642,9 @@ OFCondition DJPEG2KEncoderBase::losslessRawEncode(
 
 	DcmOffsetList offsetList;
 	unsigned long compressedSize = 0;
-	unsigned long compressedFrameSize = 0;
 	double uncompressedSize = 0.0;
 
-	// render and compress each frame
+	// compress each frame
 	if (result.good())
 	{
 
@@ -550,24 +655,19 @@ OFCondition DJPEG2KEncoderBase::losslessRawEncode(
 			byteSwapped = OFTrue;
 		}
 
-		unsigned long frameCount = OFstatic_cast(unsigned long, numberOfFrames);
+		// numberOfFrames is at least 1
+		Uint32 frameCount = OFstatic_cast(Uint32, numberOfFrames);
 		unsigned long frameSize = columns * rows * samplesPerPixel * bytesAllocated;
-		const Uint8 *framePointer = OFreinterpret_cast(const Uint8 *, pixelData);
 
 		// compute original image size in bytes, ignoring any padding bits.
 		uncompressedSize = columns * rows * samplesPerPixel * bitsStored * frameCount / 8.0;
 
-		for (unsigned long i=0; (i<frameCount) && (result.good()); ++i)
-		{
-			// compress frame
-			FMJPEG2K_DEBUG("JPEG-2000 encoder processes frame " << (i+1) << " of " << frameCount);
-			result = compressRawFrame(framePointer, bitsAllocated, columns, rows,
-				samplesPerPixel, planarConfiguration, pixelRepresentation, photometricInterpretation,
-				pixelSequence, offsetList, compressedFrameSize, djcp);
-
-			compressedSize += compressedFrameSize;
-			framePointer += frameSize;
-		}
+		// frames are independent, compress them in parallel and store them in frame order
+		RawFrameTask task(*this, OFreinterpret_cast(const Uint8 *, pixelData), frameSize, frameCount,
+			bitsAllocated, columns, rows, samplesPerPixel, planarConfiguration, pixelRepresentation,
+			photometricInterpretation, pixelSequence, offsetList, djcp);
+		result = DcmFrameProcessor::run(task, frameCount, djcp->getFrameThreads());
+		compressedSize = task.getCompressedSize();
 	}
 
 	// store pixel sequence if everything went well.
@@ -608,15 +708,14 @@ OFCondition DJPEG2KEncoderBase::compressRawFrame(
 	Uint16 planarConfiguration,
 	OFBool pixelRepresentation,
 	const OFString& photometricInterpretation,
-	DcmPixelSequence *pixelSequence,
-	DcmOffsetList &offsetList,
-	unsigned long &compressedSize,
-	const DJPEG2KCodecParameter *djcp) const
+	Uint8 *&compressedFrame,
+	Uint32 &compressedSize,
+	const DJPEG2KCodecParameter *djcp,
+	Uint32 codecThreads) const
 {
 	OFCondition result = EC_Normal;
 	Uint16 bytesAllocated = bitsAllocated / 8;
 	Uint32 frameSize = width*height*bytesAllocated*samplesPerPixel;
-	Uint32 fragmentSize = djcp->getFragmentSize();	
 	opj_cparameters_t parameters;  
 	opj_image_t *image = NULL; 
 
@@ -669,6 +768,10 @@ OFCondition DJPEG2KEncoderBase::compressRawFrame(
 			result = EC_MemoryExhausted;
 		}
 
+		// let OpenJPEG encode the code-blocks of this frame on worker threads
+		if (result.good() && (codecThreads > 1) && !opj_codec_set_threads(l_codec, OFstatic_cast(int, codecThreads)))
+			FMJPEG2K_DEBUG("JPEG-2000 encoder: OpenJPEG was built without thread support, encoding frame on a single thread");
+
 		DecodeData mysrc((unsigned char*)buffer, size);	
 		l_stream = opj_stream_create_memory_stream(&mysrc, size, OPJ_FALSE);
 
@@ -696,11 +799,10 @@ OFCondition DJPEG2KEncoderBase::compressRawFrame(
 		if (result.good())
 		{
 			// 'size' now contains the size of the compressed data in buffer
-			compressedSize = size;
-			result = pixelSequence->storeCompressedFrame(offsetList, buffer, size, fragmentSize);
+			compressedSize = OFstatic_cast(Uint32, size);
+			compressedFrame = buffer;
 		}
-
-		delete[] buffer;
+		else delete[] buffer;
 	}  
 
 	return result;
@@ -782,13 +884,13 @@ OFCondition DJPEG2KEncoderBase::RenderedEncode(
 
 	DcmOffsetList offsetList;
 	unsigned long compressedSize = 0;
-	unsigned long compressedFrameSize = 0;
 	double uncompressedSize = 0.0;
 
 	// render and compress each frame
 	if (result.good())
 	{
-		unsigned long frameCount = dimage->getFrameCount();
+		// DicomImage keeps the number of frames as Uint32
+		Uint32 frameCount = OFstatic_cast(Uint32, dimage->getFrameCount());
 
 		// compute original image size in bytes, ignoring any padding bits.
 		Uint16 samplesPerPixel = 0;
@@ -796,15 +898,11 @@ OFCondition DJPEG2KEncoderBase::RenderedEncode(
 		uncompressedSize = dimage->getWidth() * dimage->getHeight() *
 			bitsPerSample * frameCount * samplesPerPixel / 8.0;
 
-		for (unsigned long i=0; (i<frameCount) && (result.good()); ++i)
-		{
-			// compress frame
-			FMJPEG2K_DEBUG("JPEG-2000 encoder processes frame " << (i+1) << " of " << frameCount);
-			result = compressRenderedFrame(pixelSequence, dimage,
-				photometricInterpretation, offsetList, compressedFrameSize, djcp, i, djrp);
-
-			compressedSize += compressedFrameSize;
-		}
+		// all frames are rendered by now, compress them in parallel and store them in frame order
+		RenderedFrameTask task(*this, dimage, frameCount, photometricInterpretation,
+			pixelSequence, offsetList, djcp, djrp);
+		result = DcmFrameProcessor::run(task, frameCount, djcp->getFrameThreads());
+		compressedSize = task.getCompressedSize();
 	}
 
 	// store pixel sequence if everything went well.
@@ -840,14 +938,14 @@ OFCondition DJPEG2KEncoderBase::RenderedEncode(
 
 
 OFCondition DJPEG2KEncoderBase::compressRenderedFrame(
-	DcmPixelSequence *pixelSequence,
-	DicomImage *dimage,
+	const DicomImage *dimage,
 	const OFString& photometricInterpretation,
-	DcmOffsetList &offsetList,
-	unsigned long &compressedSize,
+	Uint8 *&compressedFrame,
+	Uint32 &compressedSize,
 	const DJPEG2KCodecParameter *djcp,
 	Uint32 frame,
-	const FMJPEG2KRepresentationParameter *djrp) const
+	const FMJPEG2KRepresentationParameter *djrp,
+	Uint32 codecThreads) const
 {
 	if (dimage == NULL) return EC_IllegalCall;
 
@@ -857,8 +955,6 @@ OFCondition DJPEG2KEncoderBase::compressRenderedFrame(
 	int depth = dimage->getDepth();
 	if ((depth < 1) || (depth > 16)) return EC_J2KUnsupportedBitDepth;
 
-	Uint32 fragmentSize = djcp->getFragmentSize();	
-
 	const DiPixel *dinter = dimage->getInterData();
 	if (dinter == NULL) return EC_IllegalCall;
 
@@ -1063,6 +1159,10 @@ OFCondition DJPEG2KEncoderBase::compressRenderedFrame(
 		result = EC_MemoryExhausted;
 	}
 
+	// let OpenJPEG encode the code-blocks of this frame on worker threads
+	if (result.good() && (codecThreads > 1) && !opj_codec_set_threads(l_codec, OFstatic_cast(int, codecThreads)))
+		FMJPEG2K_DEBUG("JPEG-2000 encoder: OpenJPEG was built without thread support, encoding frame on a single thread");
+
 	DecodeData mysrc((unsigned char*)compressed_buffer, compressed_buffer_size);	
 	l_stream = opj_stream_create_memory_stream(&mysrc, compressed_buffer_size, OPJ_FALSE);
 
@@ -1090,12 +1190,12 @@ OFCondition DJPEG2KEncoderBase::compressRenderedFrame(
 	if (result.good())
 	{
 		// 'compressed_buffer_size' now contains the size of the compressed data in buffer
-		compressedSize = compressed_buffer_size;
-		result = pixelSequence->storeCompressedFrame(offsetList, compressed_buffer, compressed_buffer_size, fragmentSize);
+		compressedSize = OFstatic_cast(Uint32, compressed_buffer_size);
+		compressedFrame = compressed_buffer;
 	}
+	else delete[] compressed_buffer;
 
 	delete[] buffer;
-	delete[] compressed_buffer;
 
 
 	return result;
@@ -37,7 +37,9 @@ DJPEG2KCodecParameter::DJPEG2KCodecParameter(
      J2K_UIDCreation uidCreation,
      OFBool convertToSC,
      J2K_PlanarConfiguration planarConfiguration,
-     OFBool ignoreOffsetTble)
+     OFBool ignoreOffsetTble,
+     Uint32 frameThreads,
+     Uint32 codecThreads)
 : DcmCodecParameter()
 , jp2k_optionsEnabled_(jp2k_optionsEnabled)
 , jp2k_cblkwidth_(jp2k_cblkwidth)
@@ -49,6 +51,9 @@ DJPEG2KCodecParameter::DJPEG2KCodecParameter(
 , convertToSC_(convertToSC)
 , planarConfiguration_(planarConfiguration)
 , ignoreOffsetTable_(ignoreOffsetTble)
+, frameThreads_(frameThreads)
+, codecThreads_(codecThreads)
+, codecThreadsMutex_()
 {
 }
 
@@ -56,7 +61,9 @@ DJPEG2KCodecParameter::DJPEG2KCodecParameter(
 DJPEG2KCodecParameter::DJPEG2KCodecParameter(
     J2K_UIDCreation uidCreation,
     J2K_PlanarConfiguration planarConfiguration,
-    OFBool ignoreOffsetTble)
+    OFBool ignoreOffsetTble,
+    Uint32 frameThreads,
+    Uint32 codecThreads)
 : DcmCodecParameter()
 , jp2k_optionsEnabled_(OFFalse)
 , jp2k_cblkwidth_(0)
@@ -68,6 +75,9 @@ DJPEG2KCodecParameter::DJPEG2KCodecParameter(
 , convertToSC_(OFFalse)
 , planarConfiguration_(planarConfiguration)
 , ignoreOffsetTable_(ignoreOffsetTble)
+, frameThreads_(frameThreads)
+, codecThreads_(codecThreads)
+, codecThreadsMutex_()
 {
 }
 
@@ -84,13 +94,36 @@ DJPEG2KCodecParameter::DJPEG2KCodecParameter(const DJPEG2KCodecParameter& arg)
 , convertToSC_(arg.convertToSC_)
 , planarConfiguration_(arg.planarConfiguration_)
 , ignoreOffsetTable_(arg.ignoreOffsetTable_)
+, frameThreads_(arg.frameThreads_)
+, codecThreads_(1)
+, codecThreadsMutex_()
 {
+  arg.codecThreadsMutex_.lock();
+  codecThreads_ = arg.codecThreads_;
+  arg.codecThreadsMutex_.unlock();
 }
 
 DJPEG2KCodecParameter::~DJPEG2KCodecParameter()
 {
 }
 
+Uint32 DJPEG2KCodecParameter::getCodecThreads(Uint32 numberOfFrames) const
+{
+  // frames that are already processed in parallel are not split further
+  if ((numberOfFrames > 1) && (frameThreads_ > 1)) return 1;
+  codecThreadsMutex_.lock();
+  Uint32 result = codecThreads_;
+  codecThreadsMutex_.unlock();
+  return result;
+}
+
+void DJPEG2KCodecParameter::setCodecThreads(Uint32 codecThreads)
+{
+  codecThreadsMutex_.lock();
+  codecThreads_ = codecThreads;
+  codecThreadsMutex_.unlock();
+}
+
 DcmCodecParameter *DJPEG2KCodecParameter::clone() const
 {
   return new DJPEG2KCodecParameter(*this);
@@ -37,11 +37,13 @@ DJPEG2KDecoder *FMJPEG2KDecoderRegistration::decoder_         = NULL;
 void FMJPEG2KDecoderRegistration::registerCodecs(
     J2K_UIDCreation uidcreation,
     J2K_PlanarConfiguration planarconfig,
-    OFBool ignoreOffsetTable)
+    OFBool ignoreOffsetTable,
+    Uint32 frameThreads,
+    Uint32 codecThreads)
 {
   if (! registered_)
   {
-    cp_ = new DJPEG2KCodecParameter(uidcreation, planarconfig, ignoreOffsetTable);
+    cp_ = new DJPEG2KCodecParameter(uidcreation, planarconfig, ignoreOffsetTable, frameThreads, codecThreads);
     if (cp_)
     {
       decoder_ = new DJPEG2KDecoder();
@@ -52,6 +54,11 @@ void FMJPEG2KDecoderRegistration::registerCodecs(
   }
 }
 
+void FMJPEG2KDecoderRegistration::setCodecThreads(Uint32 codecThreads)
+{
+  if (registered_) cp_->setCodecThreads(codecThreads);
+}
+
 void FMJPEG2KDecoderRegistration::cleanup()
 {
   if (registered_)
@@ -44,13 +44,15 @@ void FMJPEG2KEncoderRegistration::registerCodecs(
 	Uint32 fragmentSize,
 	OFBool createOffsetTable,
 	J2K_UIDCreation uidCreation,
-	OFBool convertToSC)
+	OFBool convertToSC,
+	Uint32 frameThreads,
+	Uint32 codecThreads)
 {
 	if (! registered_)
 	{
 		cp_ = new DJPEG2KCodecParameter(jp2k_optionsEnabled, jp2k_cblkwidth, jp2k_cblkheight,
 			preferCookedEncoding, fragmentSize, createOffsetTable, uidCreation, 
-			convertToSC, EJ2KPC_restore, OFFalse);
+			convertToSC, EJ2KPC_restore, OFFalse, frameThreads, codecThreads);
 
 		if (cp_)
 		{
@@ -63,6 +65,11 @@ void FMJPEG2KEncoderRegistration::registerCodecs(
 	}
 }
 
+void FMJPEG2KEncoderRegistration::setCodecThreads(Uint32 codecThreads)
+{
+	if (registered_) cp_->setCodecThreads(codecThreads);
+}
+
 void FMJPEG2KEncoderRegistration::cleanup()
 {
 	if (registered_)
@@ -251,6 +251,9 @@ protected:
 
 private:
 
+  /// frame task of the true lossless encoder, compresses the frames of a multi-frame image in parallel
+  class TrueLosslessFrameTask;
+
   /** compresses the given uncompressed DICOM color image and stores
    *  the result in the given pixSeq element.
    *  @param YBRmode true if the source image has YBR_FULL or YBR_FULL_422
@@ -68,6 +68,8 @@ public:
    *  @param pAcrNemaCompatibility accept old ACR-NEMA images without photometric interpretation
    *    (only "pseudo" lossless encoder)
    *  @param pTrueLosslessMode Enables true lossless compression (replaces old "pseudo lossless" encoder)
+   *  @param pFrameThreads maximum number of threads compressing the frames of a multi-frame
+   *    image (only true lossless encoder), 1 for sequential compression
    */
   DJCodecParameter(
     E_CompressionColorSpaceConversion pCompressionCSConversion,
@@ -97,7 +99,8 @@ public:
     OFBool pUseModalityRescale = OFFalse,
     OFBool pAcceptWrongPaletteTags = OFFalse,
     OFBool pAcrNemaCompatibility = OFFalse,
-    OFBool pTrueLosslessMode = OFTrue);
+    OFBool pTrueLosslessMode = OFTrue,
+    Uint32 pFrameThreads = 1);
 
   /// copy constructor
   DJCodecParameter(const DJCodecParameter& arg);
@@ -299,6 +302,14 @@ public:
     return trueLosslessMode;
   }
 
+  /** returns the maximum number of threads compressing the frames of a multi-frame image
+   *  @return maximum number of frame threads, 1 for sequential compression
+   */
+  Uint32 getFrameThreads() const
+  {
+    return frameThreads;
+  }
+
   /** returns flag indicating whether the workaround for buggy JPEG lossless images with incorrect predictor 6 is enabled
    *  @return flag indicating whether the workaround for buggy JPEG lossless images with incorrect predictor 6 is enabled
    */
@@ -416,6 +427,9 @@ private:
   /// True losless mode, replaces old "pseudo" lossless encoders, when true (default)
   OFBool trueLosslessMode;
 
+  /// maximum number of threads compressing the frames of a multi-frame image
+  Uint32 frameThreads;
+
   /// flag indicating that the workaround for buggy JPEG lossless images with incorrect predictor 6 is enabled
   OFBool predictor6WorkaroundEnabled_;
 
@@ -70,6 +70,8 @@ public:
    *  @param pAcceptWrongPaletteTags Accept wrong palette attribute tags (only "pseudo lossless" encoder)
    *  @param pAcrNemaCompatibility Accept old ACR-NEMA images without photometric interpretation (only "pseudo lossless" encoder)
    *  @param pRealLossless Enables true lossless compression (replaces old "pseudo" lossless encoders)
+   *  @param pFrameThreads Maximum number of threads compressing the frames of a multi-frame image
+   *     (only true lossless encoder), 1 for sequential compression
    */
   static void registerCodecs(
     E_CompressionColorSpaceConversion pCompressionCSConversion = ECC_lossyYCbCr,
@@ -94,7 +96,8 @@ public:
     OFBool pUseModalityRescale = OFFalse,
     OFBool pAcceptWrongPaletteTags = OFFalse,
     OFBool pAcrNemaCompatibility = OFFalse,
-    OFBool pRealLossless = OFTrue);
+    OFBool pRealLossless = OFTrue,
+    Uint32 pFrameThreads = 1);
 
   /** deregisters encoders.
    *  Attention: Must not be called while other threads might still use
@@ -39,6 +39,7 @@
 #include "dcmtk/dcmdata/dcvrst.h"     /* for class DcmShortText */
 #include "dcmtk/dcmdata/dcvrus.h"     /* for class DcmUnsignedShort */
 #include "dcmtk/dcmdata/dcswap.h"     /* for swapIfNecessary */
+#include "dcmtk/dcmdata/dcfrmpar.h"   /* for class DcmFrameProcessor */
 
 // dcmjpeg includes
 #include "dcmtk/dcmjpeg/djcparam.h"   /* for class DJCodecParameter */
@@ -49,6 +50,84 @@
 
 #include <cmath>
 
+
+class DJCodecEncoder::TrueLosslessFrameTask : public DcmFrameProcessor::CompressionTask
+{
+public:
+
+  TrueLosslessFrameTask(
+    const DJCodecEncoder& encoder,
+    const DcmRepresentationParameter *toRepParam,
+    const DJCodecParameter *djcp,
+    const Uint8 *pixelData,
+    size_t frameSize,
+    Uint32 frameCount,
+    Uint16 bitsAllocated,
+    Uint16 columns,
+    Uint16 rows,
+    Uint16 samplesPerPixel,
+    EP_Interpretation interpr,
+    DcmPixelSequence *pixelSequence,
+    DcmOffsetList& offsetList)
+  : DcmFrameProcessor::CompressionTask(pixelSequence, offsetList, djcp->getFragmentSize(), frameCount)
+  , encoder_(encoder)
+  , toRepParam_(toRepParam)
+  , djcp_(djcp)
+  , pixelData_(pixelData)
+  , frameSize_(frameSize)
+  , bitsAllocated_(bitsAllocated)
+  , columns_(columns)
+  , rows_(rows)
+  , samplesPerPixel_(samplesPerPixel)
+  , interpr_(interpr)
+  {
+  }
+
+protected:
+
+  virtual OFCondition compressFrame(Uint32 frameNo, Uint8 *&compressedData, Uint32 &compressedSize)
+  {
+    // the encoder instances keep per-image state, so each frame gets its own one
+    DJEncoder *jpeg = encoder_.createEncoderInstance(toRepParam_, djcp_, OFstatic_cast(Uint8, bitsAllocated_));
+    if (jpeg == NULL)
+    {
+      DCMJPEG_ERROR("True lossless encoder: Cannot allocate encoder instance");
+      return EC_IllegalCall;
+    }
+    const Uint8 *framePointer = pixelData_ + frameNo * frameSize_;
+    compressedSize = 0;
+    if (bitsAllocated_ == 8)
+    {
+      jpeg->encode(columns_, rows_, interpr_, samplesPerPixel_, OFconst_cast(Uint8*, framePointer), compressedData, compressedSize);
+    }
+    else if (bitsAllocated_ == 16)
+    {
+      jpeg->encode(columns_, rows_, interpr_, samplesPerPixel_, OFreinterpret_cast(Uint16*, OFconst_cast(Uint8*, framePointer)), compressedData, compressedSize);
+    }
+    delete jpeg;
+    if (compressedSize == 0)
+    {
+      DCMJPEG_ERROR("True lossless encoder: Error encoding frame");
+      return EC_CannotChangeRepresentation;
+    }
+    return EC_Normal;
+  }
+
+private:
+
+  const DJCodecEncoder& encoder_;
+  const DcmRepresentationParameter *toRepParam_;
+  const DJCodecParameter *djcp_;
+  const Uint8 *pixelData_;
+  size_t frameSize_;
+  Uint16 bitsAllocated_;
+  Uint16 columns_;
+  Uint16 rows_;
+  Uint16 samplesPerPixel_;
+  EP_Interpretation interpr_;
+};
+
+
 DJCodecEncoder::DJCodecEncoder()
 : DcmCodec()
 {
@@ -501,8 +580,6 @@ OFCondition DJCodecEncoder::encodeTrueLossless(
     Uint16 rows = 0;
     Sint32 numberOfFrames = 1;
     EP_Interpretation interpr = EPI_Unknown;
-    Uint8 *jpegData = NULL;
-    Uint32 jpegLen  = 0;
     OFBool byteSwapped = OFFalse;      // true if we have byte-swapped the original pixel data
     OFBool planConfSwitched = OFFalse; // true if planar configuration was toggled
     DcmOffsetList offsetList;
@@ -633,44 +710,17 @@ OFCondition DJCodecEncoder::encodeTrueLossless(
     // prepare some variables for encoding
     size_t frameCount = OFstatic_cast(size_t, numberOfFrames);
     size_t frameSize = columns * rows * samplesPerPixel * bytesAllocated;
-    const Uint8 *framePointer = OFreinterpret_cast(const Uint8 *, pixelData);
     size_t compressedSize = 0;
 
-    // create encoder corresponding to bit depth (8 or 16 bit)
-    DJEncoder *jpeg = createEncoderInstance(toRepParam, djcp, OFstatic_cast(Uint8, bitsAllocated));
-    if (jpeg)
-    {
-      // main loop for compression: compress each frame
-      for (unsigned int i = 0; i < frameCount && result.good(); i++)
-      {
-        if (bitsAllocated == 8)
-        {
-          jpeg->encode(columns, rows, interpr, samplesPerPixel, OFconst_cast(Uint8*, framePointer), jpegData, jpegLen);
-        }
-        else if (bitsAllocated == 16)
-        {
-          jpeg->encode(columns, rows, interpr, samplesPerPixel, OFreinterpret_cast(Uint16*, OFconst_cast(Uint8*, framePointer)), jpegData, jpegLen);
-        }
-        // update variables
-        compressedSize += jpegLen;
-        framePointer += frameSize;
-        if (jpegLen == 0)
-        {
-          DCMJPEG_ERROR("True lossless encoder: Error encoding frame");
-          result = EC_CannotChangeRepresentation;
-        }
-        else
-        {
-          result = pixelSequence->storeCompressedFrame(offsetList, jpegData, jpegLen, djcp->getFragmentSize());
-        }
-        // free memory
-        delete[] jpegData;
-      }
-    }
-    else
+    // main loop for compression: frames are independent, compress them
+    // in parallel and store them in frame order
+    if (result.good())
     {
-      DCMJPEG_ERROR("True lossless encoder: Cannot allocate encoder instance");
-      result = EC_IllegalCall;
+      TrueLosslessFrameTask task(*this, toRepParam, djcp, OFreinterpret_cast(const Uint8 *, pixelData),
+        frameSize, OFstatic_cast(Uint32, frameCount), bitsAllocated, columns, rows, samplesPerPixel,
+        interpr, pixelSequence, offsetList);
+      result = DcmFrameProcessor::run(task, OFstatic_cast(Uint32, frameCount), djcp->getFrameThreads());
+      compressedSize = task.getCompressedSize();
     }
     if (result.good())
     {
@@ -679,7 +729,6 @@ OFCondition DJCodecEncoder::encodeTrueLossless(
     }
     else
       delete pixelSequence;
-    delete jpeg; // encoder no longer in use
 
     if (result.good() && djcp->getCreateOffsetTable())
     {
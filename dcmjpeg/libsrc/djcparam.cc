@@ -50,7 +50,8 @@ DJCodecParameter::DJCodecParameter(
     OFBool pUseModalityRescale,
     OFBool pAcceptWrongPaletteTags,
     OFBool pAcrNemaCompatibility,
-    OFBool pTrueLosslessMode)
+    OFBool pTrueLosslessMode,
+    Uint32 pFrameThreads)
 : DcmCodecParameter()
 , compressionCSConversion(pCompressionCSConversion)
 , decompressionCSConversion(pDecompressionCSConversion)
@@ -77,6 +78,7 @@ DJCodecParameter::DJCodecParameter(
 , acceptWrongPaletteTags(pAcceptWrongPaletteTags)
 , acrNemaCompatibility(pAcrNemaCompatibility)
 , trueLosslessMode(pTrueLosslessMode)
+, frameThreads(pFrameThreads)
 , predictor6WorkaroundEnabled_(predictor6WorkaroundEnable)
 , cornellWorkaroundEnabled_(cornellWorkaroundEnable)
 , forceSingleFragmentPerFrame(pForceSingleFragmentPerFrame)
@@ -111,6 +113,7 @@ DJCodecParameter::DJCodecParameter(const DJCodecParameter& arg)
 , acceptWrongPaletteTags(arg.acceptWrongPaletteTags)
 , acrNemaCompatibility(arg.acrNemaCompatibility)
 , trueLosslessMode(arg.trueLosslessMode)
+, frameThreads(arg.frameThreads)
 , predictor6WorkaroundEnabled_(arg.predictor6WorkaroundEnabled_)
 , cornellWorkaroundEnabled_(arg.cornellWorkaroundEnabled_)
 , forceSingleFragmentPerFrame(arg.forceSingleFragmentPerFrame)
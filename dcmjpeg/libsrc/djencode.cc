@@ -64,7 +64,8 @@ void DJEncoderRegistration::registerCodecs(
     OFBool pUseModalityRescale,
     OFBool pAcceptWrongPaletteTags,
     OFBool pAcrNemaCompatibility,
-    OFBool pRealLossless)
+    OFBool pRealLossless,
+    Uint32 pFrameThreads)
 {
   if (! registered)
   {
@@ -96,7 +97,8 @@ void DJEncoderRegistration::registerCodecs(
       pUseModalityRescale,
       pAcceptWrongPaletteTags,
       pAcrNemaCompatibility,
-      pRealLossless);
+      pRealLossless,
+      pFrameThreads);
     if (cp)
     {
       // baseline JPEG
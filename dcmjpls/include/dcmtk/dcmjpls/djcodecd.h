@@ -192,6 +192,9 @@ public:
 
 private:
 
+  /// frame task of the decoder, decompresses the frames of a multi-frame image in parallel
+  class FrameTask;
+
   /** returns the transfer syntax that this particular codec
    *  is able to Decode
    *  @return supported transfer syntax
@@ -239,6 +242,63 @@ private:
     Uint16 imageSamplesPerPixel,
     Uint16 bytesPerSample);
 
+  /** determines the planar configuration of the decompressed image
+   *  @param cp codec parameters for this codec
+   *  @param dataset pointer to dataset in which pixel data element is contained
+   *  @param imageSamplesPerPixel number of samples per pixel
+   *  @return planar configuration, 0 for color-by-pixel, 1 for color-by-plane
+   */
+  static Uint16 decompressedPlanarConfiguration(
+    const DJLSCodecParameter *cp,
+    DcmItem *dataset,
+    Uint16 imageSamplesPerPixel);
+
+  /** reads the compressed bitstream of a single frame from the given pixel
+   *  sequence. Accesses the pixel items, so must not run concurrently for
+   *  the same pixel sequence.
+   *  @param fromPixSeq compressed pixel sequence
+   *  @param cp codec parameters for this codec
+   *  @param frameNo number of frame, starting with 0 for the first frame
+   *  @param startFragment index of the compressed fragment the frame starts with,
+   *    updated to the first fragment of the next frame upon successful return
+   *  @param imageFrames number of frames in this image
+   *  @param compressedData compressed bitstream returned in this parameter, allocated with new[]
+   *  @param compressedSize size of the compressed bitstream returned in this parameter
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  static OFCondition readCompressedFrame(
+    DcmPixelSequence * fromPixSeq,
+    const DJLSCodecParameter *cp,
+    Uint32 frameNo,
+    Uint32& startFragment,
+    Sint32 imageFrames,
+    Uint8 *& compressedData,
+    size_t& compressedSize);
+
+  /** decompresses the bitstream of a single frame and stores the result in
+   *  the given buffer. Different frames may be decompressed concurrently.
+   *  @param compressedData compressed bitstream
+   *  @param compressedSize size of the compressed bitstream
+   *  @param buffer pointer to buffer where frame is to be stored
+   *  @param bufSize size of buffer in bytes
+   *  @param imageColumns number of columns for each frame
+   *  @param imageRows number of rows for each frame
+   *  @param imageSamplesPerPixel number of samples per pixel
+   *  @param bytesPerSample number of bytes per sample
+   *  @param imagePlanarConfiguration planar configuration of the decompressed image
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  static OFCondition decodeCompressedFrame(
+    Uint8 *compressedData,
+    size_t compressedSize,
+    void *buffer,
+    Uint32 bufSize,
+    Uint16 imageColumns,
+    Uint16 imageRows,
+    Uint16 imageSamplesPerPixel,
+    Uint16 bytesPerSample,
+    Uint16 imagePlanarConfiguration);
+
   /** determines if a given image requires color-by-plane planar configuration
    *  depending on SOP Class UID (DICOM IOD) and photometric interpretation.
    *  All SOP classes defined in the 2003 edition of the DICOM standard or earlier
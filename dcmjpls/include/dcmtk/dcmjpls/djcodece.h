@@ -195,6 +195,12 @@ public:
 
 private:
 
+  /// frame task of the raw encoder, compresses the frames of a multi-frame image in parallel
+  class RawFrameTask;
+
+  /// frame task of the cooked encoder, compresses the frames of a multi-frame image in parallel
+  class CookedFrameTask;
+
   /** returns the transfer syntax that this particular codec
    *  is able to encode
    *  @return supported transfer syntax
@@ -286,8 +292,7 @@ private:
    *  @param samplesPerPixel image samples per pixel
    *  @param planarConfiguration image planar configuration
    *  @param photometricInterpretation photometric interpretation of the DICOM dataset
-   *  @param pixelSequence object in which the compressed frame is stored
-   *  @param offsetList list of frame offsets updated in this parameter
+   *  @param compressedFrame compressed frame returned in this parameter, allocated with new[]
    *  @param compressedSize size of compressed frame returned in this parameter
    *  @param djcp parameters for the codec
    *  @return EC_Normal if successful, an error code otherwise
@@ -300,16 +305,16 @@ private:
     Uint16 samplesPerPixel,
     Uint16 planarConfiguration,
     const OFString& photometricInterpretation,
-    DcmPixelSequence *pixelSequence,
-    DcmOffsetList &offsetList,
-    unsigned long &compressedSize,
+    Uint8 *&compressedFrame,
+    Uint32 &compressedSize,
     const DJLSCodecParameter *djcp) const;
 
-  /** perform the lossless cooked compression of a single frame
-   *  @param pixelSequence object in which the compressed frame is stored
+  /** perform the lossless cooked compression of a single frame.
+   *  Only reads the intermediate representation of the image, so different
+   *  frames may be compressed concurrently.
    *  @param dimage DicomImage instance used to process frame
    *  @param photometricInterpretation photometric interpretation of the DICOM dataset
-   *  @param offsetList list of frame offsets updated in this parameter
+   *  @param compressedFrame compressed frame returned in this parameter, allocated with new[]
    *  @param compressedSize size of compressed frame returned in this parameter
    *  @param djcp parameters for the codec
    *  @param frame frame index
@@ -317,11 +322,10 @@ private:
    *  @return EC_Normal if successful, an error code otherwise
    */
   OFCondition compressCookedFrame(
-    DcmPixelSequence *pixelSequence,
-    DicomImage *dimage,
+    const DicomImage *dimage,
     const OFString& photometricInterpretation,
-    DcmOffsetList &offsetList,
-    unsigned long &compressedSize,
+    Uint8 *&compressedFrame,
+    Uint32 &compressedSize,
     const DJLSCodecParameter *djcp,
     Uint32 frame,
     Uint16 nearLosslessDeviation) const;
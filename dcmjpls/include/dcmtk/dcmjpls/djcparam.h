@@ -65,6 +65,7 @@ public:
    *  @param ignoreOffsetTable         flag indicating whether to ignore the offset table when decompressing multiframe images
    *  @param jplsInterleaveMode        flag describing which interleave the JPEG-LS datastream should use
    *  @param useFFbitstreamPadding     flag indicating whether the JPEG-LS bitstream should be FF padded as required by DICOM.
+   *  @param frameThreads              maximum number of threads compressing the frames of a multi-frame image
    */
    DJLSCodecParameter(
      OFBool preferCookedEncoding,
@@ -79,7 +80,8 @@ public:
      JLS_PlanarConfiguration planarConfiguration = EJLSPC_restore,
      OFBool ignoreOffsetTable = OFFalse,
      interleaveMode jplsInterleaveMode = interleaveLine,
-     OFBool useFFbitstreamPadding = OFTrue );
+     OFBool useFFbitstreamPadding = OFTrue,
+     Uint32 frameThreads = 1);
 
   /** constructor, for use with decoders. Initializes all encoder options to defaults.
    *  @param uidCreation                 mode for SOP Instance UID creation (used both for encoding and decoding)
@@ -87,12 +89,14 @@ public:
    *  @param ignoreOffsetTable           flag indicating whether to ignore the offset table when decompressing multiframe images
    *  @param forceSingleFragmentPerFrame while decompressing a multiframe image, assume one fragment per frame even if the JPEG
    *                                     data for some frame is incomplete
+   *  @param frameThreads                maximum number of threads decompressing the frames of a multi-frame image
    */
   DJLSCodecParameter(
     JLS_UIDCreation uidCreation = EJLSUC_default,
     JLS_PlanarConfiguration planarConfiguration = EJLSPC_restore,
     OFBool ignoreOffsetTable = OFFalse,
-    OFBool forceSingleFragmentPerFrame = OFFalse);
+    OFBool forceSingleFragmentPerFrame = OFFalse,
+    Uint32 frameThreads = 1);
 
   /// copy constructor
   DJLSCodecParameter(const DJLSCodecParameter& arg);
@@ -224,6 +228,15 @@ public:
     return useFFbitstreamPadding_;
   }
 
+  /** returns the maximum number of threads compressing or decompressing
+   *  the frames of a multi-frame image, 1 for sequential processing
+   *  @return maximum number of frame threads
+   */
+  Uint32 getFrameThreads() const
+  {
+    return frameThreads_;
+  }
+
 private:
 
   /// private undefined copy assignment operator
@@ -284,6 +297,12 @@ private:
    */
   OFBool forceSingleFragmentPerFrame_;
 
+  // ****************************************************
+  // **** Parameters used for encoding and decoding ****
+
+  /// maximum number of threads processing the frames of a multi-frame image
+  Uint32 frameThreads_;
+
 };
 
 
@@ -46,12 +46,14 @@ public:
    *  @param ignoreOffsetTable flag indicating whether to ignore the offset table when decompressing multiframe images
    *  @param forceSingleFragmentPerFrame while decompressing a multiframe image,
    *    assume one fragment per frame even if the JPEG data for some frame is incomplete
+   *  @param frameThreads maximum number of threads decompressing the frames of a multi-frame image
    */
   static void registerCodecs(
     JLS_UIDCreation uidcreation = EJLSUC_default,
     JLS_PlanarConfiguration planarconfig = EJLSPC_restore,
     OFBool ignoreOffsetTable = OFFalse,
-    OFBool forceSingleFragmentPerFrame = OFFalse);
+    OFBool forceSingleFragmentPerFrame = OFFalse,
+    Uint32 frameThreads = 1);
 
   /** deregisters decoders.
    *  Attention: Must not be called while other threads might still use
@@ -33,12 +33,95 @@
 #include "dcmtk/dcmdata/dcvrpobw.h"  /* for class DcmPolymorphOBOW */
 #include "dcmtk/dcmdata/dcswap.h"    /* for swapIfNecessary() */
 #include "dcmtk/dcmdata/dcuid.h"     /* for dcmGenerateUniqueIdentifer()*/
+#include "dcmtk/dcmdata/dcfrmpar.h"  /* for class DcmFrameProcessor */
 #include "dcmtk/dcmjpls/djcparam.h"  /* for class DJLSCodecParameter */
 #include "djerror.h"                 /* for private class DJLSError */
 
 // JPEG-LS library (CharLS) includes
 #include "intrface.h"
 
+class DJLSDecoderBase::FrameTask : public DcmFrameProcessor::Task
+{
+public:
+
+  FrameTask(
+    DcmPixelSequence *pixSeq,
+    const DJLSCodecParameter *djcp,
+    Uint8 *pixelData,
+    Uint32 frameSize,
+    Sint32 imageFrames,
+    Uint16 imageColumns,
+    Uint16 imageRows,
+    Uint16 imageSamplesPerPixel,
+    Uint16 bytesPerSample,
+    Uint16 imagePlanarConfiguration)
+  : pixSeq_(pixSeq)
+  , djcp_(djcp)
+  , pixelData_(pixelData)
+  , frameSize_(frameSize)
+  , imageFrames_(imageFrames)
+  , imageColumns_(imageColumns)
+  , imageRows_(imageRows)
+  , imageSamplesPerPixel_(imageSamplesPerPixel)
+  , bytesPerSample_(bytesPerSample)
+  , imagePlanarConfiguration_(imagePlanarConfiguration)
+  , currentItem_(1) // item 0 contains the offset table
+  , compressedData_(imageFrames, OFstatic_cast(Uint8 *, NULL))
+  , compressedSize_(imageFrames, 0)
+  {
+  }
+
+  virtual ~FrameTask()
+  {
+    for (size_t i = 0; i < compressedData_.size(); ++i) delete[] compressedData_[i];
+  }
+
+  virtual OFCondition prepareFrame(Uint32 frameNo)
+  {
+    // fragments are read in frame order, each frame starts where the previous one ended
+    return readCompressedFrame(pixSeq_, djcp_, frameNo, currentItem_, imageFrames_,
+      compressedData_[frameNo], compressedSize_[frameNo]);
+  }
+
+  virtual OFCondition processFrame(Uint32 frameNo)
+  {
+    DCMJPLS_DEBUG("JPEG-LS decoder processes frame " << (frameNo+1));
+    OFCondition result = decodeCompressedFrame(compressedData_[frameNo], compressedSize_[frameNo],
+      pixelData_ + frameNo * frameSize_, frameSize_, imageColumns_, imageRows_,
+      imageSamplesPerPixel_, bytesPerSample_, imagePlanarConfiguration_);
+    delete[] compressedData_[frameNo];
+    compressedData_[frameNo] = NULL;
+
+    // check if we should enforce "one fragment per frame" while
+    // decompressing a multi-frame image even if stream suspension occurs
+    if ((result == EC_JLSInvalidCompressedData) && djcp_->getForceSingleFragmentPerFrame())
+    {
+      // frame is incomplete. Nevertheless skip to next frame.
+      // This permits decompression of faulty multi-frame images.
+      DCMJPLS_WARN("JPEG-LS bitstream invalid or incomplete, ignoring (but image is likely to be incomplete)");
+      result = EC_Normal;
+    }
+    return result;
+  }
+
+private:
+
+  DcmPixelSequence *pixSeq_;
+  const DJLSCodecParameter *djcp_;
+  Uint8 *pixelData_;
+  Uint32 frameSize_;
+  Sint32 imageFrames_;
+  Uint16 imageColumns_;
+  Uint16 imageRows_;
+  Uint16 imageSamplesPerPixel_;
+  Uint16 bytesPerSample_;
+  Uint16 imagePlanarConfiguration_;
+  Uint32 currentItem_;
+  OFVector<Uint8 *> compressedData_;
+  OFVector<size_t> compressedSize_;
+};
+
+
 E_TransferSyntax DJLSLosslessDecoder::supportedTransferSyntax() const
 {
   return EXS_JPEGLSLossless;
@@ -161,35 +244,17 @@ OFCondition DJLSDecoderBase::decode(
   OFCondition result = uncompressedPixelData.createUint16Array(totalSize/sizeof(Uint16), pixeldata16);
   if (result.bad()) return result;
 
-  Uint8 *pixeldata8 = OFreinterpret_cast(Uint8 *, pixeldata16);
-  Sint32 currentFrame = 0;
-  Uint32 currentItem = 1; // item 0 contains the offset table
-  OFBool done = OFFalse;
-  OFBool forceSingleFragmentPerFrame = djcp->getForceSingleFragmentPerFrame();
+  // frames are independent, decompress them in parallel into their slice of the pixel data
+  Uint16 imagePlanarConfiguration = decompressedPlanarConfiguration(djcp, dataset, imageSamplesPerPixel);
+  FrameTask task(pixSeq, djcp, OFreinterpret_cast(Uint8 *, pixeldata16), frameSize,
+      imageFrames, imageColumns, imageRows, imageSamplesPerPixel, bytesPerSample,
+      imagePlanarConfiguration);
+  result = DcmFrameProcessor::run(task, OFstatic_cast(Uint32, imageFrames), djcp->getFrameThreads());
 
-  while (result.good() && !done)
+  // update planar configuration if we are decoding a color image
+  if (result.good() && (imageSamplesPerPixel > 1))
   {
-      DCMJPLS_DEBUG("JPEG-LS decoder processes frame " << (currentFrame+1));
-
-      result = decodeFrame(pixSeq, djcp, dataset, currentFrame, currentItem, pixeldata8, frameSize,
-          imageFrames, imageColumns, imageRows, imageSamplesPerPixel, bytesPerSample);
-
-      // check if we should enforce "one fragment per frame" while
-      // decompressing a multi-frame image even if stream suspension occurs
-      if ((result == EC_JLSInvalidCompressedData) && forceSingleFragmentPerFrame)
-      {
-        // frame is incomplete. Nevertheless skip to next frame.
-        // This permits decompression of faulty multi-frame images.
-        DCMJPLS_WARN("JPEG-LS bitstream invalid or incomplete, ignoring (but image is likely to be incomplete)");
-        result = EC_Normal;
-      }
-
-      if (result.good())
-      {
-        // increment frame number, check if we're finished
-        if (++currentFrame == imageFrames) done = OFTrue;
-        pixeldata8 += frameSize;
-      }
+    dataset->putAndInsertUint16(DCM_PlanarConfiguration, imagePlanarConfiguration);
   }
 
   // Number of Frames might have changed in case the previous value was wrong
@@ -314,19 +379,33 @@ OFCondition DJLSDecoderBase::decodeFrame(
     Uint16 imageSamplesPerPixel,
     Uint16 bytesPerSample)
 {
-  DcmPixelItem *pixItem = NULL;
-  Uint8 * jlsData = NULL;
-  Uint8 * jlsFragmentData = NULL;
-  Uint32 fragmentLength = 0;
+  Uint8 *jlsData = NULL;
   size_t compressedSize = 0;
-  Uint32 fragmentsForThisFrame = 0;
-  OFCondition result = EC_Normal;
-  OFBool ignoreOffsetTable = cp->ignoreOffsetTable();
+  Uint16 imagePlanarConfiguration = decompressedPlanarConfiguration(cp, dataset, imageSamplesPerPixel);
 
-  // compute the number of JPEG-LS fragments we need in order to decode the next frame
-  fragmentsForThisFrame = computeNumberOfFragments(imageFrames, frameNo, currentItem, ignoreOffsetTable, fromPixSeq);
-  if (fragmentsForThisFrame == 0) result = EC_JLSCannotComputeNumberOfFragments;
+  OFCondition result = readCompressedFrame(fromPixSeq, cp, frameNo, currentItem, imageFrames, jlsData, compressedSize);
+  if (result.good())
+  {
+    result = decodeCompressedFrame(jlsData, compressedSize, buffer, bufSize,
+        imageColumns, imageRows, imageSamplesPerPixel, bytesPerSample, imagePlanarConfiguration);
+  }
+  delete[] jlsData;
+
+  // update planar configuration if we are decoding a color image
+  if (result.good() && (imageSamplesPerPixel > 1))
+  {
+    dataset->putAndInsertUint16(DCM_PlanarConfiguration, imagePlanarConfiguration);
+  }
 
+  return result;
+}
+
+
+Uint16 DJLSDecoderBase::decompressedPlanarConfiguration(
+    const DJLSCodecParameter *cp,
+    DcmItem *dataset,
+    Uint16 imageSamplesPerPixel)
+{
   // determine planar configuration for uncompressed data
   OFString imageSopClass;
   OFString imagePhotometricInterpretation;
@@ -361,6 +440,34 @@ OFCondition DJLSDecoderBase::decodeFrame(
     }
   }
 
+  return imagePlanarConfiguration;
+}
+
+
+OFCondition DJLSDecoderBase::readCompressedFrame(
+    DcmPixelSequence * fromPixSeq,
+    const DJLSCodecParameter *cp,
+    Uint32 frameNo,
+    Uint32& currentItem,
+    Sint32 imageFrames,
+    Uint8 *& compressedData,
+    size_t& compressedSize)
+{
+  DcmPixelItem *pixItem = NULL;
+  Uint8 * jlsData = NULL;
+  Uint8 * jlsFragmentData = NULL;
+  Uint32 fragmentLength = 0;
+  Uint32 fragmentsForThisFrame = 0;
+  OFCondition result = EC_Normal;
+  OFBool ignoreOffsetTable = cp->ignoreOffsetTable();
+
+  compressedData = NULL;
+  compressedSize = 0;
+
+  // compute the number of JPEG-LS fragments we need in order to decode the next frame
+  fragmentsForThisFrame = computeNumberOfFragments(imageFrames, frameNo, currentItem, ignoreOffsetTable, fromPixSeq);
+  if (fragmentsForThisFrame == 0) result = EC_JLSCannotComputeNumberOfFragments;
+
   // get the size of all the fragments
   if (result.good())
   {
@@ -402,6 +509,27 @@ OFCondition DJLSDecoderBase::decodeFrame(
     } /* while */
   }
 
+  if (result.good()) compressedData = jlsData;
+  else delete[] jlsData;
+
+  return result;
+}
+
+
+OFCondition DJLSDecoderBase::decodeCompressedFrame(
+    Uint8 *jlsData,
+    size_t compressedSize,
+    void * buffer,
+    Uint32 bufSize,
+    Uint16 imageColumns,
+    Uint16 imageRows,
+    Uint16 imageSamplesPerPixel,
+    Uint16 bytesPerSample,
+    Uint16 imagePlanarConfiguration)
+{
+  OFCondition result = EC_Normal;
+  if ((jlsData == NULL) || (compressedSize == 0)) result = EC_JLSInvalidCompressedData;
+
   if (result.good())
   {
     JlsParameters params;
@@ -419,15 +547,10 @@ OFCondition DJLSDecoderBase::decodeFrame(
       else if ((bytesPerSample == 2) && (params.bitspersample <= 8)) result = EC_JLSImageDataMismatch;
     }
 
-    if (!result.good())
-    {
-      delete[] jlsData;
-    }
-    else
+    if (result.good())
     {
       err = JpegLsDecode(buffer, bufSize, jlsData, compressedSize, &params);
       result = DJLSError::convert(err);
-      delete[] jlsData;
 
       if (result.good() && imageSamplesPerPixel == 3)
       {
@@ -466,12 +589,6 @@ OFCondition DJLSDecoderBase::decodeFrame(
                       bufSize, sizeof(Uint16));
           }
       }
-
-      // update planar configuration if we are decoding a color image
-      if (result.good() && (imageSamplesPerPixel > 1))
-      {
-        dataset->putAndInsertUint16(DCM_PlanarConfiguration, imagePlanarConfiguration);
-      }
     }
   }
 
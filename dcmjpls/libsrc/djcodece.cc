@@ -42,6 +42,7 @@
 #include "dcmtk/dcmdata/dcvrst.h"    /* for class DcmShortText */
 #include "dcmtk/dcmdata/dcvrus.h"    /* for class DcmUnsignedShort */
 #include "dcmtk/dcmdata/dcswap.h"    /* for swapIfNecessary */
+#include "dcmtk/dcmdata/dcfrmpar.h"  /* for class DcmFrameProcessor */
 
 // dcmjpls includes
 #include "dcmtk/dcmjpls/djcparam.h"  /* for class DJLSCodecParameter */
@@ -67,6 +68,108 @@ BEGIN_EXTERN_C
 END_EXTERN_C
 
 
+class DJLSEncoderBase::RawFrameTask : public DcmFrameProcessor::CompressionTask
+{
+public:
+
+  RawFrameTask(
+    const DJLSEncoderBase& encoder,
+    const Uint8 *pixelData,
+    unsigned long frameSize,
+    Uint32 frameCount,
+    Uint16 bitsAllocated,
+    Uint16 columns,
+    Uint16 rows,
+    Uint16 samplesPerPixel,
+    Uint16 planarConfiguration,
+    const OFString& photometricInterpretation,
+    DcmPixelSequence *pixelSequence,
+    DcmOffsetList &offsetList,
+    const DJLSCodecParameter *djcp)
+  : DcmFrameProcessor::CompressionTask(pixelSequence, offsetList, djcp->getFragmentSize(), frameCount)
+  , encoder_(encoder)
+  , pixelData_(pixelData)
+  , frameSize_(frameSize)
+  , frameCount_(frameCount)
+  , bitsAllocated_(bitsAllocated)
+  , columns_(columns)
+  , rows_(rows)
+  , samplesPerPixel_(samplesPerPixel)
+  , planarConfiguration_(planarConfiguration)
+  , photometricInterpretation_(photometricInterpretation)
+  , djcp_(djcp)
+  {
+  }
+
+protected:
+
+  virtual OFCondition compressFrame(Uint32 frameNo, Uint8 *&compressedData, Uint32 &compressedSize)
+  {
+    DCMJPLS_DEBUG("JPEG-LS encoder processes frame " << (frameNo+1) << " of " << frameCount_);
+    return encoder_.compressRawFrame(pixelData_ + frameNo * frameSize_, bitsAllocated_, columns_, rows_,
+        samplesPerPixel_, planarConfiguration_, photometricInterpretation_,
+        compressedData, compressedSize, djcp_);
+  }
+
+private:
+
+  const DJLSEncoderBase& encoder_;
+  const Uint8 *pixelData_;
+  unsigned long frameSize_;
+  Uint32 frameCount_;
+  Uint16 bitsAllocated_;
+  Uint16 columns_;
+  Uint16 rows_;
+  Uint16 samplesPerPixel_;
+  Uint16 planarConfiguration_;
+  OFString photometricInterpretation_;
+  const DJLSCodecParameter *djcp_;
+};
+
+
+class DJLSEncoderBase::CookedFrameTask : public DcmFrameProcessor::CompressionTask
+{
+public:
+
+  CookedFrameTask(
+    const DJLSEncoderBase& encoder,
+    const DicomImage *dimage,
+    Uint32 frameCount,
+    const OFString& photometricInterpretation,
+    DcmPixelSequence *pixelSequence,
+    DcmOffsetList &offsetList,
+    const DJLSCodecParameter *djcp,
+    Uint16 nearLosslessDeviation)
+  : DcmFrameProcessor::CompressionTask(pixelSequence, offsetList, djcp->getFragmentSize(), frameCount)
+  , encoder_(encoder)
+  , dimage_(dimage)
+  , frameCount_(frameCount)
+  , photometricInterpretation_(photometricInterpretation)
+  , djcp_(djcp)
+  , nearLosslessDeviation_(nearLosslessDeviation)
+  {
+  }
+
+protected:
+
+  virtual OFCondition compressFrame(Uint32 frameNo, Uint8 *&compressedData, Uint32 &compressedSize)
+  {
+    DCMJPLS_DEBUG("JPEG-LS encoder processes frame " << (frameNo+1) << " of " << frameCount_);
+    return encoder_.compressCookedFrame(dimage_, photometricInterpretation_,
+        compressedData, compressedSize, djcp_, frameNo, nearLosslessDeviation_);
+  }
+
+private:
+
+  const DJLSEncoderBase& encoder_;
+  const DicomImage *dimage_;
+  Uint32 frameCount_;
+  OFString photometricInterpretation_;
+  const DJLSCodecParameter *djcp_;
+  Uint16 nearLosslessDeviation_;
+};
+
+
 E_TransferSyntax DJLSLosslessEncoder::supportedTransferSyntax() const
 {
   return EXS_JPEGLSLossless;
@@ -504,7 +607,6 @@ OFCondition DJLSEncoderBase::losslessRawEncode(
 
   DcmOffsetList offsetList;
   unsigned long compressedSize = 0;
-  unsigned long compressedFrameSize = 0;
   double uncompressedSize = 0.0;
 
   // render and compress each frame
@@ -518,24 +620,19 @@ OFCondition DJLSEncoderBase::losslessRawEncode(
        byteSwapped = OFTrue;
     }
 
-    unsigned long frameCount = OFstatic_cast(unsigned long, numberOfFrames);
+    // numberOfFrames is at least 1
+    Uint32 frameCount = OFstatic_cast(Uint32, numberOfFrames);
     unsigned long frameSize = columns * rows * samplesPerPixel * bytesAllocated;
-    const Uint8 *framePointer = OFreinterpret_cast(const Uint8 *, pixelData);
 
     // compute original image size in bytes, ignoring any padding bits.
     uncompressedSize = columns * rows * samplesPerPixel * bitsStored * frameCount / 8.0;
 
-    for (unsigned long i=0; (i<frameCount) && (result.good()); ++i)
-    {
-      // compress frame
-      DCMJPLS_DEBUG("JPEG-LS encoder processes frame " << (i+1) << " of " << frameCount);
-      result = compressRawFrame(framePointer, bitsAllocated, columns, rows,
-          samplesPerPixel, planarConfiguration, photometricInterpretation,
-          pixelSequence, offsetList, compressedFrameSize, djcp);
-
-      compressedSize += compressedFrameSize;
-      framePointer += frameSize;
-    }
+    // frames are independent, compress them in parallel and store them in frame order
+    RawFrameTask task(*this, OFreinterpret_cast(const Uint8 *, pixelData), OFstatic_cast(Uint32, frameSize), frameCount,
+        bitsAllocated, columns, rows, samplesPerPixel, planarConfiguration,
+        photometricInterpretation, pixelSequence, offsetList, djcp);
+    result = DcmFrameProcessor::run(task, frameCount, djcp->getFrameThreads());
+    compressedSize = task.getCompressedSize();
   }
 
   // store pixel sequence if everything went well.
@@ -647,15 +744,13 @@ OFCondition DJLSEncoderBase::compressRawFrame(
   Uint16 samplesPerPixel,
   Uint16 planarConfiguration,
   const OFString& /* photometricInterpretation */,
-  DcmPixelSequence *pixelSequence,
-  DcmOffsetList &offsetList,
-  unsigned long &compressedSize,
+  Uint8 *&compressedFrame,
+  Uint32 &compressedSize,
   const DJLSCodecParameter *djcp) const
 {
   OFCondition result = EC_Normal;
   Uint16 bytesAllocated = bitsAllocated / 8;
   Uint32 frameSize = width*height*bytesAllocated*samplesPerPixel;
-  Uint32 fragmentSize = djcp->getFragmentSize();
   JlsParameters jls_params;
   Uint8 *frameBuffer = NULL;
 
@@ -760,12 +855,12 @@ OFCondition DJLSEncoderBase::compressRawFrame(
 
     if (result.good())
     {
-      compressedSize = OFstatic_cast(unsigned long, bytesWritten);
-      fixPaddingIfNecessary(OFstatic_cast(Uint8 *, buffer), size, compressedSize, djcp->getUseFFbitstreamPadding());
-      result = pixelSequence->storeCompressedFrame(offsetList, buffer, compressedSize, fragmentSize);
+      unsigned long bytesStored = OFstatic_cast(unsigned long, bytesWritten);
+      fixPaddingIfNecessary(OFstatic_cast(Uint8 *, buffer), size, bytesStored, djcp->getUseFFbitstreamPadding());
+      compressedSize = OFstatic_cast(Uint32, bytesStored);
+      compressedFrame = buffer;
     }
-
-    delete[] buffer;
+    else delete[] buffer;
   }
 
   if (frameBuffer)
@@ -883,13 +978,13 @@ OFCondition DJLSEncoderBase::losslessCookedEncode(
 
   DcmOffsetList offsetList;
   unsigned long compressedSize = 0;
-  unsigned long compressedFrameSize = 0;
   double uncompressedSize = 0.0;
 
   // render and compress each frame
   if (result.good())
   {
-    unsigned long frameCount = dimage->getFrameCount();
+    // DicomImage keeps the number of frames as Uint32
+    Uint32 frameCount = OFstatic_cast(Uint32, dimage->getFrameCount());
 
     // compute original image size in bytes, ignoring any padding bits.
     Uint16 samplesPerPixel = 0;
@@ -897,15 +992,11 @@ OFCondition DJLSEncoderBase::losslessCookedEncode(
     uncompressedSize = dimage->getWidth() * dimage->getHeight() *
       bitsPerSample * frameCount * samplesPerPixel / 8.0;
 
-    for (unsigned long i=0; (i<frameCount) && (result.good()); ++i)
-    {
-      // compress frame
-      DCMJPLS_DEBUG("JPEG-LS encoder processes frame " << (i+1) << " of " << frameCount);
-      result = compressCookedFrame(pixelSequence, dimage,
-          photometricInterpretation, offsetList, compressedFrameSize, djcp, i, nearLosslessDeviation);
-
-      compressedSize += compressedFrameSize;
-    }
+    // all frames are rendered by now, compress them in parallel and store them in frame order
+    CookedFrameTask task(*this, dimage, frameCount, photometricInterpretation,
+        pixelSequence, offsetList, djcp, nearLosslessDeviation);
+    result = DcmFrameProcessor::run(task, frameCount, djcp->getFrameThreads());
+    compressedSize = task.getCompressedSize();
   }
 
   // store pixel sequence if everything went well.
@@ -955,11 +1046,10 @@ OFCondition DJLSEncoderBase::losslessCookedEncode(
 
 
 OFCondition DJLSEncoderBase::compressCookedFrame(
-  DcmPixelSequence *pixelSequence,
-  DicomImage *dimage,
+  const DicomImage *dimage,
   const OFString& /* photometricInterpretation */,
-  DcmOffsetList &offsetList,
-  unsigned long &compressedSize,
+  Uint8 *&compressedFrame,
+  Uint32 &compressedSize,
   const DJLSCodecParameter *djcp,
   Uint32 frame,
   Uint16 nearLosslessDeviation) const
@@ -972,8 +1062,6 @@ OFCondition DJLSEncoderBase::compressCookedFrame(
   int depth = dimage->getDepth();
   if ((depth < 1) || (depth > 16)) return EC_JLSUnsupportedBitDepth;
 
-  Uint32 fragmentSize = djcp->getFragmentSize();
-
   const DiPixel *dinter = dimage->getInterData();
   if (dinter == NULL) return EC_IllegalCall;
 
@@ -1167,13 +1255,14 @@ OFCondition DJLSEncoderBase::compressCookedFrame(
   if (result.good())
   {
     // 'compressed_buffer_size' now contains the size of the compressed data in buffer
-    compressedSize = OFstatic_cast(unsigned long, bytesWritten);
-    fixPaddingIfNecessary(OFstatic_cast(Uint8 *, buffer), compressed_buffer_size, compressedSize, djcp->getUseFFbitstreamPadding());
-    result = pixelSequence->storeCompressedFrame(offsetList, compressed_buffer, compressedSize, fragmentSize);
+    unsigned long bytesStored = OFstatic_cast(unsigned long, bytesWritten);
+    fixPaddingIfNecessary(OFstatic_cast(Uint8 *, compressed_buffer), compressed_buffer_size, bytesStored, djcp->getUseFFbitstreamPadding());
+    compressedSize = OFstatic_cast(Uint32, bytesStored);
+    compressedFrame = compressed_buffer;
   }
+  else delete[] compressed_buffer;
 
   delete[] buffer;
-  delete[] compressed_buffer;
   if (frameBuffer)
     delete[] frameBuffer;
 
@@ -36,7 +36,8 @@ DJLSCodecParameter::DJLSCodecParameter(
      JLS_PlanarConfiguration planarConfiguration,
      OFBool ignoreOffsetTble,
      interleaveMode jplsInterleaveMode,
-     OFBool useFFbitstreamPadding)
+     OFBool useFFbitstreamPadding,
+     Uint32 frameThreads)
 : DcmCodecParameter()
 , preferCookedEncoding_(preferCookedEncoding)
 , jpls_t1_(jpls_t1)
@@ -52,6 +53,7 @@ DJLSCodecParameter::DJLSCodecParameter(
 , planarConfiguration_(planarConfiguration)
 , ignoreOffsetTable_(ignoreOffsetTble)
 , forceSingleFragmentPerFrame_(OFFalse)
+, frameThreads_(frameThreads)
 {
 }
 
@@ -60,7 +62,8 @@ DJLSCodecParameter::DJLSCodecParameter(
     JLS_UIDCreation uidCreation,
     JLS_PlanarConfiguration planarConfiguration,
     OFBool ignoreOffsetTble,
-    OFBool forceSingleFragmentPerFrame)
+    OFBool forceSingleFragmentPerFrame,
+    Uint32 frameThreads)
 : DcmCodecParameter()
 , preferCookedEncoding_(OFTrue)
 , jpls_t1_(0)
@@ -76,6 +79,7 @@ DJLSCodecParameter::DJLSCodecParameter(
 , planarConfiguration_(planarConfiguration)
 , ignoreOffsetTable_(ignoreOffsetTble)
 , forceSingleFragmentPerFrame_(forceSingleFragmentPerFrame)
+, frameThreads_(frameThreads)
 {
 }
 
@@ -95,6 +99,7 @@ DJLSCodecParameter::DJLSCodecParameter(const DJLSCodecParameter& arg)
 , planarConfiguration_(arg.planarConfiguration_)
 , ignoreOffsetTable_(arg.ignoreOffsetTable_)
 , forceSingleFragmentPerFrame_(arg.forceSingleFragmentPerFrame_)
+, frameThreads_(arg.frameThreads_)
 {
 }
 
@@ -35,11 +35,12 @@ void DJLSDecoderRegistration::registerCodecs(
     JLS_UIDCreation uidcreation,
     JLS_PlanarConfiguration planarconfig,
     OFBool ignoreOffsetTable,
-    OFBool forceSingleFragmentPerFrame)
+    OFBool forceSingleFragmentPerFrame,
+    Uint32 frameThreads)
 {
   if (! registered_)
   {
-    cp_ = new DJLSCodecParameter(uidcreation, planarconfig, ignoreOffsetTable, forceSingleFragmentPerFrame);
+    cp_ = new DJLSCodecParameter(uidcreation, planarconfig, ignoreOffsetTable, forceSingleFragmentPerFrame, frameThreads);
     if (cp_)
     {
       losslessdecoder_ = new DJLSLosslessDecoder();
@@ -43,13 +43,14 @@ void DJLSEncoderRegistration::registerCodecs(
     JLS_UIDCreation uidCreation,
     OFBool convertToSC,
     DJLSCodecParameter::interleaveMode jplsInterleaveMode,
-    OFBool useFFbitstreamPadding)
+    OFBool useFFbitstreamPadding,
+    Uint32 frameThreads)
 {
   if (! registered_)
   {
     cp_ = new DJLSCodecParameter(preferCookedEncoding, jpls_t1, jpls_t2, jpls_t3,
       jpls_reset, fragmentSize, createOffsetTable, uidCreation,
-      convertToSC, EJLSPC_restore, OFFalse, jplsInterleaveMode, useFFbitstreamPadding);
+      convertToSC, EJLSPC_restore, OFFalse, jplsInterleaveMode, useFFbitstreamPadding, frameThreads);
 
     if (cp_)
     {
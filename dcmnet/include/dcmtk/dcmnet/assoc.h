@@ -105,12 +105,13 @@
 
 /*
  * There have been reports that smaller PDUs work better in some environments.
- * Allow a 4K minimum and a 128K maximum. Any further extension requires
- * modifications in the DUL code.
+ * Allow a 4K minimum and a 4M maximum. Large PDUs reduce the number of PDU
+ * headers, system calls and PDV iterations for bulk transfers, but the DUL
+ * allocates a receive buffer of the negotiated size for each association.
  */
 #define ASC_DEFAULTMAXPDU       16384 /* 16K is default if nothing else specified */
 #define ASC_MINIMUMPDUSIZE       4096
-#define ASC_MAXIMUMPDUSIZE     131072 /* 128K - we only handle this big */
+#define ASC_MAXIMUMPDUSIZE    4194304 /* 4M - we only handle this big */
 
 /*
 ** Type Definitions
@@ -116,6 +116,18 @@ public:
    */
   virtual ssize_t write(void *buf, size_t nbyte) = 0;
 
+  /** attempts to write the contents of two buffers to the transport
+   *  connection as if they were a single contiguous buffer, e.g.\ a PDU
+   *  header followed by its payload. The default implementation calls
+   *  write() for each buffer.
+   *  @param buf1 first buffer
+   *  @param nbyte1 number of bytes to write from the first buffer
+   *  @param buf2 second buffer
+   *  @param nbyte2 number of bytes to write from the second buffer
+   *  @return number of bytes written in total, negative number if unsuccessful.
+   */
+  virtual ssize_t writeGather(void *buf1, size_t nbyte1, void *buf2, size_t nbyte2);
+
   /** Closes the transport connection. If a secure connection
    *  is used, a closure alert is sent before the connection
    *  is closed. Abstract method.
@@ -301,6 +313,17 @@ public:
    */
   virtual ssize_t write(void *buf, size_t nbyte);
 
+  /** attempts to write the contents of two buffers to the transport
+   *  connection using writev() or WSASend(), without copying them into
+   *  an intermediate buffer. Partial writes are resumed where possible.
+   *  @param buf1 first buffer
+   *  @param nbyte1 number of bytes to write from the first buffer
+   *  @param buf2 second buffer
+   *  @param nbyte2 number of bytes to write from the second buffer
+   *  @return number of bytes written in total, negative number if unsuccessful.
+   */
+  virtual ssize_t writeGather(void *buf1, size_t nbyte1, void *buf2, size_t nbyte2);
+
   /** Closes the transport connection. If a secure connection
    *  is used, a closure alert is sent before the connection
    *  is closed.
@@ -272,6 +272,29 @@ class DCMTK_DCMNET_EXPORT DcmStorageSCU
                              const E_FileReadMode readMode = ERM_fileOnly,
                              const OFBool checkValues = OFTrue);
 
+    /** add a SOP instance stored in a given DICOM file to the list of instances to be
+     *  transferred, using UID values the caller has already read from the file.  Unlike
+     *  the other addDicomFile() method, the file is not accessed before it is sent, which
+     *  avoids reading the header of each file twice.  The values are checked in the same
+     *  way (see checkSOPInstance() for details).  DICOMDIR files are not recognized.
+     *  @param  filename           name of the DICOM file that contains the SOP instance
+     *  @param  sopClassUID        SOP Class UID of the SOP instance
+     *  @param  sopInstanceUID     SOP Instance UID of the SOP instance
+     *  @param  transferSyntaxUID  Transfer Syntax UID of the SOP instance
+     *  @param  readMode           read mode passed to the DcmFileFormat::loadFile() method
+     *                             when the SOP instance is sent
+     *  @param  checkValues        flag indicating whether to check the UID values for
+     *                             validity and conformance.  If OFFalse, only empty values
+     *                             are rejected.
+     *  @return status, EC_Normal if successful, an error code otherwise
+     */
+    OFCondition addDicomFile(const OFFilename &filename,
+                             const OFString &sopClassUID,
+                             const OFString &sopInstanceUID,
+                             const OFString &transferSyntaxUID,
+                             const E_FileReadMode readMode = ERM_fileOnly,
+                             const OFBool checkValues = OFTrue);
+
     /** add a SOP instance from a given DICOM dataset to the list of instances to be
      *  transferred.  Before adding the SOP instance to the list, it is checked for validity
      *  and conformance to the DICOM standard (see checkSOPInstance() for details).  However,
@@ -220,6 +220,17 @@ protected:
    */
   virtual OFCondition initializeNework(T_ASC_Network** network);
 
+  /** Join and delete all workers whose threads have terminated since the
+   *  last call. Called automatically before a new worker is started.
+   */
+  void cleanupExitedWorkers();
+
+  /** Wait for all workers that are still handling an association to
+   *  terminate, then join and delete them. Must not be called from within
+   *  a worker thread.
+   */
+  void joinWorkers();
+
 private:
 
   /// Possible run modes of pool
@@ -239,6 +250,8 @@ private:
   OFList<DcmBaseSCPWorker*> m_workersBusy;
   /// List of all workers being idle, i.e.\ not running a connection
   OFList<DcmBaseSCPWorker*> m_workersIdle;
+  /// List of all workers whose thread has terminated but was not joined yet
+  OFList<DcmBaseSCPWorker*> m_workersExited;
 
   /// SCP configuration to be used by pool and all workers
   DcmSCPConfig m_cfg;
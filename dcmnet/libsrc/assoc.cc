@@ -319,6 +319,12 @@ ASC_createAssociationParameters(T_ASC_Parameters ** params,
             << maxReceivePDUSize << " too small (using " << ASC_MINIMUMPDUSIZE << ")");
       maxReceivePDUSize = ASC_MINIMUMPDUSIZE;
     }
+    else if (maxReceivePDUSize > ASC_MAXIMUMPDUSIZE)
+    {
+      DCMNET_WARN("ASC_createAssociationParameters: maxReceivePDUSize "
+            << maxReceivePDUSize << " too large (using " << ASC_MAXIMUMPDUSIZE << ")");
+      maxReceivePDUSize = ASC_MAXIMUMPDUSIZE;
+    }
 
     (*params)->ourMaxPDUReceiveSize = maxReceivePDUSize;
     (*params)->DULparams.maxPDU = maxReceivePDUSize;
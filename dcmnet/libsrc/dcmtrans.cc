@@ -44,6 +44,9 @@ BEGIN_EXTERN_C
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>        /* for writev() */
+#endif
 END_EXTERN_C
 
 #ifdef DCMTK_HAVE_POLL
@@ -144,6 +147,15 @@ DcmTransportConnection::~DcmTransportConnection()
 {
 }
 
+ssize_t DcmTransportConnection::writeGather(void *buf1, size_t nbyte1, void *buf2, size_t nbyte2)
+{
+  ssize_t written = write(buf1, nbyte1);
+  if (written != OFstatic_cast(ssize_t, nbyte1)) return written;
+  ssize_t written2 = write(buf2, nbyte2);
+  if (written2 < 0) return written2;
+  return written + written2;
+}
+
 OFBool DcmTransportConnection::safeSelectReadableAssociation(DcmTransportConnection *connections[], int connCount, int timeout)
 {
   int numberOfRounds = timeout+1;
@@ -356,6 +368,55 @@ ssize_t DcmTCPConnection::write(void *buf, size_t nbyte)
 #endif
 }
 
+ssize_t DcmTCPConnection::writeGather(void *buf1, size_t nbyte1, void *buf2, size_t nbyte2)
+{
+#ifdef HAVE_WINSOCK_H
+  WSABUF buffers[2];
+  buffers[0].buf = OFstatic_cast(char *, buf1);
+  buffers[0].len = OFstatic_cast(ULONG, nbyte1);
+  buffers[1].buf = OFstatic_cast(char *, buf2);
+  buffers[1].len = OFstatic_cast(ULONG, nbyte2);
+  DWORD written = 0;
+  if (WSASend(getSocket(), buffers, 2, &written, 0, NULL, NULL) != 0) return -1;
+  return OFstatic_cast(ssize_t, written);
+#elif defined(HAVE_SYS_UIO_H)
+  struct iovec buffers[2];
+  buffers[0].iov_base = buf1;
+  buffers[0].iov_len = nbyte1;
+  buffers[1].iov_base = buf2;
+  buffers[1].iov_len = nbyte2;
+  struct iovec *next = buffers;
+  int count = 2;
+  ssize_t total = 0;
+  while (count > 0)
+  {
+    ssize_t written = ::writev(getSocket(), next, count);
+    if (written < 0)
+    {
+      // retry if interrupted after a partial write, since the caller cannot resume
+      if ((total > 0) && (OFStandard::getLastNetworkErrorCode().value() == DCMNET_EINTR)) continue;
+      return (total > 0) ? total : written;
+    }
+    total += written;
+    // skip the buffers that have been written completely, then resume within the next one
+    while ((count > 0) && (OFstatic_cast(size_t, written) >= next->iov_len))
+    {
+      written -= OFstatic_cast(ssize_t, next->iov_len);
+      ++next;
+      --count;
+    }
+    if (count > 0)
+    {
+      next->iov_base = OFstatic_cast(char *, next->iov_base) + written;
+      next->iov_len -= OFstatic_cast(size_t, written);
+    }
+  }
+  return total;
+#else
+  return DcmTransportConnection::writeGather(buf1, nbyte1, buf2, nbyte2);
+#endif
+}
+
 void DcmTCPConnection::close()
 {
   closeTransportConnection();
@@ -425,6 +425,42 @@ OFCondition DcmStorageSCU::addDicomFile(const OFFilename &filename,
 }
 
 
+OFCondition DcmStorageSCU::addDicomFile(const OFFilename &filename,
+                                        const OFString &sopClassUID,
+                                        const OFString &sopInstanceUID,
+                                        const OFString &transferSyntaxUID,
+                                        const E_FileReadMode readMode,
+                                        const OFBool checkValues)
+{
+    OFCondition status = EC_IllegalParameter;
+    // check for non-empty filename
+    if (!filename.isEmpty())
+    {
+        DCMNET_DEBUG("adding DICOM file '" << filename << "' with known SOP instance");
+        // check the SOP instance before adding it
+        status = checkSOPInstance(sopClassUID, sopInstanceUID, transferSyntaxUID, checkValues);
+        if (status.good())
+        {
+            // create a new entry ...
+            TransferEntry *entry = new TransferEntry(filename, readMode, sopClassUID, sopInstanceUID, transferSyntaxUID);
+            if (entry != NULL)
+            {
+                // ... and add it to the list of SOP instances to be transferred
+                TransferList.push_back(entry);
+            } else
+                status = EC_MemoryExhausted;
+        }
+        if (status.good())
+            DCMNET_DEBUG("successfully added SOP instance " << sopInstanceUID << " to the transfer list");
+        else
+            DCMNET_ERROR("cannot add DICOM file to the transfer list: " << filename << ": " << status.text());
+    } else {
+        DCMNET_ERROR("cannot add DICOM file with empty filename");
+    }
+    return status;
+}
+
+
 OFCondition DcmStorageSCU::addDataset(DcmDataset *dataset,
                                       const E_TransferSyntax datasetXfer,
                                       const E_HandlingMode handlingMode,
@@ -125,6 +125,7 @@ END_EXTERN_C
 #include "dcmtk/ofstd/ofstd.h"
 
 #include "dcmtk/dcmnet/dul.h"
+#include "dcmtk/dcmnet/assoc.h"    /* for ASC_MINIMUMPDUSIZE, ASC_MAXIMUMPDUSIZE */
 #include "dcmtk/dcmnet/dulstruc.h"
 #include "dulpriv.h"
 #include "dulfsm.h"
@@ -186,8 +187,8 @@ static OFString dump_uid(const char *UID, const char *indent);
 static void clearRequestorsParams(DUL_ASSOCIATESERVICEPARAMETERS * params);
 static void clearPresentationContext(LST_HEAD ** l);
 
-#define MIN_PDU_LENGTH  4*1024
-#define MAX_PDU_LENGTH  128*1024
+#define MIN_PDU_LENGTH  ASC_MINIMUMPDUSIZE
+#define MAX_PDU_LENGTH  ASC_MAXIMUMPDUSIZE
 
 static OFBool processIsForkedChild = OFFalse;
 static OFBool shouldFork = OFFalse;
@@ -3072,7 +3072,7 @@ writeDataPDU(PRIVATE_ASSOCIATIONKEY ** association,
         head[24];
     unsigned long
         length;
-    int
+    ssize_t
         nbytes;
 
     /* construct a stream variable that will contain PDU head information */
@@ -3082,30 +3082,18 @@ writeDataPDU(PRIVATE_ASSOCIATIONKEY ** association,
     OFCondition cond = streamDataPDUHead(pdu, head, sizeof(head), &length);
     if (cond.bad()) return cond;
 
-    /* send the PDU head information (see above) */
-    do
-    {
-      nbytes = (*association)->connection ? (*association)->connection->write((char*)head, size_t(length)) : 0;
-    } while (nbytes == -1 && OFStandard::getLastNetworkErrorCode().value() == DCMNET_EINTR);
-
-    /* if not all head information was sent, return an error */
-    if ((unsigned long) nbytes != length)
-    {
-        OFString msg = "TCP I/O Error (";
-        msg += OFStandard::getLastNetworkErrorCode().message();
-        msg += ") occurred in routine: writeDataPDU";
-        return makeDcmnetCondition(DULC_TCPIOERROR, OF_error, msg.c_str());
-    }
-
-    /* send the PDU's PDV data (note that our representation of a PDU can only contain one PDV.) */
+    /* send the PDU head information (see above) and the PDU's PDV data in one gathering */
+    /* write, so that the PDV data does not have to be copied next to the head first */
+    /* (note that our representation of a PDU can only contain one PDV.) */
+    unsigned long pdvLength = pdu->presentationDataValue.length - 2;
     do
     {
-      nbytes = (*association)->connection ? (*association)->connection->write((char*)pdu->presentationDataValue.data,
-        size_t(pdu->presentationDataValue.length - 2)) : 0;
+      nbytes = (*association)->connection ? (*association)->connection->writeGather((char*)head, size_t(length),
+        pdu->presentationDataValue.data, size_t(pdvLength)) : 0;
     } while (nbytes == -1 && OFStandard::getLastNetworkErrorCode().value() == DCMNET_EINTR);
 
-        /* if not all head information was sent, return an error */
-    if ((unsigned long) nbytes != pdu->presentationDataValue.length - 2)
+    /* if not all information was sent, return an error */
+    if ((unsigned long) nbytes != length + pdvLength)
     {
         OFString msg = "TCP I/O Error (";
         msg += OFStandard::getLastNetworkErrorCode().message();
@@ -36,6 +36,7 @@ DcmBaseSCPPool::DcmBaseSCPPool()
   : m_criticalSection(),
     m_workersBusy(),
     m_workersIdle(),
+    m_workersExited(),
     m_cfg(),
     m_maxWorkers(5),
     m_runMode( LISTEN )
@@ -116,25 +117,7 @@ OFCondition DcmBaseSCPPool::listen()
     }
   }
 
-  m_criticalSection.lock();
-  m_runMode = SHUTDOWN;
-
-  // iterate over all busy workers, join their threads and delete them.
-  for
-  (
-    OFListIterator( DcmBaseSCPPool::DcmBaseSCPWorker* ) it = m_workersBusy.begin();
-    it != m_workersBusy.end();
-    ++it
-  )
-  {
-    m_criticalSection.unlock();
-    (*it)->join();
-    delete *it;
-    m_criticalSection.lock();
-  }
-
-  m_workersBusy.clear();
-  m_criticalSection.unlock();
+  joinWorkers();
 
   /* In the end, clean up the rest of the memory and drop network */
   ASC_dropNetwork(&network);
@@ -185,6 +168,9 @@ void DcmBaseSCPPool::setMaxThreads(const Uint16 maxWorkers)
 OFCondition DcmBaseSCPPool::runAssociation(T_ASC_Association *assoc,
                                            const DcmSharedSCPConfig& sharedConfig)
 {
+  /* Free the threads of workers that are done with their association */
+  cleanupExitedWorkers();
+
   /* Try to find idle worker thread */
   OFCondition result = EC_Normal;
   DcmBaseSCPWorker *chosen = NULL;
@@ -282,10 +268,64 @@ void DcmBaseSCPPool::notifyThreadExit(DcmBaseSCPPool::DcmBaseSCPWorker* thread,
   {
     DCMNET_DEBUG("DcmBaseSCPPool: Worker thread #" << thread->threadID() << " exited with error: " << result.text());
     m_workersBusy.remove(thread);
-    delete thread;
-    thread = NULL;
+    // the thread is still running at this point, so it is joined and
+    // deleted later on by cleanupExitedWorkers()
+    m_workersExited.push_back(thread);
+  }
+  m_criticalSection.unlock();
+}
+
+// ----------------------------------------------------------------------------
+
+void DcmBaseSCPPool::cleanupExitedWorkers()
+{
+  OFList<DcmBaseSCPWorker*> exited;
+  m_criticalSection.lock();
+  while (!m_workersExited.empty())
+  {
+    exited.push_back(m_workersExited.front());
+    m_workersExited.pop_front();
   }
   m_criticalSection.unlock();
+
+  // join outside of the critical section, the threads are about to exit anyway
+  for
+  (
+    OFListIterator( DcmBaseSCPPool::DcmBaseSCPWorker* ) it = exited.begin();
+    it != exited.end();
+    ++it
+  )
+  {
+    (*it)->join();
+    delete *it;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void DcmBaseSCPPool::joinWorkers()
+{
+  m_criticalSection.lock();
+  m_runMode = SHUTDOWN;
+
+  // iterate over all busy workers, join their threads and delete them.
+  for
+  (
+    OFListIterator( DcmBaseSCPPool::DcmBaseSCPWorker* ) it = m_workersBusy.begin();
+    it != m_workersBusy.end();
+    ++it
+  )
+  {
+    m_criticalSection.unlock();
+    (*it)->join();
+    delete *it;
+    m_criticalSection.lock();
+  }
+
+  m_workersBusy.clear();
+  m_criticalSection.unlock();
+
+  cleanupExitedWorkers();
 }
 
 // ----------------------------------------------------------------------------
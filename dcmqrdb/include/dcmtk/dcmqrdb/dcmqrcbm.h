@@ -31,6 +31,8 @@ class DcmQueryRetrieveDatabaseHandle;
 class DcmQueryRetrieveOptions;
 class DcmQueryRetrieveConfig;
 class DcmQueryRetrieveDatabaseStatus;
+class DcmQueryRetrieveMoveSubOpPool;
+class DcmQueryRetrieveMoveSubOpSender;
 
 /** this class maintains the context information that is passed to the
  *  callback function called by DIMSE_moveProvider.
@@ -75,12 +77,19 @@ public:
     , nCompleted(0)
     , nFailed(0)
     , nWarning(0)
+    , subAssocPeer()
+    , subOpPool(NULL)
     {
       origAETitle[0] = '\0';
       origHostName[0] = '\0';
       dstAETitle[0] = '\0';
     }
 
+    /** destructor. Stops the sub-operation senders and releases the sub-associations
+     *  if the move provider returned before the final response, e.g. after an A-ABORT.
+     */
+    ~DcmQueryRetrieveMoveContext();
+
     /** callback handler called by the DIMSE_storeProvider callback function.
      *  @param cancelled (in) flag indicating whether a C-CANCEL was received
      *  @param request original move request (in)
@@ -108,6 +117,9 @@ public:
 
 private:
 
+    /// sender threads run the sub-operations of their sub-association
+    friend class DcmQueryRetrieveMoveSubOpSender;
+
     /// private undefined copy constructor
     DcmQueryRetrieveMoveContext(const DcmQueryRetrieveMoveContext& other);
 
@@ -115,10 +127,17 @@ private:
     DcmQueryRetrieveMoveContext& operator=(const DcmQueryRetrieveMoveContext& other);
 
     void addFailedUIDInstance(const char *sopInstance);
-    OFCondition performMoveSubOp(DIC_UI sopClass, DIC_UI sopInstance, char *fname);
+    OFCondition performMoveSubOp(T_ASC_Association *assoc, DIC_UI sopClass, DIC_UI sopInstance, char *fname);
     OFCondition buildSubAssociation(T_DIMSE_C_MoveRQ *request);
+    OFCondition createSubAssociation(T_ASC_Association **assoc);
     OFCondition closeSubAssociation();
+    void startSubOpSenders();
+    void stopSubOpSenders();
+    void lockCounters();
+    void unlockCounters();
+    void countSubOp(DIC_US& counter, const char *failedInstance = NULL);
     void moveNextImage(DcmQueryRetrieveDatabaseStatus * dbStatus);
+    void moveNextImages(DcmQueryRetrieveDatabaseStatus * dbStatus);
     void failAllSubOperations(DcmQueryRetrieveDatabaseStatus * dbStatus);
     void buildFailedInstanceList(DcmDataset ** rspIds);
     OFBool mapMoveDestination(
@@ -183,6 +202,14 @@ private:
     /// number of completed sub-operations that causes warnings
     DIC_US nWarning;
 
+    /// presentation address (host:port) of the move destination
+    OFString subAssocPeer;
+
+    /** additional sub-associations and sender threads if the sub-operations are run in parallel,
+     *  NULL if they are performed one by one over subAssoc
+     */
+    DcmQueryRetrieveMoveSubOpPool *subOpPool;
+
 };
 
 #endif
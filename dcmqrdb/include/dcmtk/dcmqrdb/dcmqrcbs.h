@@ -28,6 +28,8 @@
 
 class DcmQueryRetrieveDatabaseHandle;
 class DcmQueryRetrieveOptions;
+class DcmQueryRetrieveFileWriter;
+class DcmQueryRetrieveFileWriteListener;
 class DcmFileFormat;
 
 /** this class maintains the context information that is passed to the
@@ -74,6 +76,9 @@ public:
     void setStorageDir(const char* fn) { _storageDir = fn; }
     const char* storageDir() { return _storageDir; }
 
+    /// return the stage that writes the incoming files, NULL if written synchronously
+    DcmQueryRetrieveFileWriter *fileWriter() const;
+
     /** callback handler called by the DIMSE_storeProvider callback function.
      *  @param progress progress state (in)
      *  @param req original store request (in)
@@ -97,14 +102,37 @@ private:
     void saveImageToDB(
         T_DIMSE_C_StoreRQ *req,             /* original store request */
         const char *imageFileName,
+        DcmDataset *imageDataSet,           /* dataset written to imageFileName, may be NULL */
         /* out */
         T_DIMSE_C_StoreRSP *rsp,            /* final store response */
         DcmDataset **stDetail);
 
+    /** writes the file, directly or through the write-behind stage
+     *  @param ff file to be written
+     *  @param fname name of the file
+     *  @param rsp C-STORE-RSP, the status is set if the file cannot be written
+     *  @param listener notified once the file has been written, deleted afterwards. May be NULL.
+     */
     void writeToFile(
         DcmFileFormat *ff,
         const char* fname,
-        T_DIMSE_C_StoreRSP *rsp);
+        T_DIMSE_C_StoreRSP *rsp,
+        DcmQueryRetrieveFileWriteListener *listener = NULL);
+
+    /** serializes the file into a buffer for the write-behind stage
+     *  @param ff file to be serialized
+     *  @param xfer transfer syntax of the file
+     *  @param writeMode write the file with or without meta header
+     *  @param buffer returns the serialized file, allocated with new[]
+     *  @param length returns the length of the serialized file in bytes
+     *  @return EC_Normal if successful, an error code otherwise
+     */
+    OFCondition serializeFile(
+        DcmFileFormat *ff,
+        E_TransferSyntax xfer,
+        E_FileWriteMode writeMode,
+        Uint8 *& buffer,
+        size_t& length);
 
     void checkRequestAgainstDataset(
         T_DIMSE_C_StoreRQ *req,     /* original store request */
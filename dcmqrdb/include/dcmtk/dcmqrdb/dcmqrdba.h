@@ -30,6 +30,7 @@
 
 class DcmDataset;
 class DcmQueryRetrieveDatabaseStatus;
+class DcmQueryRetrieveFileWriteListener;
 struct DcmQueryRetrieveCharacterSetOptions;
 
 #ifndef MAXPATHLEN
@@ -87,6 +88,51 @@ public:
       DcmQueryRetrieveDatabaseStatus  *status,
       OFBool     isNew = OFTrue ) = 0;
 
+  /** register the given DICOM object, which has been received through a C-STORE
+   *  operation and stored in a file, in the database. Unlike storeRequest(), the
+   *  dataset that has just been written to the file can be passed, which allows
+   *  implementations to avoid reading the file again. The default implementation
+   *  ignores the dataset and calls storeRequest().
+   *  @param SOPClassUID SOP class UID of DICOM instance
+   *  @param SOPInstanceUID SOP instance UID of DICOM instance
+   *  @param imageFileName file name (full path) of DICOM instance
+   *  @param dataset dataset of the DICOM instance as written to imageFileName,
+   *    may be NULL if only the file is available
+   *  @param status pointer to DB status object in which a DIMSE status code
+        suitable for use with the C-STORE-RSP message is set.
+   *  @param isNew if true, the instance is marked as "new" in the database,
+   *    if such a flag is maintained in the database.
+   *  @return EC_Normal upon normal completion, or some other OFCondition code upon failure.
+   */
+  virtual OFCondition storeDatasetRequest(
+      const char *SOPClassUID,
+      const char *SOPInstanceUID,
+      const char *imageFileName,
+      DcmDataset *dataset,
+      DcmQueryRetrieveDatabaseStatus  *status,
+      OFBool     isNew = OFTrue );
+
+  /** prepares the registration of a DICOM object that is written to a file
+   *  asynchronously. The attributes to index are taken from the dataset before
+   *  this method returns, the object is registered in the database only once the
+   *  returned listener is notified that the file has been written, so the
+   *  database never refers to a file that does not exist. The listener must
+   *  not depend on the lifetime of this handle. The default implementation
+   *  returns NULL, i.e. the database does not support deferred registration and
+   *  the caller has to call storeDatasetRequest() once the file exists.
+   *  @param SOPClassUID SOP class UID of DICOM instance
+   *  @param SOPInstanceUID SOP instance UID of DICOM instance
+   *  @param imageFileName file name (full path) the DICOM instance is written to
+   *  @param dataset dataset of the DICOM instance as it is written to imageFileName
+   *  @return listener to pass to DcmQueryRetrieveFileWriter::writeFile(), owned by
+   *    the caller until then. NULL if not supported or in case of an error.
+   */
+  virtual DcmQueryRetrieveFileWriteListener *deferStoreRequest(
+      const char *SOPClassUID,
+      const char *SOPInstanceUID,
+      const char *imageFileName,
+      DcmDataset *dataset);
+
   /** initiate FIND operation using the given SOP class UID (which identifies
    *  the query model) and DICOM dataset containing find request identifiers.
    *  @param SOPClassUID SOP class UID of query service, identifies Q/R model
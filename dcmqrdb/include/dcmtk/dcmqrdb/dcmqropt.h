@@ -36,6 +36,56 @@
 extern DCMTK_DCMQRDB_EXPORT const OFConditionConst QR_EC_InvalidPeer;
 extern DCMTK_DCMQRDB_EXPORT const OFConditionConst QR_EC_IndexDatabaseError;
 
+/** abstract interface of an object that is notified once a file passed to
+ *  DcmQueryRetrieveFileWriter::writeFile() has been written or could not be
+ *  written.
+ */
+class DCMTK_DCMQRDB_EXPORT DcmQueryRetrieveFileWriteListener
+{
+public:
+  /// destructor
+  virtual ~DcmQueryRetrieveFileWriteListener() {}
+
+  /** called once the file is in place or the write has failed. May be called
+   *  on another thread than the one that requested the write.
+   *  @param success OFTrue if the file has been written
+   */
+  virtual void fileWritten(OFBool success) = 0;
+};
+
+/** abstract interface of a stage that writes the files of incoming storage
+ *  requests. If set in DcmQueryRetrieveOptions, each dataset is serialized on
+ *  the association thread and the file is written by the implementation, which
+ *  is also responsible for creating the directory the file is stored in.
+ */
+class DCMTK_DCMQRDB_EXPORT DcmQueryRetrieveFileWriter
+{
+public:
+  /// destructor
+  virtual ~DcmQueryRetrieveFileWriter() {}
+
+  /** writes a serialized DICOM file. Depending on the policy of the
+   *  implementation, this method returns as soon as the file is queued,
+   *  written or synced to disk.
+   *  @param fileName path of the file, an existing file is replaced
+   *  @param buffer serialized file, allocated with new[]. Ownership is
+   *    transferred to the writer, also in case of an error.
+   *  @param length length of the buffer in bytes
+   *  @param listener notified once the file has been written or the write has
+   *    failed, possibly before this method returns. Ownership is transferred to
+   *    the writer, which deletes the listener after the notification. May be NULL.
+   *  @return EC_Normal if successful, an error code otherwise. If the writer
+   *    is asynchronous, EC_Normal only means that the file has been queued.
+   */
+  virtual OFCondition writeFile(const OFString& fileName, Uint8 *buffer, size_t length,
+    DcmQueryRetrieveFileWriteListener *listener = NULL) = 0;
+
+  /** checks whether writeFile() returns before the file has been written.
+   *  @return OFTrue if the writer is asynchronous
+   */
+  virtual OFBool isAsynchronous() const = 0;
+};
+
 /** this class encapsulates all the various options that affect the
  *  operation of the SCP, in addition to those defined in the config file
  */
@@ -72,6 +122,11 @@ public:
   /// block size for file padding, pad DICOM files to multiple of this value
   OFCmdUnsignedInt  filepad_;
 
+  /** stage that writes the files of incoming storage requests, not owned.
+   *  NULL to write the files synchronously on the association thread.
+   */
+  DcmQueryRetrieveFileWriter *fileWriter_;
+
   /// group length encoding when writing DICOM files
   E_GrpLenEncoding  groupLength_;
 
@@ -84,6 +139,11 @@ public:
   /// maximum number of parallel associations accepted
   int               maxAssociations_;
 
+  /** maximum number of parallel sub-associations to the move destination of a C-MOVE.
+   *  Values > 1 run the sub-operations on separate threads, which requires WITH_THREADS.
+   */
+  OFCmdUnsignedInt  maxMoveSubAssociations_;
+
   /// maximum PDU size
   OFCmdUnsignedInt  maxPDU_;
 
@@ -160,6 +220,11 @@ public:
   /// timeout for ACSE operations
   int acse_timeout_;
 
+  /** maximum time in seconds waitForAssociation() waits for an incoming association
+   *  in single process mode, i.e. how often the caller regains control
+   */
+  int association_wait_timeout_;
+
   // association configuration file name
   OFString associationConfigFile;
 
@@ -27,12 +27,15 @@
 #include "dcmtk/dcmnet/assoc.h"
 #include "dcmtk/dcmnet/dimse.h"
 #include "dcmtk/dcmnet/dcasccfg.h"
+#include "dcmtk/ofstd/ofthread.h"
 #include "dcmtk/dcmqrdb/dcmqrptb.h"
 
 class DcmQueryRetrieveConfig;
 class DcmQueryRetrieveOptions;
 class DcmQueryRetrieveDatabaseHandle;
 class DcmQueryRetrieveDatabaseHandleFactory;
+class DcmQueryRetrieveAssociationPool;
+class DcmQueryRetrieveAssociationWorker;
 
 /// enumeration describing reasons for refusing an association request
 enum CTN_RefuseReason
@@ -68,12 +71,15 @@ public:
     const DcmQueryRetrieveDatabaseHandleFactory& factory,
     const DcmAssociationConfiguration& associationConfiguration);
 
-  /// destructor
-  virtual ~DcmQueryRetrieveSCP() { }
+  /// destructor, waits for associations still handled by worker threads
+  virtual ~DcmQueryRetrieveSCP();
 
   /** wait for incoming A-ASSOCIATE requests, perform association negotiation
    *  and serve the requests. May fork child processes depending on availability
-   *  of the fork() system function and configuration options.
+   *  of the fork() system function and configuration options. In single process
+   *  mode, each association is handled by a worker thread of a bounded pool
+   *  (if DCMTK is compiled with thread support), otherwise it is handled
+   *  before this call returns.
    *  @param theNet network structure for listen socket
    *  @return EC_Normal if successful, an error code otherwise
    */
@@ -91,8 +97,17 @@ public:
    */
   void cleanChildren();
 
+  /** ask the associations handled by worker threads to finish. Commands in
+   *  progress are completed, associations waiting for their next command are
+   *  aborted within association_wait_timeout_ seconds. Call this after leaving
+   *  the waitForAssociation() loop, the destructor waits for the workers.
+   */
+  void stop();
+
 private:
 
+  friend class DcmQueryRetrieveAssociationWorker;
+
   /// private undefined copy constructor
   DcmQueryRetrieveSCP(const DcmQueryRetrieveSCP& other);
 
@@ -109,6 +124,11 @@ private:
 
   OFCondition refuseAssociation(T_ASC_Association ** assoc, CTN_RefuseReason reason);
 
+  /** count the associations currently served by child processes or worker threads
+   *  @return number of active associations
+   */
+  size_t countActiveAssociations();
+
   OFCondition handleAssociation(
     T_ASC_Association * assoc,
     OFBool correctUIDPadding);
@@ -149,12 +169,26 @@ private:
 
   static void refuseAnyStorageContexts(T_ASC_Association *assoc);
 
+  /** check whether stop() has been called, can be called by any worker thread
+   *  @return OFTrue if the associations should finish
+   */
+  OFBool stopRequested();
+
   /// configuration facility
   const DcmQueryRetrieveConfig *config_;
 
   /// child process table, only used in multi-processing mode
   DcmQueryRetrieveProcessTable processtable_;
 
+  /// worker thread pool, only used in single process mode
+  DcmQueryRetrieveAssociationPool *associationPool_;
+
+  /// set by stop(), protected by stopMutex_
+  OFBool stop_;
+
+  /// protects stop_
+  OFMutex stopMutex_;
+
   /// flag for database interface: check C-FIND identifier
   OFBool dbCheckFindIdentifier_;
 
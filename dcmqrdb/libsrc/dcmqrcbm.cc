@@ -33,6 +33,12 @@
 #include "dcmtk/dcmqrdb/dcmqrdbi.h"
 #include "dcmtk/ofstd/ofstd.h"
 
+#ifdef WITH_THREADS
+#include "dcmtk/ofstd/ofthread.h"
+#include "dcmtk/ofstd/oflist.h"
+#include "dcmtk/ofstd/ofvector.h"
+#endif
+
 
 BEGIN_EXTERN_C
 #ifdef HAVE_FCNTL_H
@@ -69,6 +75,199 @@ static void moveSubOpProgressCallback(void * /* callbackData */,
   }
 }
 
+#ifdef WITH_THREADS
+
+/** a C-STORE sub-operation of a C-MOVE waiting for a sender thread.
+ *  Internal use only.
+ */
+struct DcmQueryRetrieveMoveSubOp
+{
+    DIC_UI sopClass;
+    DIC_UI sopInstance;
+    char fileName[MAXPATHLEN + 1];
+};
+
+/** sender thread that performs sub-operations over one sub-association.
+ *  Internal use only.
+ */
+class DcmQueryRetrieveMoveSubOpSender : public OFThread
+{
+public:
+    DcmQueryRetrieveMoveSubOpSender(DcmQueryRetrieveMoveContext& context, DcmQueryRetrieveMoveSubOpPool& pool,
+        T_ASC_Association *assoc, OFBool ownsAssociation)
+    : context_(context)
+    , pool_(pool)
+    , assoc_(assoc)
+    , ownsAssociation_(ownsAssociation)
+    {
+    }
+
+    /// the sub-association, only released by the pool if it was created for this sender
+    T_ASC_Association *&association() { return assoc_; }
+    OFBool ownsAssociation() const { return ownsAssociation_; }
+
+protected:
+    virtual void run();
+
+private:
+    DcmQueryRetrieveMoveContext& context_;
+    DcmQueryRetrieveMoveSubOpPool& pool_;
+    T_ASC_Association *assoc_;
+    OFBool ownsAssociation_;
+};
+
+/** queue of sub-operations shared by the sender threads of a C-MOVE. The thread
+ *  handling the C-MOVE reads the database and queues the sub-operations, the
+ *  senders report each completed sub-operation so that a pending response can be sent.
+ *  Internal use only.
+ */
+class DcmQueryRetrieveMoveSubOpPool
+{
+public:
+    DcmQueryRetrieveMoveSubOpPool()
+    : dbExhausted(OFFalse)
+    , dbRemaining(0)
+    , dbFinalStatus(STATUS_Success)
+    , available_(0)
+    , completed_(0)
+    , outstanding_(0)
+    {
+    }
+
+    ~DcmQueryRetrieveMoveSubOpPool()
+    {
+        for (size_t i = 0; i < senders_.size(); ++i) delete senders_[i];
+    }
+
+    void addSender(DcmQueryRetrieveMoveSubOpSender *sender)
+    {
+        senders_.push_back(sender);
+        sender->start();
+    }
+
+    size_t senders() const { return senders_.size(); }
+
+    void push(const DcmQueryRetrieveMoveSubOp& op)
+    {
+        mutex_.lock();
+        ops_.push_back(op);
+        outstanding_++;
+        mutex_.unlock();
+        available_.post();
+    }
+
+    /// waits for the next sub-operation, returns false if the pool is stopped
+    OFBool pop(DcmQueryRetrieveMoveSubOp& op)
+    {
+        available_.wait();
+        mutex_.lock();
+        OFBool result = !ops_.empty();
+        if (result) {
+            op = ops_.front();
+            ops_.pop_front();
+        }
+        mutex_.unlock();
+        return result;
+    }
+
+    void done()
+    {
+        mutex_.lock();
+        outstanding_--;
+        mutex_.unlock();
+        completed_.post();
+    }
+
+    /// number of queued and running sub-operations
+    size_t outstanding()
+    {
+        mutex_.lock();
+        size_t result = outstanding_;
+        mutex_.unlock();
+        return result;
+    }
+
+    void waitForCompletion()
+    {
+        completed_.wait();
+    }
+
+    /** drops the sub-operations not yet taken by a sender and waits for the senders to finish
+     *  @return the sender threads, their associations still have to be released
+     */
+    OFVector<DcmQueryRetrieveMoveSubOpSender *>& stop()
+    {
+        mutex_.lock();
+        outstanding_ -= ops_.size();
+        ops_.clear();
+        mutex_.unlock();
+        for (size_t i = 0; i < senders_.size(); ++i) available_.post();
+        for (size_t i = 0; i < senders_.size(); ++i) senders_[i]->join();
+        return senders_;
+    }
+
+    /// protects the sub-operation counters and the list of failed instances
+    OFMutex countersMutex;
+
+    /// true if the database delivered its last sub-operation
+    OFBool dbExhausted;
+
+    /// number of sub-operations not yet read from the database
+    DIC_US dbRemaining;
+
+    /// status reported by the database after the last sub-operation
+    DIC_US dbFinalStatus;
+
+private:
+    OFMutex mutex_;
+    OFSemaphore available_;
+    OFSemaphore completed_;
+    OFList<DcmQueryRetrieveMoveSubOp> ops_;
+    size_t outstanding_;
+    OFVector<DcmQueryRetrieveMoveSubOpSender *> senders_;
+};
+
+void DcmQueryRetrieveMoveSubOpSender::run()
+{
+    DcmQueryRetrieveMoveSubOp op;
+    while (pool_.pop(op)) {
+        OFCondition cond = context_.performMoveSubOp(assoc_, op.sopClass, op.sopInstance, op.fileName);
+        if (cond != EC_Normal) {
+            OFString temp_str;
+            DCMQRDB_ERROR("moveSCP: Move Sub-Op Failed: " << DimseCondition::dump(temp_str, cond));
+        }
+        pool_.done();
+    }
+}
+
+#endif
+
+static void releaseSubAssociation(T_ASC_Association *&assoc)
+{
+    OFCondition cond = EC_Normal;
+    OFString temp_str;
+    DCMQRDB_INFO("Releasing Sub-Association");
+    cond = ASC_releaseAssociation(assoc);
+    if (cond.bad()) {
+        DCMQRDB_ERROR("moveSCP: Sub-Association Release Failed: " << DimseCondition::dump(temp_str, cond));
+    }
+    cond = ASC_dropAssociation(assoc);
+    if (cond.bad()) {
+        DCMQRDB_ERROR("moveSCP: Sub-Association Drop Failed: " << DimseCondition::dump(temp_str, cond));
+    }
+    cond = ASC_destroyAssociation(&assoc);
+    if (cond.bad()) {
+        DCMQRDB_ERROR("moveSCP: Sub-Association Destroy Failed: " << DimseCondition::dump(temp_str, cond));
+    }
+}
+
+DcmQueryRetrieveMoveContext::~DcmQueryRetrieveMoveContext()
+{
+    /* the senders use this context, they must be stopped before it is destroyed */
+    closeSubAssociation();
+    free(failedUIDs);
+}
+
 void DcmQueryRetrieveMoveContext::callbackHandler(
     /* in */
     OFBool cancelled, T_DIMSE_C_MoveRQ *request,
@@ -101,6 +300,8 @@ void DcmQueryRetrieveMoveContext::callbackHandler(
             } else if (cond.bad()) {
                 /* failed to build association, must fail move */
                 failAllSubOperations(&dbStatus);
+            } else {
+                startSubOpSenders();
             }
         }
     }
@@ -111,7 +312,11 @@ void DcmQueryRetrieveMoveContext::callbackHandler(
     }
 
     if (dbStatus.status() == STATUS_Pending) {
-        moveNextImage(&dbStatus);
+        if (subOpPool) {
+            moveNextImages(&dbStatus);
+        } else {
+            moveNextImage(&dbStatus);
+        }
     }
 
     if (dbStatus.status() != STATUS_Pending) {
@@ -148,10 +353,12 @@ void DcmQueryRetrieveMoveContext::callbackHandler(
 
     /* set response status */
     response->DimseStatus = dbStatus.status();
+    lockCounters();
     response->NumberOfRemainingSubOperations = nRemaining;
     response->NumberOfCompletedSubOperations = nCompleted;
     response->NumberOfFailedSubOperations = nFailed;
     response->NumberOfWarningSubOperations = nWarning;
+    unlockCounters();
     *stDetail = dbStatus.extractStatusDetail();
 
     OFString str;
@@ -189,7 +396,29 @@ void DcmQueryRetrieveMoveContext::addFailedUIDInstance(const char *sopInstance)
     }
 }
 
-OFCondition DcmQueryRetrieveMoveContext::performMoveSubOp(DIC_UI sopClass, DIC_UI sopInstance, char *fname)
+void DcmQueryRetrieveMoveContext::lockCounters()
+{
+#ifdef WITH_THREADS
+    if (subOpPool) subOpPool->countersMutex.lock();
+#endif
+}
+
+void DcmQueryRetrieveMoveContext::unlockCounters()
+{
+#ifdef WITH_THREADS
+    if (subOpPool) subOpPool->countersMutex.unlock();
+#endif
+}
+
+void DcmQueryRetrieveMoveContext::countSubOp(DIC_US& counter, const char *failedInstance)
+{
+    lockCounters();
+    counter++;
+    if (failedInstance) addFailedUIDInstance(failedInstance);
+    unlockCounters();
+}
+
+OFCondition DcmQueryRetrieveMoveContext::performMoveSubOp(T_ASC_Association *assoc, DIC_UI sopClass, DIC_UI sopInstance, char *fname)
 {
     OFCondition cond = EC_Normal;
     T_DIMSE_C_StoreRQ req;
@@ -210,21 +439,19 @@ OFCondition DcmQueryRetrieveMoveContext::performMoveSubOp(DIC_UI sopClass, DIC_U
         /* due to quota system the file could have been deleted */
         DCMQRDB_ERROR("Move SCP: storeSCU: [file: " << fname << "]: "
             << OFStandard::getLastSystemErrorCode().message());
-        nFailed++;
-        addFailedUIDInstance(sopInstance);
+        countSubOp(nFailed, sopInstance);
         return EC_Normal;
     }
     dcmtk_flock(lockfd, LOCK_SH);
 #endif
 
-    msgId = subAssoc->nextMsgID++;
+    msgId = assoc->nextMsgID++;
 
     /* which presentation context should be used */
-    presId = ASC_findAcceptedPresentationContextID(subAssoc,
+    presId = ASC_findAcceptedPresentationContextID(assoc,
         sopClass);
     if (presId == 0) {
-        nFailed++;
-        addFailedUIDInstance(sopInstance);
+        countSubOp(nFailed, sopInstance);
         DCMQRDB_ERROR("Move SCP: storeSCU: [file: " << fname << "] No presentation context for: ("
             << dcmSOPClassUIDToModality(sopClass, "OT") << ") " << sopClass);
         return DIMSE_NOVALIDPRESENTATIONCONTEXTID;
@@ -242,7 +469,7 @@ OFCondition DcmQueryRetrieveMoveContext::performMoveSubOp(DIC_UI sopClass, DIC_U
     DCMQRDB_INFO("Store SCU RQ: MsgID " << msgId << ", ("
         << dcmSOPClassUIDToModality(sopClass, "OT") << ")");
 
-    cond = DIMSE_storeUser(subAssoc, presId, &req,
+    cond = DIMSE_storeUser(assoc, presId, &req,
         fname, NULL, moveSubOpProgressCallback, this,
         options_.blockMode_, options_.dimse_timeout_,
         &rsp, &stDetail);
@@ -258,22 +485,20 @@ OFCondition DcmQueryRetrieveMoveContext::performMoveSubOp(DIC_UI sopClass, DIC_U
             << DU_cstoreStatusString(rsp.DimseStatus) << "]");
         if (rsp.DimseStatus == STATUS_Success) {
             /* everything ok */
-            nCompleted++;
+            countSubOp(nCompleted);
         } else if (DICOM_WARNING_STATUS(rsp.DimseStatus)) {
             /* a warning status message */
-            nWarning++;
+            countSubOp(nWarning);
             DCMQRDB_ERROR("Move SCP: Store Warning: Response Status: " <<
                     DU_cstoreStatusString(rsp.DimseStatus));
         } else {
-            nFailed++;
-            addFailedUIDInstance(sopInstance);
+            countSubOp(nFailed, sopInstance);
             /* print a status message */
             DCMQRDB_ERROR("Move SCP: Store Failed: Response Status: " <<
                 DU_cstoreStatusString(rsp.DimseStatus));
         }
     } else {
-        nFailed++;
-        addFailedUIDInstance(sopInstance);
+        countSubOp(nFailed, sopInstance);
         OFString temp_str;
         DCMQRDB_ERROR("Move SCP: storeSCU: Store Request Failed: " << DimseCondition::dump(temp_str, cond));
     }
@@ -290,8 +515,6 @@ OFCondition DcmQueryRetrieveMoveContext::buildSubAssociation(T_DIMSE_C_MoveRQ *r
     DIC_NODENAME dstHostName;
     DIC_NODENAME dstHostNamePlusPort;
     int dstPortNumber;
-    T_ASC_Parameters *params;
-    OFString temp_str;
 
     OFStandard::strlcpy(dstAETitle, request->MoveDestination, DIC_AE_LEN + 1);
 
@@ -312,16 +535,31 @@ OFCondition DcmQueryRetrieveMoveContext::buildSubAssociation(T_DIMSE_C_MoveRQ *r
         request->MoveDestination, dstHostName, DIC_NODENAME_LEN + 1, &dstPortNumber)) {
         return QR_EC_InvalidPeer;
     }
+    OFStandard::snprintf(dstHostNamePlusPort, sizeof(DIC_NODENAME), "%s:%d", dstHostName, dstPortNumber);
+    subAssocPeer = dstHostNamePlusPort;
+
+    cond = createSubAssociation(&subAssoc);
+    if (cond.good()) {
+        assocStarted = OFTrue;
+    }
+    return cond;
+}
+
+OFCondition DcmQueryRetrieveMoveContext::createSubAssociation(T_ASC_Association **assoc)
+{
+    OFCondition cond = EC_Normal;
+    T_ASC_Parameters *params;
+    OFString temp_str;
+
     if (cond.good()) {
-        cond = ASC_createAssociationParameters(&params, ASC_DEFAULTMAXPDU);
+        cond = ASC_createAssociationParameters(&params, OFstatic_cast(int, options_.maxPDU_), dcmConnectionTimeout.get());
         if (cond.bad()) {
             DCMQRDB_ERROR("moveSCP: Cannot create Association-params for sub-ops: " << DimseCondition::dump(temp_str, cond));
         }
     }
     if (cond.good()) {
-        OFStandard::snprintf(dstHostNamePlusPort, sizeof(DIC_NODENAME), "%s:%d", dstHostName, dstPortNumber);
         ASC_setPresentationAddresses(params, OFStandard::getHostName().c_str(),
-            dstHostNamePlusPort);
+            subAssocPeer.c_str());
         ASC_setAPTitles(params, ourAETitle.c_str(), dstAETitle,NULL);
 
         if (options_.outgoingProfile.empty()) {
@@ -337,7 +575,7 @@ OFCondition DcmQueryRetrieveMoveContext::buildSubAssociation(T_DIMSE_C_MoveRQ *r
     if (cond.good()) {
         /* create association */
         DCMQRDB_INFO("Requesting Sub-Association");
-        cond = ASC_requestAssociation(options_.net_, params, &subAssoc);
+        cond = ASC_requestAssociation(options_.net_, params, assoc);
         if (cond.bad()) {
             if (cond == DUL_ASSOCIATIONREJECTED) {
                 T_ASC_RejectParameters rej;
@@ -349,10 +587,6 @@ OFCondition DcmQueryRetrieveMoveContext::buildSubAssociation(T_DIMSE_C_MoveRQ *r
             }
         }
     }
-
-    if (cond.good()) {
-        assocStarted = OFTrue;
-    }
     return cond;
 }
 
@@ -360,22 +594,12 @@ OFCondition DcmQueryRetrieveMoveContext::closeSubAssociation()
 {
     OFCondition cond = EC_Normal;
 
+    /* the senders must not use subAssoc anymore */
+    stopSubOpSenders();
+
     if (subAssoc != NULL) {
         /* release association */
-        OFString temp_str;
-        DCMQRDB_INFO("Releasing Sub-Association");
-        cond = ASC_releaseAssociation(subAssoc);
-        if (cond.bad()) {
-            DCMQRDB_ERROR("moveSCP: Sub-Association Release Failed: " << DimseCondition::dump(temp_str, cond));
-        }
-        cond = ASC_dropAssociation(subAssoc);
-        if (cond.bad()) {
-            DCMQRDB_ERROR("moveSCP: Sub-Association Drop Failed: " << DimseCondition::dump(temp_str, cond));
-        }
-        cond = ASC_destroyAssociation(&subAssoc);
-        if (cond.bad()) {
-            DCMQRDB_ERROR("moveSCP: Sub-Association Destroy Failed: " << DimseCondition::dump(temp_str, cond));
-        }
+        releaseSubAssociation(subAssoc);
     }
 
     if (assocStarted) {
@@ -385,6 +609,91 @@ OFCondition DcmQueryRetrieveMoveContext::closeSubAssociation()
     return cond;
 }
 
+void DcmQueryRetrieveMoveContext::startSubOpSenders()
+{
+#ifdef WITH_THREADS
+    if (options_.maxMoveSubAssociations_ <= 1) {
+        return;
+    }
+
+    subOpPool = new DcmQueryRetrieveMoveSubOpPool();
+    subOpPool->addSender(new DcmQueryRetrieveMoveSubOpSender(*this, *subOpPool, subAssoc, OFFalse));
+    for (OFCmdUnsignedInt i = 1; i < options_.maxMoveSubAssociations_; ++i) {
+        T_ASC_Association *assoc = NULL;
+        if (createSubAssociation(&assoc).bad()) {
+            /* the destination may limit the number of associations, continue with those established */
+            DCMQRDB_WARN("moveSCP: continuing with " << i << " Sub-Associations");
+            break;
+        }
+        subOpPool->addSender(new DcmQueryRetrieveMoveSubOpSender(*this, *subOpPool, assoc, OFTrue));
+    }
+    DCMQRDB_INFO("Performing sub-operations over " << subOpPool->senders() << " Sub-Associations");
+#endif
+}
+
+void DcmQueryRetrieveMoveContext::stopSubOpSenders()
+{
+#ifdef WITH_THREADS
+    if (subOpPool == NULL) {
+        return;
+    }
+
+    OFVector<DcmQueryRetrieveMoveSubOpSender *>& senders = subOpPool->stop();
+    for (size_t i = 0; i < senders.size(); ++i) {
+        if (senders[i]->ownsAssociation() && senders[i]->association() != NULL) {
+            releaseSubAssociation(senders[i]->association());
+        }
+    }
+    delete subOpPool;
+    subOpPool = NULL;
+#endif
+}
+
+void DcmQueryRetrieveMoveContext::moveNextImages(DcmQueryRetrieveDatabaseStatus * dbStatus)
+{
+#ifdef WITH_THREADS
+    OFCondition dbcond = EC_Normal;
+
+    /* keep a sub-operation waiting for every sender, so that no sub-association idles */
+    while (!subOpPool->dbExhausted && subOpPool->outstanding() < 2 * subOpPool->senders()) {
+        DcmQueryRetrieveMoveSubOp op;
+        memset(&op, 0, sizeof(op));
+
+        /* get DB response */
+        dbcond = dbHandle.nextMoveResponse(
+            op.sopClass, sizeof(op.sopClass), op.sopInstance, sizeof(op.sopInstance), op.fileName, sizeof(op.fileName),
+            &subOpPool->dbRemaining, dbStatus);
+        if (dbcond.bad()) {
+            DCMQRDB_ERROR("moveSCP: Database: nextMoveResponse Failed ("
+                    << DU_cmoveStatusString(dbStatus->status()) << "):");
+        }
+
+        if (dbStatus->status() == STATUS_Pending) {
+            subOpPool->push(op);
+        } else {
+            subOpPool->dbExhausted = OFTrue;
+            subOpPool->dbFinalStatus = dbStatus->status();
+        }
+    }
+
+    /* a pending response is sent for every completed sub-operation */
+    if (subOpPool->outstanding() > 0) {
+        subOpPool->waitForCompletion();
+    }
+
+    size_t outstanding = subOpPool->outstanding();
+    lockCounters();
+    nRemaining = OFstatic_cast(DIC_US, outstanding + (subOpPool->dbExhausted ? 0 : subOpPool->dbRemaining));
+    unlockCounters();
+
+    if (outstanding > 0 || !subOpPool->dbExhausted) {
+        dbStatus->setStatus(STATUS_Pending);
+    } else {
+        dbStatus->setStatus(subOpPool->dbFinalStatus);
+    }
+#endif
+}
+
 void DcmQueryRetrieveMoveContext::moveNextImage(DcmQueryRetrieveDatabaseStatus * dbStatus)
 {
     OFCondition cond = EC_Normal;
@@ -408,7 +717,7 @@ void DcmQueryRetrieveMoveContext::moveNextImage(DcmQueryRetrieveDatabaseStatus *
 
     if (dbStatus->status() == STATUS_Pending) {
         /* perform sub-op */
-        cond = performMoveSubOp(subImgSOPClass, subImgSOPInstance, subImgFileName);
+        cond = performMoveSubOp(subAssoc, subImgSOPClass, subImgSOPInstance, subImgFileName);
         if (cond != EC_Normal) {
             OFString temp_str;
             DCMQRDB_ERROR("moveSCP: Move Sub-Op Failed: " << DimseCondition::dump(temp_str, cond));
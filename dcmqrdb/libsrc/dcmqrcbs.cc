@@ -27,10 +27,16 @@
 #include "dcmtk/dcmqrdb/dcmqropt.h"
 #include "dcmtk/dcmnet/diutil.h"
 #include "dcmtk/dcmdata/dcfilefo.h"
+#include "dcmtk/dcmdata/dcostrmb.h"
 #include "dcmtk/dcmqrdb/dcmqrdbs.h"
 #include "dcmtk/dcmqrdb/dcmqrdbi.h"
 
 
+DcmQueryRetrieveFileWriter *DcmQueryRetrieveStoreContext::fileWriter() const
+{
+  return options_.fileWriter_;
+}
+
 void DcmQueryRetrieveStoreContext::updateDisplay(T_DIMSE_StoreProgress * progress)
 {
   // We can't use oflog for the pdu output, but we use a special logger for
@@ -60,6 +66,7 @@ void DcmQueryRetrieveStoreContext::updateDisplay(T_DIMSE_StoreProgress * progres
 void DcmQueryRetrieveStoreContext::saveImageToDB(
     T_DIMSE_C_StoreRQ *req,             /* original store request */
     const char *imageFileName,
+    DcmDataset *imageDataSet,           /* dataset written to imageFileName, may be NULL */
     /* out */
     T_DIMSE_C_StoreRSP *rsp,            /* final store response */
     DcmDataset **stDetail)
@@ -76,9 +83,9 @@ void DcmQueryRetrieveStoreContext::saveImageToDB(
 
     if (status == STATUS_Success)
     {
-        dbcond = dbHandle.storeRequest(
+        dbcond = dbHandle.storeDatasetRequest(
             req->AffectedSOPClassUID, req->AffectedSOPInstanceUID,
-            imageFileName, &dbStatus);
+            imageFileName, imageDataSet, &dbStatus);
         if (dbcond.bad())
         {
             OFString temp_str;
@@ -96,25 +103,102 @@ void DcmQueryRetrieveStoreContext::saveImageToDB(
 void DcmQueryRetrieveStoreContext::writeToFile(
     DcmFileFormat *ff,
     const char* fname,
-    T_DIMSE_C_StoreRSP *rsp)
+    T_DIMSE_C_StoreRSP *rsp,
+    DcmQueryRetrieveFileWriteListener *listener)
 {
     E_TransferSyntax xfer = options_.writeTransferSyntax_;
     if (xfer == EXS_Unknown) xfer = ff->getDataset()->getOriginalXfer();
 
     ff->chooseRepresentation(xfer, NULL);
 
-    OFCondition cond = ff->saveFile(fname, xfer, options_.sequenceType_,
-        options_.groupLength_, options_.paddingType_, (Uint32)options_.filepad_,
-        (Uint32)options_.itempad_, (options_.useMetaheader_) ? EWM_fileformat : EWM_dataset);
+    E_FileWriteMode writeMode = (options_.useMetaheader_) ? EWM_fileformat : EWM_dataset;
+    OFCondition cond = EC_Normal;
+
+    /* padding changes the length of the encoded file, such files are always written synchronously */
+    Uint8 *buffer = NULL;
+    size_t length = 0;
+    OFBool writeBehind = OFFalse;
+    if (options_.fileWriter_ && (options_.paddingType_ != EPD_withPadding) &&
+        serializeFile(ff, xfer, writeMode, buffer, length).good())
+    {
+        /* the write-behind stage takes over the buffer and creates the directory */
+        cond = options_.fileWriter_->writeFile(fname, buffer, length, listener);
+        writeBehind = OFTrue;
+    }
+    else
+    {
+        if (options_.fileWriter_)
+        {
+            /* the directory is otherwise left to the write-behind stage */
+            OFString dirName;
+            OFStandard::getDirNameFromPath(dirName, fname, OFFalse);
+            if (!dirName.empty()) OFStandard::createDirectory(dirName, _storageDir);
+        }
+        cond = ff->saveFile(fname, xfer, options_.sequenceType_,
+            options_.groupLength_, options_.paddingType_, (Uint32)options_.filepad_,
+            (Uint32)options_.itempad_, writeMode);
+        if (listener)
+        {
+            listener->fileWritten(cond.good());
+            delete listener;
+        }
+    }
 
     if (cond.bad())
     {
       DCMQRDB_ERROR("storescp: Cannot write image file: " << fname);
       rsp->DimseStatus = STATUS_STORE_Refused_OutOfResources;
 
-      // delete incomplete file
-      OFStandard::deleteFile(fname);
+      // delete incomplete file, the write-behind stage never leaves one behind
+      if (!writeBehind) OFStandard::deleteFile(fname);
+    }
+}
+
+OFCondition DcmQueryRetrieveStoreContext::serializeFile(
+    DcmFileFormat *ff,
+    E_TransferSyntax xfer,
+    E_FileWriteMode writeMode,
+    Uint8 *& buffer,
+    size_t& length)
+{
+    /* encode the file exactly as DcmFileFormat::saveFile() would write it */
+    DcmObject *obj = ff;
+    if (writeMode == EWM_dataset) obj = ff->getDataset();
+    else ff->validateMetaInfo(xfer, writeMode);
+    ff->removeInvalidGroups();
+
+    const Uint32 maxLength = obj->calcElementLength(xfer, options_.sequenceType_);
+    if (maxLength == DCM_UndefinedLength) return EC_IllegalCall;
+
+    buffer = new Uint8[maxLength];
+    DcmOutputBufferStream bufferStream(buffer, maxLength);
+    OFCondition cond = bufferStream.status();
+    if (cond.good())
+    {
+        /* the buffer stream reports a full buffer as EC_StreamNotifyClient */
+        obj->transferInit();
+        if (writeMode == EWM_dataset)
+            cond = ff->getDataset()->write(bufferStream, xfer, options_.sequenceType_, NULL,
+                options_.groupLength_, options_.paddingType_);
+        else
+            cond = ff->write(bufferStream, xfer, options_.sequenceType_, NULL,
+                options_.groupLength_, options_.paddingType_, 0, 0, 0, writeMode);
+        obj->transferEnd();
+    }
+    if (cond.good())
+    {
+        void *data = NULL;
+        offile_off_t written = 0;
+        bufferStream.flushBuffer(data, written);
+        length = OFstatic_cast(size_t, written);
+    }
+    else
+    {
+        delete[] buffer;
+        buffer = NULL;
+        length = 0;
     }
+    return cond;
 }
 
 void DcmQueryRetrieveStoreContext::checkRequestAgainstDataset(
@@ -170,11 +254,23 @@ void DcmQueryRetrieveStoreContext::callbackHandler(
         }
 
         if (!options_.ignoreStoreData_ && rsp->DimseStatus == STATUS_Success) {
+            DcmDataset *writtenDataSet = NULL;
+            OFBool indexDeferred = OFFalse;
             if ((imageDataSet)&&(*imageDataSet)) {
-                writeToFile(dcmff, fileName, rsp);
+                /* an asynchronous writer may fail after the response has been sent, so the
+                 * instance is only indexed once its file has been written
+                 */
+                DcmQueryRetrieveFileWriteListener *indexer = NULL;
+                if (options_.fileWriter_ && options_.fileWriter_->isAsynchronous())
+                    indexer = dbHandle.deferStoreRequest(req->AffectedSOPClassUID,
+                        req->AffectedSOPInstanceUID, fileName, *imageDataSet);
+                indexDeferred = (indexer != NULL);
+                writeToFile(dcmff, fileName, rsp, indexer);
+                /* index the dataset we have just written instead of reading the file again */
+                writtenDataSet = *imageDataSet;
             }
-            if (rsp->DimseStatus == STATUS_Success) {
-                saveImageToDB(req, fileName, rsp, stDetail);
+            if (rsp->DimseStatus == STATUS_Success && !indexDeferred) {
+                saveImageToDB(req, fileName, writtenDataSet, rsp, stDetail);
             }
         }
 
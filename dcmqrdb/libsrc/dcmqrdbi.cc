@@ -765,6 +765,26 @@ DcmQueryRetrieveDatabaseHandle::~DcmQueryRetrieveDatabaseHandle()
 {
 }
 
+OFCondition DcmQueryRetrieveDatabaseHandle::storeDatasetRequest(
+    const char  *SOPClassUID,
+    const char  *SOPInstanceUID,
+    const char  *imageFileName,
+    DcmDataset  * /* dataset */,
+    DcmQueryRetrieveDatabaseStatus   *status,
+    OFBool      isNew)
+{
+    return storeRequest(SOPClassUID, SOPInstanceUID, imageFileName, status, isNew);
+}
+
+DcmQueryRetrieveFileWriteListener *DcmQueryRetrieveDatabaseHandle::deferStoreRequest(
+    const char  * /* SOPClassUID */,
+    const char  * /* SOPInstanceUID */,
+    const char  * /* imageFileName */,
+    DcmDataset  * /* dataset */)
+{
+    return NULL;
+}
+
 /* ========================= FIND ========================= */
 
 // helper function to print 'ASCII' instead of an empty string for the value of
@@ -33,10 +33,12 @@ DcmQueryRetrieveOptions::DcmQueryRetrieveOptions()
 , correctUIDPadding_(OFFalse)
 , disableGetSupport_(OFFalse)
 , filepad_(0)
+, fileWriter_(NULL)
 , groupLength_(EGL_recalcGL)
 , ignoreStoreData_(OFFalse)
 , itempad_(0)
 , maxAssociations_(20)
+, maxMoveSubAssociations_(1)
 , maxPDU_(ASC_DEFAULTMAXPDU)
 , net_(NULL)
 , networkTransferSyntax_(EXS_Unknown)
@@ -70,6 +72,7 @@ DcmQueryRetrieveOptions::DcmQueryRetrieveOptions()
 , blockMode_(DIMSE_BLOCKING)
 , dimse_timeout_(0)
 , acse_timeout_(30)
+, association_wait_timeout_(1000)
 , associationConfigFile()
 , incomingProfile()
 , outgoingProfile()
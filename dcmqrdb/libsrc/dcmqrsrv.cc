@@ -31,8 +31,9 @@
 #include "dcmtk/dcmqrdb/dcmqrcbg.h"    /* for class DcmQueryRetrieveGetContext */
 #include "dcmtk/dcmqrdb/dcmqrcbs.h"    /* for class DcmQueryRetrieveStoreContext */
 
-#include <thread>
-#include <future>
+#ifdef WITH_THREADS
+#include "dcmtk/dcmnet/scppool.h"      /* for class DcmBaseSCPPool */
+#endif
 
 static void findCallback(
   /* in */
@@ -99,7 +100,8 @@ static void storeCallback(
 
         OFString baseStr;
         OFStandard::combineDirAndFilename(baseStr, context->storageDir(), studyInstanceUID, OFTrue);
-        if (!OFStandard::dirExists(baseStr))
+        /* a write-behind stage creates the directory itself and caches its existence */
+        if ((context->fileWriter() == NULL) && !OFStandard::dirExists(baseStr))
         {
             if (OFStandard::createDirectory(baseStr, context->storageDir()).bad())
             {
@@ -122,6 +124,102 @@ static void storeCallback(
  * ============================================================================================================
  */
 
+#ifdef WITH_THREADS
+
+/** SCP pool that hands associations accepted and negotiated by DcmQueryRetrieveSCP
+ *  over to worker threads. Unlike DcmSCPPool, the pool does not listen on its own,
+ *  DcmQueryRetrieveSCP::waitForAssociation() remains in charge of the network.
+ *  Internal use only.
+ */
+class DcmQueryRetrieveAssociationPool : public DcmBaseSCPPool
+{
+public:
+  /** constructor
+   *  @param scp SCP whose association handling is run by the workers
+   *  @param maxWorkers maximum number of concurrently handled associations
+   */
+  DcmQueryRetrieveAssociationPool(DcmQueryRetrieveSCP& scp, Uint16 maxWorkers)
+  : DcmBaseSCPPool()
+  , scp_(scp)
+  , sharedConfig_()
+  {
+    setMaxThreads(maxWorkers);
+  }
+
+  /// destructor, waits for all workers to finish their association
+  virtual ~DcmQueryRetrieveAssociationPool()
+  {
+    joinWorkers();
+  }
+
+  /** start a worker thread for an acknowledged association. On success, the
+   *  worker takes over ownership of the association.
+   *  @param assoc association to be handled
+   *  @return EC_Normal if a worker has been started, an error code otherwise
+   */
+  OFCondition startAssociation(T_ASC_Association *assoc)
+  {
+    return runAssociation(assoc, sharedConfig_);
+  }
+
+protected:
+  virtual DcmBaseSCPWorker* createSCPWorker();
+
+private:
+  /// SCP whose association handling is run by the workers
+  DcmQueryRetrieveSCP& scp_;
+  /// unused by our workers, but required by DcmBaseSCPPool
+  DcmSharedSCPConfig sharedConfig_;
+};
+
+
+/** worker thread running DcmQueryRetrieveSCP::handleAssociation() for a
+ *  single association. Internal use only.
+ */
+class DcmQueryRetrieveAssociationWorker : public DcmBaseSCPPool::DcmBaseSCPWorker
+{
+public:
+  DcmQueryRetrieveAssociationWorker(DcmBaseSCPPool& pool, DcmQueryRetrieveSCP& scp)
+  : DcmBaseSCPWorker(pool)
+  , scp_(scp)
+  , busy_(OFFalse)
+  {
+  }
+
+  virtual OFCondition setSharedConfig(const DcmSharedSCPConfig& /* config */)
+  {
+    return EC_Normal;
+  }
+
+  virtual OFBool busy()
+  {
+    return busy_;
+  }
+
+protected:
+  virtual OFCondition workerListen(T_ASC_Association* const assoc)
+  {
+    busy_ = OFTrue;
+    OFCondition cond = scp_.handleAssociation(assoc, scp_.options_.correctUIDPadding_);
+    busy_ = OFFalse;
+    return cond;
+  }
+
+private:
+  /// SCP that handles the association
+  DcmQueryRetrieveSCP& scp_;
+  /// true while the association is handled
+  volatile OFBool busy_;
+};
+
+
+DcmBaseSCPPool::DcmBaseSCPWorker* DcmQueryRetrieveAssociationPool::createSCPWorker()
+{
+  return new DcmQueryRetrieveAssociationWorker(*this, scp_);
+}
+
+#endif
+
 
 DcmQueryRetrieveSCP::DcmQueryRetrieveSCP(
   const DcmQueryRetrieveConfig& config,
@@ -130,12 +228,40 @@ DcmQueryRetrieveSCP::DcmQueryRetrieveSCP(
   const DcmAssociationConfiguration& associationConfiguration)
 : config_(&config)
 , processtable_()
+, associationPool_(NULL)
+, stop_(OFFalse)
+, stopMutex_()
 , dbCheckFindIdentifier_(OFFalse)
 , dbCheckMoveIdentifier_(OFFalse)
 , factory_(factory)
 , options_(options)
 , associationConfiguration_(associationConfiguration)
 {
+#ifdef WITH_THREADS
+  if (options_.singleProcess_)
+  {
+    Uint16 maxWorkers = OFstatic_cast(Uint16, (options_.maxAssociations_ > 0) ? options_.maxAssociations_ : 1);
+    associationPool_ = new DcmQueryRetrieveAssociationPool(*this, maxWorkers);
+  }
+#endif
+}
+
+
+DcmQueryRetrieveSCP::~DcmQueryRetrieveSCP()
+{
+#ifdef WITH_THREADS
+  delete associationPool_;
+#endif
+}
+
+
+size_t DcmQueryRetrieveSCP::countActiveAssociations()
+{
+  size_t result = processtable_.countChildProcesses();
+#ifdef WITH_THREADS
+  if (associationPool_) result += associationPool_->numThreads(OFTrue);
+#endif
+  return result;
 }
 
 
@@ -179,7 +305,15 @@ OFCondition DcmQueryRetrieveSCP::dispatch(T_ASC_Association *assoc, OFBool corre
         while (cond.good() && (firstLoop || options_.keepDBHandleDuringAssociation_) )
         {
             firstLoop = OFFalse;
-            cond = DIMSE_receiveCommand(assoc, DIMSE_BLOCKING, 0, &presID, &msg, NULL);
+            if (options_.singleProcess_)
+            {
+                /* wait for the next command in slices, so that an idle association notices a stop request */
+                do
+                {
+                    cond = DIMSE_receiveCommand(assoc, DIMSE_NONBLOCKING, options_.association_wait_timeout_, &presID, &msg, NULL);
+                } while ((cond == DIMSE_NODATAAVAILABLE) && !stopRequested());
+            }
+            else cond = DIMSE_receiveCommand(assoc, DIMSE_BLOCKING, 0, &presID, &msg, NULL);
 
             /* did peer release, abort, or do we have a valid message ? */
             if (cond.good())
@@ -253,6 +387,9 @@ OFCondition DcmQueryRetrieveSCP::handleAssociation(T_ASC_Association * assoc, OF
         ASC_dropSCPAssociation(assoc);
     } else if (cond == DUL_PEERABORTEDASSOCIATION) {
         DCMQRDB_INFO("Association Aborted");
+    } else if (cond == DIMSE_NODATAAVAILABLE) {
+        DCMQRDB_INFO("Server stopping, aborting idle association");
+        cond = ASC_abortAssociation(assoc);
     } else {
         DCMQRDB_ERROR("DIMSE Failure (aborting association): " << DimseCondition::dump(temp_str, cond));
         /* some kind of error so abort the association */
@@ -995,7 +1132,7 @@ OFCondition DcmQueryRetrieveSCP::waitForAssociation(T_ASC_Network * theNet)
     int timeout;
     OFBool go_cleanup = OFFalse;
 
-    if (options_.singleProcess_) timeout = 1000;
+    if (options_.singleProcess_) timeout = options_.association_wait_timeout_;
     else
     {
       if (processtable_.countChildProcesses() > 0)
@@ -1077,7 +1214,7 @@ OFCondition DcmQueryRetrieveSCP::waitForAssociation(T_ASC_Network * theNet)
     if (! go_cleanup)
     {
         // too many concurrent associations ??
-        if (processtable_.countChildProcesses() >= OFstatic_cast(size_t, options_.maxAssociations_))
+        if (countActiveAssociations() >= OFstatic_cast(size_t, options_.maxAssociations_))
         {
             cond = refuseAssociation(&assoc, CTN_TooManyAssociations);
             go_cleanup = OFTrue;
@@ -1109,8 +1246,22 @@ OFCondition DcmQueryRetrieveSCP::waitForAssociation(T_ASC_Network * theNet)
 
         if (options_.singleProcess_)
         {
+#ifdef WITH_THREADS
+            /* don't spawn a sub-process, hand the association over to a worker thread */
+            cond = associationPool_->startAssociation(assoc);
+            if (cond.bad())
+            {
+                /* the association is acknowledged already, so we can only abort it */
+                DCMQRDB_ERROR("Cannot create association worker thread: " << DimseCondition::dump(temp_str, cond));
+                ASC_abortAssociation(assoc);
+                ASC_dropAssociation(assoc);
+                ASC_destroyAssociation(&assoc);
+                cond = EC_Normal;
+            }
+#else
             /* don't spawn a sub-process to handle the association */
-            std::async(std::launch::async, &DcmQueryRetrieveSCP::handleAssociation, this, assoc, options_.correctUIDPadding_);
+            cond = handleAssociation(assoc, options_.correctUIDPadding_);
+#endif
         }
 #ifdef HAVE_FORK
         else
@@ -1168,6 +1319,23 @@ void DcmQueryRetrieveSCP::cleanChildren()
 }
 
 
+void DcmQueryRetrieveSCP::stop()
+{
+  stopMutex_.lock();
+  stop_ = OFTrue;
+  stopMutex_.unlock();
+}
+
+
+OFBool DcmQueryRetrieveSCP::stopRequested()
+{
+  stopMutex_.lock();
+  OFBool result = stop_;
+  stopMutex_.unlock();
+  return result;
+}
+
+
 void DcmQueryRetrieveSCP::setDatabaseFlags(
   OFBool dbCheckFindIdentifier,
   OFBool dbCheckMoveIdentifier)
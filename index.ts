@@ -15,12 +15,15 @@ interface scuOptions {
   source: Node;
   target: Node;
   verbose?: boolean;
+  maxPdu?: number;
+  priority?: number;
 }
 
 interface scpOptions {
   source: Node;
   peers: Node[];
   verbose?: boolean;
+  maxPdu?: number;
 }
 
 export interface echoScuOptions extends scuOptions {
@@ -30,6 +33,7 @@ export interface findScuOptions extends scuOptions {
   netTransferPrefer?: string;
   tags: KeyValue[];
   charset?: string;
+  resultBatchSize?: number;
 };
 
 export interface getScuOptions extends scuOptions {
@@ -47,6 +51,7 @@ export interface moveScuOptions extends scuOptions {
 export interface storeScuOptions extends scuOptions {
   sourcePath: string;
   netTransferPropose?: string;
+  maxAssociations?: number;
 };
 
 export interface storeScpOptions extends scpOptions {
@@ -57,22 +62,87 @@ export interface storeScpOptions extends scpOptions {
   permissive?: boolean;
   storeOnly?: boolean;
   writeFile?: boolean;
+  bitPreserving?: boolean;
+  maxAssociations?: number;
+  maxMoveSubAssociations?: number;
+  dbDurability?: 'full' | 'normal' | 'async';
+  fileDurability?: 'full' | 'normal' | 'async';
+  fileWriterThreads?: number;
+  rebuildDbCounters?: boolean;
+  dbIndexes?: string[];
+  codecThreads?: number;
 };
 
 export interface shutdownScuOptions extends scuOptions {
 };
 
+export interface peerLimit extends Node {
+  maxAssociations: number;
+};
+
+export interface schedulerOptions {
+  threads?: number;
+  maxAssociationsPerPeer?: number;
+  maxQueued?: number;
+  peers?: peerLimit[];
+};
+
+export interface schedulerStats {
+  queued: number;
+  running: number;
+  // associations held by the running operations, a storeScu with maxAssociations may hold several
+  associations: number;
+  completed: number;
+  avgQueueMs: number;
+  maxQueueMs: number;
+  avgRunMs: number;
+  maxRunMs: number;
+};
+
+export interface schedulerMetrics extends schedulerStats {
+  threads: number;
+  rejected: number;
+  peers: (schedulerStats & { peer: string; limit: number })[];
+};
+
+export interface scpHandle {
+  // stops listening, running associations are finished before the final callback
+  stop(): void;
+};
+
 export interface parseOptions {
   sourcePath: string;
   verbose?: boolean;
+  stopTag?: string;
+  includeTags?: string[];
+  compact?: boolean;
+  bulkDataThreshold?: number;
+}
+
+export interface parseFilesOptions extends Omit<parseOptions, 'sourcePath'> {
+  sourcePath?: string;
+  sourcePaths?: string[];
+  threads?: number;
+  resultBatchSize?: number;
 }
 
+export interface previewOptions {
+  sourcePath: string;
+  frame?: number;
+  reduceFactor?: number;
+  region?: { left?: number; top?: number; width?: number; height?: number };
+  codecThreads?: number;
+  verbose?: boolean;
+};
+
 export interface recompressOptions {
   sourcePath: string;
   storagePath: string;
   writeTransfer?: string;
   lossyQuality?: number;
   enableRecompression?: boolean;
+  threads?: number;
+  codecThreads?: number;
   verbose?: boolean;
 };
 
@@ -97,8 +167,8 @@ export function storeScu(options: storeScuOptions, callback: (result: string) =>
   addon.storeScu(JSON.stringify(options), callback);
 }
 
-export function startStoreScp(options: storeScpOptions, callback: (result: string) => void) {
-  addon.startScp(JSON.stringify(options), callback);
+export function startStoreScp(options: storeScpOptions, callback: (result: string, buffer?: Buffer) => void): scpHandle {
+  return addon.startScp(JSON.stringify(options), callback);
 }
 
 export function shutdownScu(options: shutdownScuOptions, callback: (result: string) => void) {
@@ -109,6 +179,22 @@ export function parseFile(options: parseOptions, callback: (result: string) => v
   addon.parseFile(JSON.stringify(options), callback);
 }
 
+export function parseFiles(options: parseFilesOptions, callback: (result: string) => void) {
+  addon.parseFiles(JSON.stringify(options), callback);
+}
+
+export function decodePreview(options: previewOptions, callback: (result: string, buffer?: Buffer) => void) {
+  addon.decodePreview(JSON.stringify(options), callback);
+}
+
 export function recompress(options: recompressOptions, callback: (result: string) => void) {
   addon.recompress(JSON.stringify(options), callback);
 }
+
+export function configureScheduler(options: schedulerOptions) {
+  addon.configureScheduler(JSON.stringify(options));
+}
+
+export function getSchedulerMetrics(): schedulerMetrics {
+  return JSON.parse(addon.getSchedulerMetrics());
+}
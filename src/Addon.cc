@@ -12,12 +12,18 @@
 #include "GetAsyncWorker.h"
 #include "MoveAsyncWorker.h"
 #include "StoreAsyncWorker.h"
-#include "ServerAsyncWorker.h"
+#include "ServerWorker.h"
 #include "ParseAsyncWorker.h"
+#include "ParseFilesAsyncWorker.h"
 #include "CompressAsyncWorker.h"
+#include "PreviewAsyncWorker.h"
 #include "ShutdownAsyncWorker.h"
+#include "OperationScheduler.h"
+#include "json.h"
 
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 
 using namespace Napi;
 
@@ -75,6 +81,24 @@ Value DoParse(const CallbackInfo& info) {
     return info.Env().Undefined();
 }
 
+Value DoParseFiles(const CallbackInfo& info) {
+    std::string input = info[0].As<String>().Utf8Value();
+    Function cb = info[1].As<Function>();
+
+    auto worker = new ParseFilesAsyncWorker(input, cb);
+    worker->Queue();
+    return info.Env().Undefined();
+}
+
+Value DoPreview(const CallbackInfo& info) {
+    std::string input = info[0].As<String>().Utf8Value();
+    Function cb = info[1].As<Function>();
+
+    auto worker = new PreviewAsyncWorker(input, cb);
+    worker->Queue();
+    return info.Env().Undefined();
+}
+
 Value DoCompress(const CallbackInfo& info) {
     std::string input = info[0].As<String>().Utf8Value();
     Function cb = info[1].As<Function>();
@@ -88,9 +112,16 @@ Value StartScp(const CallbackInfo& info) {
     std::string input = info[0].As<String>().Utf8Value();
     Function cb = info[1].As<Function>();
 
-    auto worker = new ServerAsyncWorker(input, cb);
-    worker->Queue();
-    return info.Env().Undefined();
+    // servers run on their own thread instead of occupying a libuv pool thread
+    auto worker = std::make_shared<ServerWorker>(input, cb);
+    worker->Start();
+
+    Object handle = Object::New(info.Env());
+    handle.Set("stop", Function::New(info.Env(), [worker](const CallbackInfo& info) -> Value {
+        worker->Stop();
+        return info.Env().Undefined();
+    }, "stop"));
+    return handle;
 }
 
 Value DoShutdown(const CallbackInfo& info) {
@@ -102,6 +133,51 @@ Value DoShutdown(const CallbackInfo& info) {
     return info.Env().Undefined();
 }
 
+Value ConfigureScheduler(const CallbackInfo& info) {
+    std::string input = info[0].As<String>().Utf8Value();
+
+    // omitted options keep their current value, peer limits are added to the existing ones.
+    // Nothing is applied if any option is invalid.
+    sSchedulerOptions options = OperationScheduler::instance().options();
+    auto count = [](const nlohmann::json& value) {
+        if (!value.is_number_integer() || value.get<long long>() < 0) {
+            throw std::invalid_argument("expected a non-negative integer, got " + value.dump());
+        }
+        return value.get<size_t>();
+    };
+    std::string key;
+    try {
+        nlohmann::json j = nlohmann::json::parse(input);
+        if (j.contains(key = "threads")) {
+            options.threads = count(j.at(key));
+        }
+        if (j.contains(key = "maxAssociationsPerPeer")) {
+            options.maxPerPeer = count(j.at(key));
+        }
+        if (j.contains(key = "maxQueued")) {
+            options.maxQueued = count(j.at(key));
+        }
+        if (j.contains(key = "peers")) {
+            for (const auto& peer : j.at(key)) {
+                key = "peers[" + peer.dump() + "]";
+                options.peerLimits[OperationScheduler::peerKey(peer.at("aet").get<std::string>(), peer.at("ip").get<std::string>(),
+                    peer.at("port").get<int>())] = count(peer.at("maxAssociations"));
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::string msg = key.empty() ? std::string("invalid scheduler options: ") : "invalid scheduler option " + key + ": ";
+        TypeError::New(info.Env(), msg + e.what()).ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+    OperationScheduler::instance().configure(options);
+    return info.Env().Undefined();
+}
+
+Value GetSchedulerMetrics(const CallbackInfo& info) {
+    return String::New(info.Env(), OperationScheduler::instance().metrics().dump());
+}
+
 
 Object Init(Env env, Object exports) {
 
@@ -129,8 +205,16 @@ Object Init(Env env, Object exports) {
                 Function::New(env, DoShutdown));
     exports.Set(String::New(env, "parseFile"),
                 Function::New(env, DoParse));
+    exports.Set(String::New(env, "parseFiles"),
+                Function::New(env, DoParseFiles));
+    exports.Set(String::New(env, "decodePreview"),
+                Function::New(env, DoPreview));
     exports.Set(String::New(env, "recompress"),
                 Function::New(env, DoCompress));
+    exports.Set(String::New(env, "configureScheduler"),
+                Function::New(env, ConfigureScheduler));
+    exports.Set(String::New(env, "getSchedulerMetrics"),
+                Function::New(env, GetSchedulerMetrics));
     return exports;
 }
 
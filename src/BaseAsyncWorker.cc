@@ -1,6 +1,7 @@
 #include "BaseAsyncWorker.h"
 
 #include "Utils.h"
+#include "OperationScheduler.h"
 
 #include "dcmtk/config/osconfig.h" /* make sure OS specific configuration is included first */
 #include "dcmtk/oflog/oflog.h"
@@ -37,17 +38,13 @@ protected:
 };
 
 
-BaseAsyncWorker::BaseAsyncWorker(std::string data, Function &callback) : AsyncProgressQueueWorker<char>(callback),
-                                                                           _input(data)
+BaseAsyncWorker::BaseAsyncWorker(std::string data, Function &callback) : CallbackWorker(data, callback, "BaseAsyncWorker"), _associations(1)
 {
     //add the custom appender
     // using namespace dcmtk::log4cplus;
     // Logger rootLogger = Logger::getRoot();
     // this->_appender = new BufferAppender();
     // rootLogger.addAppender(this->_appender);
-
-    // disable verbose logging
-    OFLog::configure(OFLogger::WARN_LOG_LEVEL);
 }
 
 BaseAsyncWorker::~BaseAsyncWorker() 
@@ -57,26 +54,44 @@ BaseAsyncWorker::~BaseAsyncWorker()
     // rootLogger.removeAppender(this->_appender);
 }
 
-void BaseAsyncWorker::OnOK()
+void BaseAsyncWorker::Queue()
 {
-      HandleScope scope(Env());
-      std::string msg = ns::createJsonResponse(ns::SUCCESS, "request succeeded", _jsonOutput);
-      if (_error.length() > 0) msg = _error;
-      String o = String::New(Env(), msg);
-      Callback().Call({o});
+    // operations against the same remote AE share its association limit, local operations only the threads
+    ns::sInput in = ns::parseInputJson(_input);
+    std::string peer = in.target.valid() ? OperationScheduler::peerKey(in.target.aet, in.target.ip, in.target.port) : std::string();
+    // operations that send over several associations hold a slot of the remote AE for each of them
+    size_t associations = in.maxAssociations > 1 ? OFstatic_cast(size_t, in.maxAssociations) : 1;
+    if (!OperationScheduler::instance().submit(peer, in.priority, associations, [this](size_t granted) {
+            _associations = granted;
+            Run();
+        })) {
+        SetErrorJson("operation rejected, scheduler queue is full");
+        Finish(_error);
+        delete this;
+    }
 }
 
-void BaseAsyncWorker::OnProgress(const char *data, size_t size)
+void BaseAsyncWorker::Run()
 {
-      HandleScope scope(Env());
-      String o = String::New(Env(), data, size);
-      Callback().Call({o});
+    try {
+        Execute(ExecutionProgress(this));
+    }
+    catch (const std::exception& e) {
+        SetErrorJson(std::string("exception: ") + e.what());
+    }
+    Finish(ns::createJsonResponse(ns::SUCCESS, "request succeeded", _jsonOutput));
+    delete this;
 }
 
-void BaseAsyncWorker::SetErrorJson(const std::string& message)
+void BaseAsyncWorker::ExecutionProgress::Send(const char* data, size_t count) const
 {
-       _error =  ns::createJsonResponse(ns::FAILURE, message);
-       // SetError(sError);
+    _worker->Post(std::string(data, count));
+}
+
+void BaseAsyncWorker::SendBuffer(const std::string& msg, unsigned char* data, size_t length, const ExecutionProgress& /*progress*/)
+{
+    // the buffer travels with its message, so concurrent senders cannot mix up buffers
+    Post(msg, data, length);
 }
 
 void BaseAsyncWorker::SendInfo(const std::string& msg, const ExecutionProgress& progress, ns::eStatus status)
@@ -86,15 +101,6 @@ void BaseAsyncWorker::SendInfo(const std::string& msg, const ExecutionProgress&
 }
 
 
-void BaseAsyncWorker::EnableVerboseLogging(bool enabled)
-{
-    if (enabled) {
-        OFLog::configure(OFLogger::DEBUG_LOG_LEVEL);
-    } else {
-        OFLog::configure(OFLogger::WARN_LOG_LEVEL);
-    }
-}
-
 void BaseAsyncWorker::applyOverrideKeys(DcmDataset *dataset, const OFList<OFString> &overrideKeys)
 {
     /* replace specific keys by those in overrideKeys */
@@ -2,9 +2,11 @@
 
 #include <napi.h>
 #include <iostream>
+#include <string>
 
 #include "json.h"
 #include "Utils.h"
+#include "CallbackWorker.h"
 
 #include "dcmtk/config/osconfig.h" /* make sure OS specific configuration is included first */
 #include "dcmtk/oflog/oflog.h"
@@ -15,24 +17,38 @@
 using namespace Napi;
 
 
-class BaseAsyncWorker : public AsyncProgressQueueWorker<char>
+// base of all operations, Queue() runs Execute() on a thread of the OperationScheduler instead of the libuv pool,
+// progress messages and the final response are passed to the callback through a thread-safe function
+class BaseAsyncWorker : public CallbackWorker
 {
     public:
+        // passes progress messages to the callback, can be used from any thread
+        class ExecutionProgress
+        {
+            public:
+                explicit ExecutionProgress(BaseAsyncWorker* worker) : _worker(worker) {}
+
+                void Send(const char* data, size_t count) const;
+
+            private:
+                BaseAsyncWorker* _worker;
+        };
+
         BaseAsyncWorker(std::string data, Function &callback);
 
-        ~BaseAsyncWorker();
+        virtual ~BaseAsyncWorker();
 
-        virtual void OnOK();
-        
-        virtual void OnProgress(const char *data, size_t size);
+        // queues the operation in the scheduler, the worker deletes itself after the final callback has been queued
+        void Queue();
 
-    protected:
+        virtual void Execute(const ExecutionProgress& progress) = 0;
 
-        void SetErrorJson(const std::string& message);
+        // passes msg and the data as Buffer to the callback, the Buffer takes ownership of the new[] allocated data
+        void SendBuffer(const std::string& msg, unsigned char* data, size_t length, const ExecutionProgress& progress);
 
-        void SendInfo(const std::string& msg, const ExecutionProgress& progress, ns::eStatus status = ns::PENDING);
+    protected:
 
-        void EnableVerboseLogging(bool enabled);
+        void SendInfo(const std::string& msg, const ExecutionProgress& progress, ns::eStatus status = ns::PENDING);
 
         void applyOverrideKeys(DcmDataset *dataset, const OFList<OFString> &overrideKeys);
 
@@ -40,8 +56,12 @@ class BaseAsyncWorker : public AsyncProgressQueueWorker<char>
 
         void prepareTS(E_TransferSyntax ts,  OFList<OFString> &syntaxes);
 
-        std::string _input;
         nlohmann::json _jsonOutput;
-        std::string _error;
         dcmtk::log4cplus::SharedAppenderPtr _appender;
+        // associations to the target granted by the scheduler, at most maxAssociations
+        size_t _associations;
+
+    private:
+        // runs the operation and sends the final response, called by the scheduler
+        void Run();
 };
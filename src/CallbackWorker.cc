@@ -0,0 +1,71 @@
+#include "CallbackWorker.h"
+
+#include "Utils.h"
+
+#include "dcmtk/config/osconfig.h" /* make sure OS specific configuration is included first */
+#include "dcmtk/oflog/oflog.h"
+
+CallbackWorker::CallbackWorker(std::string data, Function &callback, const char* resourceName) : _input(data)
+{
+    // unlimited queue, a worker never waits for JS, only one thread releases the function
+    _tsfn = ThreadSafeFunction::New(callback.Env(), callback, resourceName, 0, 1);
+
+    // disable verbose logging
+    OFLog::configure(OFLogger::WARN_LOG_LEVEL);
+}
+
+CallbackWorker::~CallbackWorker()
+{
+}
+
+void CallbackWorker::Post(const std::string& msg, unsigned char* data, size_t length)
+{
+    sMessage* message = new sMessage();
+    message->msg = msg;
+    message->data = data;
+    message->length = length;
+    if (_tsfn.BlockingCall(message, CallJs) != napi_ok) {
+        // the environment is shutting down
+        delete[] message->data;
+        delete message;
+    }
+}
+
+void CallbackWorker::Finish(const std::string& msg)
+{
+    Post(_error.length() > 0 ? _error : msg);
+    _tsfn.Release();
+}
+
+void CallbackWorker::CallJs(Napi::Env env, Function callback, sMessage* message)
+{
+    if (env != nullptr && callback != nullptr) {
+        String o = String::New(env, message->msg);
+        if (message->data) {
+            // external memory, copied only if the runtime does not allow external buffers
+            Buffer<unsigned char> b = Buffer<unsigned char>::NewOrCopy(env, message->data, message->length,
+                [](Napi::Env /*env*/, unsigned char* data) { delete[] data; });
+            message->data = NULL;
+            callback.Call({o, b});
+        }
+        else {
+            callback.Call({o});
+        }
+    }
+    delete[] message->data;
+    delete message;
+}
+
+void CallbackWorker::SetErrorJson(const std::string& message)
+{
+    _error = ns::createJsonResponse(ns::FAILURE, message);
+}
+
+void CallbackWorker::EnableVerboseLogging(bool enabled)
+{
+    if (enabled) {
+        OFLog::configure(OFLogger::DEBUG_LOG_LEVEL);
+    } else {
+        OFLog::configure(OFLogger::WARN_LOG_LEVEL);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <napi.h>
+#include <string>
+
+using namespace Napi;
+
+// common base of the workers, passes messages from any thread to the JS callback through a thread-safe function.
+// The messages arrive in the order they were posted.
+class CallbackWorker
+{
+    public:
+        CallbackWorker(std::string data, Function &callback, const char* resourceName);
+
+        virtual ~CallbackWorker();
+
+        // passes msg and the data, if any, as Buffer to the callback, the Buffer takes ownership of the new[] allocated data
+        void Post(const std::string& msg, unsigned char* data = NULL, size_t length = 0);
+
+    protected:
+        // posts _error if set, msg otherwise, as final response and releases the callback
+        void Finish(const std::string& msg);
+
+        void SetErrorJson(const std::string& message);
+
+        void EnableVerboseLogging(bool enabled);
+
+        std::string _input;
+        std::string _error;
+
+    private:
+        struct sMessage {
+            std::string msg;
+            unsigned char* data;
+            size_t length;
+        };
+
+        static void CallJs(Napi::Env env, Function callback, sMessage* message);
+
+        ThreadSafeFunction _tsfn;
+};
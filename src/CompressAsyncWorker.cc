@@ -4,6 +4,11 @@
 #include <list>
 #include <memory>
 #include <sstream>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "Utils.h"
 
@@ -75,12 +80,77 @@ namespace
 #endif
     return OFFilename(fullPath.c_str());
   }
+
+  // number of files waiting between two pipeline stages
+  const size_t MAX_QUEUED_JOBS = 4;
+
+  // queue between two stages of the recompress pipeline, pop() fails once the queue is closed and empty
+  template <typename T>
+  class JobQueue
+  {
+  public:
+    JobQueue() : m_closed(false) {}
+
+    void push(T job)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_notFull.wait(lock, [this] { return m_jobs.size() < MAX_QUEUED_JOBS; });
+      m_jobs.push_back(std::move(job));
+      lock.unlock();
+      m_notEmpty.notify_one();
+    }
+
+    bool pop(T &job)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_notEmpty.wait(lock, [this] { return m_closed || !m_jobs.empty(); });
+      if (m_jobs.empty())
+        return false;
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+      lock.unlock();
+      m_notFull.notify_one();
+      return true;
+    }
+
+    void close()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+      }
+      m_notEmpty.notify_all();
+    }
+
+  private:
+    std::deque<T> m_jobs;
+    bool m_closed;
+    std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+  };
 }
 
+// a file passing through the stages of recompress()
+struct CompressJob
+{
+  CompressJob() : isSameFile(false), originalXfer(EXS_Unknown), writeXfer(EXS_Unknown), done(false), success(false) {}
+
+  OFFilename infile;
+  OFFilename outfile;
+  std::unique_ptr<DcmFileFormat> dfile;
+  bool isSameFile;
+  E_TransferSyntax originalXfer;
+  E_TransferSyntax writeXfer;
+  // set if no further stage has to run
+  bool done;
+  bool success;
+};
+
 CompressAsyncWorker::CompressAsyncWorker(std::string data, Function &callback)
     : BaseAsyncWorker(data, callback)
 {
-  ns::registerCodecs();
+  ns::registerCodecs(ns::parseInputJson(data).codecThreads);
 }
 
 void CompressAsyncWorker::Execute(const ExecutionProgress &progress)
@@ -172,22 +242,74 @@ void CompressAsyncWorker::Execute(const ExecutionProgress &progress)
 
 
 
-  OFListIterator(OFFilename) iter = fileNameList.begin();
-  OFListIterator(OFFilename) enditer = fileNameList.end();
-
-  float fileCount = static_cast<float>(fileNameList.size());
-  float count = 0;
+  size_t numThreads = in.threads > 1 ? OFstatic_cast(size_t, in.threads) : 1;
   bool validFileFound = false;
-  while ((iter != enditer))
+  if (numThreads == 1)
   {
-    if (recompress(*iter, OFString(in.storagePath.c_str()), writeTrans.getXfer(), in.lossyQuality, in.enableRecompression))
+    OFListIterator(OFFilename) iter = fileNameList.begin();
+    OFListIterator(OFFilename) enditer = fileNameList.end();
+    while ((iter != enditer))
     {
-      validFileFound = true;
+      CompressJob job;
+      job.infile = *iter;
+      if (loadFile(job, OFString(in.storagePath.c_str()), writeTrans.getXfer(), in.enableRecompression) &&
+          encode(job, in.lossyQuality))
+      {
+        saveFile(job);
+      }
+      validFileFound |= job.success;
+      reportProgress(job, progress);
+      ++iter;
     }
-    ++iter;
-    ++count;
-    int progress = (int)(count / fileCount * 100.0f);
-    DCMNET_INFO("Compress progress: " << progress);
+  }
+  else
+  {
+    // read, encode and write in separate stages, only encoding runs on several threads
+    DCMNET_INFO("recompressing " << fileNameList.size() << " files on " << numThreads << " threads");
+    JobQueue< std::unique_ptr<CompressJob> > loaded;
+    JobQueue< std::unique_ptr<CompressJob> > encoded;
+
+    std::thread reader([&] {
+      for (OFListIterator(OFFilename) iter = fileNameList.begin(); iter != fileNameList.end(); ++iter)
+      {
+        std::unique_ptr<CompressJob> job(new CompressJob());
+        job->infile = *iter;
+        loadFile(*job, OFString(in.storagePath.c_str()), writeTrans.getXfer(), in.enableRecompression);
+        loaded.push(std::move(job));
+      }
+      loaded.close();
+    });
+
+    std::vector<std::thread> encoders;
+    for (size_t i = 0; i < numThreads; ++i)
+    {
+      encoders.push_back(std::thread([&] {
+        std::unique_ptr<CompressJob> job;
+        while (loaded.pop(job))
+        {
+          if (!job->done)
+            encode(*job, in.lossyQuality);
+          encoded.push(std::move(job));
+        }
+      }));
+    }
+
+    std::thread writer([&] {
+      std::unique_ptr<CompressJob> job;
+      while (encoded.pop(job))
+      {
+        if (!job->done)
+          saveFile(*job);
+        validFileFound |= job->success;
+        reportProgress(*job, progress);
+      }
+    });
+
+    reader.join();
+    for (std::thread &encoder : encoders)
+      encoder.join();
+    encoded.close();
+    writer.join();
   }
 
   if (!validFileFound)
@@ -196,15 +318,29 @@ void CompressAsyncWorker::Execute(const ExecutionProgress &progress)
   }
 }
 
+void CompressAsyncWorker::reportProgress(const CompressJob &job, const ExecutionProgress &progress)
+{
+  json v = json::object();
+  v["Filepath"] = job.infile.getCharPointer();
+  v["Success"] = job.success;
+  if (job.success && !job.outfile.isEmpty())
+    v["Outputpath"] = job.outfile.getCharPointer();
+  std::string msg = ns::createJsonResponse(ns::PENDING, "RECOMPRESSED", v);
+  progress.Send(msg.c_str(), msg.length());
+}
+
 OFBool CompressAsyncWorker::isDicomFile(const OFFilename &fname)
 {
   // TODO: implement
   return OFTrue;
 }
 
-OFBool CompressAsyncWorker::recompress(const OFFilename &infile, const OFString &storePath, E_TransferSyntax _prefXfer, int quality, bool enableRecompression)
+OFBool CompressAsyncWorker::loadFile(CompressJob &job, const OFString &storePath, E_TransferSyntax _prefXfer, bool enableRecompression)
 {
-  DcmFileFormat dfile;
+  const OFFilename &infile = job.infile;
+  job.done = true;
+  job.dfile.reset(new DcmFileFormat());
+  DcmFileFormat &dfile = *job.dfile;
   OFCondition status = dfile.loadFile(infile, EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect);
   if (status.bad())
   {
@@ -222,13 +358,13 @@ OFBool CompressAsyncWorker::recompress(const OFFilename &infile, const OFString
   }
   OFFilename outfile(storePath + OFString("/") + OFString(sopInstanceUID));
   DCMNET_INFO("output: " << outfile.getCharPointer());
+  job.outfile = outfile;
 
   // create paths that we can actually compare
   OFpath inpath(convertToOsPath(infile.getCharPointer()).getCharPointer());
   OFpath outpath(convertToOsPath(outfile.getCharPointer()).getCharPointer());
 
   // check if input is same as output
-  bool isSameFile = false;
   E_TransferSyntax originalXfer = lookForXfer(dfile.getMetaInfo());
   E_TransferSyntax prefXfer = _prefXfer;
 
@@ -247,18 +383,39 @@ OFBool CompressAsyncWorker::recompress(const OFFilename &infile, const OFString
           prefXfer = originalXfer;
         }
   }
-  
+  job.originalXfer = originalXfer;
+  job.writeXfer = prefXfer;
+
   if (inpath == outpath)
   {
-    isSameFile = true;
+    job.isSameFile = true;
     // skip writing if input and output is the same and TS match already
     if (originalXfer == prefXfer)
     {
       DCMNET_INFO("file has correct Xfer already skipping...");
-      return OFTrue;
+      job.success = true;
+      return OFFalse;
     }
   }
 
+  // read the pixel data here, so the read overlaps with the encoding of other files on the encoder threads
+  status = dfile.loadAllDataIntoMemory();
+  if (status.bad())
+  {
+    DCMNET_WARN("Failed loading file: " << infile.getCharPointer());
+    return OFFalse;
+  }
+
+  job.done = false;
+  return OFTrue;
+}
+
+OFBool CompressAsyncWorker::encode(CompressJob &job, int quality)
+{
+  DcmFileFormat &dfile = *job.dfile;
+  E_TransferSyntax prefXfer = job.writeXfer;
+  job.done = true;
+
   // set quality factor
   DcmXfer xfer(prefXfer);
 
@@ -284,8 +441,8 @@ OFBool CompressAsyncWorker::recompress(const OFFilename &infile, const OFString
   OFCondition cond = dfile.chooseRepresentation(prefXfer, rp);
   if (cond.bad() || !dfile.canWriteXfer(prefXfer))
   {
-    DCMNET_WARN("Failed compressing file: " << infile.getCharPointer() << " keeping original");
-    cond = dfile.chooseRepresentation(originalXfer, NULL);
+    DCMNET_WARN("Failed compressing file: " << job.infile.getCharPointer() << " keeping original");
+    cond = dfile.chooseRepresentation(job.originalXfer, NULL);
   }
 
   if (cond.bad()) {
@@ -293,8 +450,20 @@ OFBool CompressAsyncWorker::recompress(const OFFilename &infile, const OFString
       return OFFalse;
   }
 
+  job.done = false;
+  return OFTrue;
+}
+
+OFBool CompressAsyncWorker::saveFile(CompressJob &job)
+{
+  DcmFileFormat &dfile = *job.dfile;
+  const OFFilename &outfile = job.outfile;
+  E_TransferSyntax prefXfer = job.writeXfer;
+  OFCondition cond;
+  job.done = true;
+
   // just save the file if output is different
-  if (!isSameFile)
+  if (!job.isSameFile)
   {
     cond = dfile.saveFile(outfile, prefXfer);
     if (cond.bad())
@@ -302,6 +471,7 @@ OFBool CompressAsyncWorker::recompress(const OFFilename &infile, const OFString
       DCMNET_WARN("Failed writing file to: " << outfile.getCharPointer());
       return OFFalse;
     }
+    job.success = true;
     return OFTrue;
   }
 
@@ -333,5 +503,6 @@ OFBool CompressAsyncWorker::recompress(const OFFilename &infile, const OFString
     return OFFalse;
   }
 
+  job.success = true;
   return OFTrue;
 }
@@ -11,6 +11,8 @@
 
 using namespace Napi;
 
+struct CompressJob;
+
 class CompressAsyncWorker : public BaseAsyncWorker
 {
     public:
@@ -20,5 +22,10 @@ class CompressAsyncWorker : public BaseAsyncWorker
 
     protected:
         OFBool isDicomFile( const OFFilename &fname );
-        OFBool recompress(const OFFilename& infile, const OFString& storePath, E_TransferSyntax prefXfer, int quality, bool enableRecompression);
+        // the stages of recompressing a file, each returns false if the file needs no further stage
+        OFBool loadFile(CompressJob& job, const OFString& storePath, E_TransferSyntax prefXfer, bool enableRecompression);
+        OFBool encode(CompressJob& job, int quality);
+        OFBool saveFile(CompressJob& job);
+
+        void reportProgress(const CompressJob& job, const ExecutionProgress& progress);
 };
@@ -158,7 +158,7 @@ void EchoAsyncWorker::Execute(const ExecutionProgress &progress)
     const char *opt_peerTitle = in.target.aet.c_str();
     const char *opt_ourTitle = in.source.aet.c_str();
 
-    OFCmdUnsignedInt opt_maxReceivePDULength = ASC_DEFAULTMAXPDU;
+    OFCmdUnsignedInt opt_maxReceivePDULength = ns::maxReceivePdu(in);
     OFCmdUnsignedInt opt_repeatCount = 1;
     OFBool opt_abortAssociation = OFFalse;
     OFCmdUnsignedInt opt_numXferSyntaxes = 1;
@@ -9,6 +9,7 @@
 #include <list>
 #include <iomanip>
 #include <vector>
+#include <functional>
 
 using json = nlohmann::json;
 
@@ -76,10 +77,71 @@ std::string int_to_hex(uint16_t i)
 }
 
 
+// converts a response to DICOM JSON
+json toDicomJson(const ns::DicomObject &obj)
+{
+    json v = json::object();
+    for (const ns::DicomElement &elm : obj)
+    {
+        std::string value = elm.value;
+        std::string keyName = int_to_hex(elm.xtag.getGroup()) + int_to_hex(elm.xtag.getElement());
+        DcmTag t(elm.xtag);
+        std::string vr = std::string(t.getVR().getVRName());
+        json jsonValue = json::array();
+        if (vr == "PN") {
+            json j;
+            j["Alphabetic"] = value;
+            jsonValue.push_back(j);
+        }
+        else if (vr == "IS" || vr == "SL" || vr == "SS" || vr == "UL" || vr == "US") {
+            if (value.length() == 0) {
+                jsonValue.push_back(nullptr);
+            }
+            else {
+                std::vector<std::string> splitValue = split(value, '\\');
+                for (auto i : splitValue) {
+                    try {
+                        jsonValue.push_back(std::stoi(i));
+                    }
+                    catch (...) {
+                        jsonValue.push_back(nullptr);
+                    }
+                }
+            }
+        }
+        else if (vr == "DS" || vr == "FL" || vr == "FD") {
+            if (value.length() == 0) {
+                jsonValue.push_back(nullptr);
+            }
+            else {
+                std::vector<std::string> splitValue = split(value, '\\');
+                for (auto i : splitValue) {
+                    try {
+                        jsonValue.push_back(std::stof(i));
+                    }
+                    catch (...) {
+                        jsonValue.push_back(nullptr);
+                    }
+                }
+            }
+        }
+        else {
+            jsonValue = split(value, '\\');
+        }
+
+        v[keyName]["vr"] = vr;
+        if (!(jsonValue.size() == 1 &&  jsonValue[0] == nullptr)) {
+            v[keyName]["Value"] = jsonValue;
+        }
+    }
+    return v;
+}
+
 class FindScuCallback : public DcmFindSCUCallback
 {
 public:
-    FindScuCallback(const ns::DicomObject &rqContainer, std::list<ns::DicomObject> *rspContainer);
+    // responses are converted to DICOM JSON and appended to rspContainer
+    FindScuCallback(const ns::DicomObject &rqContainer, json *rspContainer);
 
     ~FindScuCallback() {}
 
@@ -91,12 +153,19 @@ public:
 
     std::string charset;
 
+    // if set, called whenever batchSize responses are collected, expected to empty the container
+    std::function<void(json &)> flush;
+    size_t batchSize = 0;
+
+    // number of responses received so far
+    size_t numResponses = 0;
+
 private:
     ns::DicomObject m_requestContainer;
-    std::list<ns::DicomObject> *m_responseContainer;
+    json *m_responseContainer;
 };
 
-FindScuCallback::FindScuCallback(const ns::DicomObject &rqContainer, std::list<ns::DicomObject> *rspContainer)
+FindScuCallback::FindScuCallback(const ns::DicomObject &rqContainer, json *rspContainer)
     : m_requestContainer(rqContainer), m_responseContainer(rspContainer)
 {
 }
@@ -152,7 +221,11 @@ void FindScuCallback::callback(T_DIMSE_C_FindRQ *request, int &responseCount, T_
             responseItem.push_back(cp);
         }
     }
-    m_responseContainer->push_back(responseItem);
+    m_responseContainer->push_back(toDicomJson(responseItem));
+    ++numResponses;
+    if (flush && m_responseContainer->size() >= batchSize) {
+        flush(*m_responseContainer);
+    }
 }
 
 } // namespace
@@ -218,9 +291,17 @@ void FindAsyncWorker::Execute(const ExecutionProgress &progress)
         return;
     }
 
-    std::list<ns::DicomObject> result;
+    json result = json::array();
     FindScuCallback callback(queryAttributes, &result);
     callback.charset = in.charset;
+    if (in.resultBatchSize > 0) {
+        // stream the matches instead of holding all of them until the association is released
+        callback.batchSize = in.resultBatchSize;
+        callback.flush = [this, &progress](json &responses) {
+            SendResults(responses, progress);
+            responses = json::array();
+        };
+    }
 
     // do the main work: negotiate network association, perform C-FIND transaction,
     // process results, and finally tear down the association.
@@ -233,7 +314,7 @@ void FindAsyncWorker::Execute(const ExecutionProgress &progress)
         pref_find_networkTransferSyntax,
         DIMSE_BLOCKING,
         30,
-        ASC_DEFAULTMAXPDU,
+        ns::maxReceivePdu(in),
         false,
         false,
         1,
@@ -260,65 +341,21 @@ void FindAsyncWorker::Execute(const ExecutionProgress &progress)
 
     OFStandard::shutdownNetwork();
 
-    // convert result
-    json outJson = json::array();
-    for (const ns::DicomObject &obj : result)
-    {
-        json v = json::object();
-        for (const ns::DicomElement &elm : obj)
-        {
-            std::string value = elm.value;
-            std::string keyName = int_to_hex(elm.xtag.getGroup()) + int_to_hex(elm.xtag.getElement());
-            DcmTag t(elm.xtag);
-            std::string vr = std::string(t.getVR().getVRName());
-            json jsonValue = json::array();
-            if (vr == "PN") {
-                json j;
-                j["Alphabetic"] = value;
-                jsonValue.push_back(j);
-            }
-            else if (vr == "IS" || vr == "SL" || vr == "SS" || vr == "UL" || vr == "US") {
-                if (value.length() == 0) {
-                    jsonValue.push_back(nullptr);
-                }
-                else {
-                    std::vector<std::string> splitValue = split(value, '\\');
-                    for (auto i : splitValue) {
-                        try {
-                            jsonValue.push_back(std::stoi(i));
-                        }
-                        catch (...) {
-                            jsonValue.push_back(nullptr);
-                        }
-                    }
-                }
-            }
-            else if (vr == "DS" || vr == "FL" || vr == "FD") {
-                if (value.length() == 0) {
-                    jsonValue.push_back(nullptr);
-                }
-                else {
-                    std::vector<std::string> splitValue = split(value, '\\');
-                    for (auto i : splitValue) {
-                        try {
-                            jsonValue.push_back(std::stof(i));
-                        }
-                        catch (...) {
-                            jsonValue.push_back(nullptr);
-                        }
-                    }
-                }
-            }
-            else {
-                jsonValue = split(value, '\\');
-            }
-
-            v[keyName]["vr"] = vr;
-            if (!(jsonValue.size() == 1 &&  jsonValue[0] == nullptr)) {
-                v[keyName]["Value"] = jsonValue;
-            }
+    if (in.resultBatchSize > 0) {
+        if (!result.empty()) {
+            SendResults(result, progress);
         }
-        outJson.push_back(v);
-        _jsonOutput = outJson.dump();
+        json summary = json::object();
+        summary["NumberOfMatches"] = callback.numResponses;
+        _jsonOutput = summary.dump();
+        return;
     }
+
+    _jsonOutput = result.dump();
+}
+
+void FindAsyncWorker::SendResults(const json &results, const ExecutionProgress &progress)
+{
+    std::string msg = ns::createJsonResponse(ns::PENDING, "request pending", results.dump());
+    progress.Send(msg.c_str(), msg.length());
 }
@@ -10,4 +10,8 @@ class FindAsyncWorker : public BaseAsyncWorker
         FindAsyncWorker(std::string data, Function &callback);
 
         void Execute(const ExecutionProgress& progress);
+
+    protected:
+        // sends a batch of matches as DICOM JSON in a pending response
+        void SendResults(const json& results, const ExecutionProgress& progress);
 };
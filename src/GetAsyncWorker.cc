@@ -38,7 +38,7 @@ namespace
     {
         public:
 
-            NanNotifier(const AsyncProgressQueueWorker<char>::ExecutionProgress& progress): _progress(progress) {
+            NanNotifier(const BaseAsyncWorker::ExecutionProgress& progress): _progress(progress) {
 
             }
             inline void sendMessage(const OFString& msg, const OFString& container) {
@@ -48,7 +48,7 @@ namespace
                 _progress.Send(msg2.c_str(), msg2.length());
             }
         private:
-            AsyncProgressQueueWorker<char>::ExecutionProgress _progress;
+            BaseAsyncWorker::ExecutionProgress _progress;
 
     };
 } // namespace
@@ -96,7 +96,7 @@ void GetAsyncWorker::Execute(const ExecutionProgress &progress)
     DcmXfer netTransPrefer = in.netTransferPrefer.empty() ? DcmXfer(EXS_Unknown) : DcmXfer(in.netTransferPrefer.c_str());
     DCMNET_INFO("preferred (accepted) network transfer syntax for incoming associations: " << netTransPrefer.getXferName());
 
-    OFCmdUnsignedInt opt_maxPDU = ASC_DEFAULTMAXPDU;
+    OFCmdUnsignedInt opt_maxPDU = ns::maxReceivePdu(in);
     E_TransferSyntax opt_store_networkTransferSyntax = netTransPrefer.getXfer();
     E_TransferSyntax opt_get_networkTransferSyntax =  netTransPrefer.getXfer();
     DcmStorageMode opt_storageMode = DCMSCU_STORAGE_DISK;
@@ -88,7 +88,7 @@ void MoveAsyncWorker::Execute(const ExecutionProgress &progress)
     OFList<OFString> syntaxes;
     this->prepareTS(netTransPrefer.getXfer(), syntaxes);
     DcmSCU scu;
-    scu.setMaxReceivePDULength(ASC_DEFAULTMAXPDU);
+    scu.setMaxReceivePDULength(ns::maxReceivePdu(in));
     scu.setACSETimeout(60);
     scu.setDIMSEBlockingMode(DIMSE_BLOCKING);
     scu.setDIMSETimeout(60);
@@ -0,0 +1,201 @@
+#include "OperationScheduler.h"
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+using json = nlohmann::json;
+
+OperationScheduler::OperationScheduler() : m_rejected(0), m_threadCount(0)
+{
+}
+
+OperationScheduler& OperationScheduler::instance()
+{
+    // never destroyed, the detached scheduler threads may still use it while the process exits
+    static OperationScheduler* scheduler = new OperationScheduler();
+    return *scheduler;
+}
+
+std::string OperationScheduler::peerKey(const std::string& aet, const std::string& ip, int port)
+{
+    std::ostringstream key;
+    key << aet << "@" << ip << ":" << port;
+    return key.str();
+}
+
+void OperationScheduler::configure(const sSchedulerOptions& options)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_options = options;
+        if (m_options.threads == 0) {
+            m_options.threads = 1;
+        }
+        startThreads();
+    }
+    // raised limits may allow waiting operations to start, surplus threads exit
+    m_cond.notify_all();
+}
+
+sSchedulerOptions OperationScheduler::options()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_options;
+}
+
+bool OperationScheduler::submit(const std::string& peer, int priority, size_t associations, std::function<void(size_t)> run)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_options.maxQueued > 0 && m_queue.size() >= m_options.maxQueued) {
+            ++m_rejected;
+            return false;
+        }
+
+        sOperation op;
+        op.peer = peer;
+        op.priority = priority;
+        op.associations = std::max<size_t>(associations, 1);
+        op.submitted = Clock::now();
+        op.run = run;
+
+        // behind all operations of the same or a higher priority
+        auto pos = std::find_if(m_queue.begin(), m_queue.end(), [priority](const sOperation& queued) { return queued.priority < priority; });
+        m_queue.insert(pos, op);
+        ++m_peers[peer].queued;
+        ++m_total.queued;
+
+        startThreads();
+    }
+    m_cond.notify_one();
+    return true;
+}
+
+json OperationScheduler::metrics()
+{
+    auto toJson = [](const sPeerStats& stats) {
+        json j = json::object();
+        j["queued"] = stats.queued;
+        j["running"] = stats.running;
+        j["associations"] = stats.associations;
+        j["completed"] = stats.completed;
+        j["avgQueueMs"] = stats.completed > 0 ? stats.waitMs / stats.completed : 0.0;
+        j["maxQueueMs"] = stats.maxWaitMs;
+        j["avgRunMs"] = stats.completed > 0 ? stats.runMs / stats.completed : 0.0;
+        j["maxRunMs"] = stats.maxRunMs;
+        return j;
+    };
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    json result = toJson(m_total);
+    result["threads"] = m_threadCount;
+    result["rejected"] = m_rejected;
+    json peers = json::array();
+    for (const auto& peer : m_peers) {
+        if (peer.first.empty()) {
+            continue;
+        }
+        json p = toJson(peer.second);
+        p["peer"] = peer.first;
+        p["limit"] = peerLimit(peer.first);
+        peers.push_back(p);
+    }
+    result["peers"] = peers;
+    return result;
+}
+
+void OperationScheduler::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        std::list<sOperation>::iterator it;
+        m_cond.wait(lock, [this, &it] {
+            if (m_threadCount > m_options.threads) {
+                return true;
+            }
+            it = nextRunnable();
+            return it != m_queue.end();
+        });
+        if (m_threadCount > m_options.threads) {
+            // the pool has been shrunk
+            --m_threadCount;
+            return;
+        }
+
+        sOperation op = std::move(*it);
+        m_queue.erase(it);
+        size_t associations = grantedAssociations(op);
+        sPeerStats& peer = m_peers[op.peer];
+        --peer.queued;
+        --m_total.queued;
+        for (sPeerStats* stats : { &peer, &m_total }) {
+            ++stats->running;
+            stats->associations += associations;
+        }
+        lock.unlock();
+
+        Clock::time_point started = Clock::now();
+        op.run(associations);
+        Clock::time_point finished = Clock::now();
+
+        double waitMs = std::chrono::duration<double, std::milli>(started - op.submitted).count();
+        double runMs = std::chrono::duration<double, std::milli>(finished - started).count();
+
+        lock.lock();
+        for (sPeerStats* stats : { &m_peers[op.peer], &m_total }) {
+            --stats->running;
+            stats->associations -= associations;
+            ++stats->completed;
+            stats->waitMs += waitMs;
+            stats->maxWaitMs = std::max(stats->maxWaitMs, waitMs);
+            stats->runMs += runMs;
+            stats->maxRunMs = std::max(stats->maxRunMs, runMs);
+        }
+        // forget idle remote AEs, so a long running process does not collect every AE it ever talked to.
+        // Configured limits are part of the options and stay.
+        auto idle = m_peers.find(op.peer);
+        if (idle != m_peers.end() && idle->second.queued == 0 && idle->second.running == 0) {
+            m_peers.erase(idle);
+        }
+        // a slot of this remote AE is free again, which may allow an operation other than the next one to start
+        m_cond.notify_all();
+    }
+}
+
+std::list<OperationScheduler::sOperation>::iterator OperationScheduler::nextRunnable()
+{
+    for (auto it = m_queue.begin(); it != m_queue.end(); ++it) {
+        size_t limit = peerLimit(it->peer);
+        if (it->peer.empty() || limit == 0 || m_peers[it->peer].associations < limit) {
+            return it;
+        }
+    }
+    return m_queue.end();
+}
+
+size_t OperationScheduler::grantedAssociations(const sOperation& op)
+{
+    size_t limit = peerLimit(op.peer);
+    if (op.peer.empty() || limit == 0) {
+        return op.associations;
+    }
+    // rather start with fewer associations than wait for the peer to become idle
+    size_t held = m_peers[op.peer].associations;
+    return held < limit ? std::min(op.associations, limit - held) : 1;
+}
+
+size_t OperationScheduler::peerLimit(const std::string& peer) const
+{
+    auto it = m_options.peerLimits.find(peer);
+    return it != m_options.peerLimits.end() ? it->second : m_options.maxPerPeer;
+}
+
+void OperationScheduler::startThreads()
+{
+    while (m_threadCount < m_options.threads) {
+        // detached, the threads wait for operations for the lifetime of the process
+        std::thread(&OperationScheduler::workerLoop, this).detach();
+        ++m_threadCount;
+    }
+}
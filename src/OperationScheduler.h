@@ -0,0 +1,100 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "json.h"
+
+struct sSchedulerOptions {
+    sSchedulerOptions() : threads(16), maxPerPeer(0), maxQueued(0) {}
+    // number of scheduler threads, operations never run on the libuv thread pool
+    size_t threads;
+    // maximum number of associations open concurrently to the same remote AE, 0 for no limit (default)
+    size_t maxPerPeer;
+    // maximum number of waiting operations, further operations are rejected, 0 for no limit
+    size_t maxQueued;
+    // limits of single remote AEs, overriding maxPerPeer
+    std::map<std::string, size_t> peerLimits;
+};
+
+// runs the operations of the addon on its own threads. Operations against the same remote AE
+// are limited to a number of concurrent associations, waiting operations are started by priority
+// and in the order they were submitted.
+class OperationScheduler
+{
+public:
+    // the scheduler of the process, created on first use and never destroyed
+    static OperationScheduler& instance();
+
+    // key of a remote AE used for its limit and metrics
+    static std::string peerKey(const std::string& aet, const std::string& ip, int port);
+
+    // applies new options, running and waiting operations are kept
+    void configure(const sSchedulerOptions& options);
+
+    // the options currently applied
+    sSchedulerOptions options();
+
+    // queues the operation, higher priorities start first. peer is empty for local operations
+    // which are only limited by the number of threads. An operation may open up to associations
+    // associations to the peer, it is passed the number it may open, which is capped at the free
+    // slots of the peer when it starts. Returns false if the queue is full.
+    bool submit(const std::string& peer, int priority, size_t associations, std::function<void(size_t)> run);
+
+    // queue depth, running operations and latencies, in total and per remote AE with queued or running operations
+    nlohmann::json metrics();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct sOperation {
+        std::string peer;
+        int priority;
+        size_t associations;
+        Clock::time_point submitted;
+        std::function<void(size_t)> run;
+    };
+
+    struct sPeerStats {
+        sPeerStats() : queued(0), running(0), associations(0), completed(0), waitMs(0), maxWaitMs(0), runMs(0), maxRunMs(0) {}
+        size_t queued;
+        size_t running;
+        // slots held by the running operations, counted against the limit of the peer
+        size_t associations;
+        size_t completed;
+        double waitMs;
+        double maxWaitMs;
+        double runMs;
+        double maxRunMs;
+    };
+
+    OperationScheduler();
+
+    void workerLoop();
+
+    // returns the first waiting operation whose remote AE has a free slot, must be called with the mutex locked
+    std::list<sOperation>::iterator nextRunnable();
+
+    // number of associations the operation may open if started now, must be called with the mutex locked
+    size_t grantedAssociations(const sOperation& op);
+
+    size_t peerLimit(const std::string& peer) const;
+
+    void startThreads();
+
+    sSchedulerOptions m_options;
+    // waiting operations, ordered by priority and submission
+    std::list<sOperation> m_queue;
+    // remote AEs with waiting or running operations
+    std::map<std::string, sPeerStats> m_peers;
+    sPeerStats m_total;
+    size_t m_rejected;
+    size_t m_threadCount;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
@@ -20,14 +20,136 @@
 #include "dcmtk/dcmnet/diutil.h"
 #include "dcmtk/ofstd/ofconapp.h"
 #include "dcmtk/dcmdata/dcjson.h"
+#include "dcmtk/dcmdata/dcistrmf.h" /* for DcmInputFileStreamFactory */
+#include "dcmtk/dcmdata/dcsequen.h"
+#include "dcmtk/dcmdata/dcitem.h"
 #include "dcmtk/ofstd/ofstream.h"
 
 #ifdef WITH_ZLIB
 #include <zlib.h>
 #endif
 
+namespace
+{
+
+// accepts keywords, "gggg,eeee" and "ggggeeee"
+bool toTagKey(const std::string& name, DcmTagKey& key)
+{
+    if (name.length() == 8 && name.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos) {
+        key = ns::toElement(name, "").xtag;
+        return true;
+    }
+    DcmTag tag;
+    if (DcmTag::findTagFromName(name.c_str(), tag).bad()) {
+        return false;
+    }
+    key = tag;
+    return true;
+}
+
+// same output as DcmElement::writeJsonOpener(), which is not accessible
+void writeJsonOpener(STD_NAMESPACE ostream &out, DcmJsonFormat &format, const DcmTag& tag)
+{
+    DcmVR vr(tag.getVR());
+    out << ++format.indent() << "\""
+        << STD_NAMESPACE hex << STD_NAMESPACE setfill('0')
+        << STD_NAMESPACE setw(4) << STD_NAMESPACE uppercase << tag.getGTag()
+        << STD_NAMESPACE setw(4) << STD_NAMESPACE uppercase << tag.getETag() << "\":"
+        << format.space() << "{" << STD_NAMESPACE dec << STD_NAMESPACE setfill(' ');
+    out << STD_NAMESPACE nouppercase;
+    out << format.newline() << ++format.indent() << "\"vr\":" << format.space() << "\""
+        << vr.getValidVRName() << "\"";
+}
+
+void writeJsonCloser(STD_NAMESPACE ostream &out, DcmJsonFormat &format)
+{
+    out << format.newline() << --format.indent() << "}";
+    --format.indent();
+}
+
+// writes the items like DcmItem::writeJsonExt(), but only the included attributes and, if bulkDataURIs is set,
+// values that were not loaded are referenced by file offset and length
+class JsonWriter
+{
+public:
+    JsonWriter(DcmJsonFormat& format, const std::string& filename, const std::set<DcmTagKey>& includeTags, bool bulkDataURIs)
+        : m_format(format), m_filename(filename), m_includeTags(includeTags), m_bulkDataURIs(bulkDataURIs) {}
+
+    OFCondition writeItem(STD_NAMESPACE ostream &out, DcmItem& item, bool printBraces, bool topLevel)
+    {
+        OFCondition status = EC_Normal;
+        bool first = true;
+        for (unsigned long i = 0; status.good() && i < item.card(); ++i) {
+            DcmElement* elem = item.getElement(i);
+            // group lengths are never printed
+            if (elem->getTag().getElement() == 0) {
+                continue;
+            }
+            if (topLevel && !m_includeTags.empty() && m_includeTags.find(elem->getTag()) == m_includeTags.end()) {
+                continue;
+            }
+            if (first && printBraces) out << "{" << m_format.newline();
+            if (!first) out << "," << m_format.newline();
+            first = false;
+            status = writeElement(out, *elem);
+        }
+        if (first) {
+            if (printBraces) out << "{}";
+        }
+        else if (printBraces) {
+            out << m_format.newline() << m_format.indent() << "}";
+        }
+        return status;
+    }
+
+private:
+    OFCondition writeElement(STD_NAMESPACE ostream &out, DcmElement& elem)
+    {
+        if (elem.ident() == EVR_SQ) {
+            // items may contain bulk data as well
+            DcmSequenceOfItems& sequence = OFstatic_cast(DcmSequenceOfItems&, elem);
+            writeJsonOpener(out, m_format, elem.getTag());
+            OFCondition status = EC_Normal;
+            if (sequence.card() > 0) {
+                m_format.printValuePrefix(out);
+                for (unsigned long i = 0; status.good() && i < sequence.card(); ++i) {
+                    if (i > 0) m_format.printNextArrayElementPrefix(out);
+                    status = writeItem(out, *sequence.getItem(i), true, false);
+                }
+                m_format.printValueSuffix(out);
+            }
+            writeJsonCloser(out, m_format);
+            return status;
+        }
+
+        // values exceeding the read limit are still in the file, do not load them just to encode them
+        const DcmInputStreamFactory* factory = elem.getInputStream();
+        if (m_bulkDataURIs && !elem.valueLoaded() && factory && factory->ident() == DFT_DcmInputFileStreamFactory) {
+            const DcmInputFileStreamFactory* fileFactory = OFstatic_cast(const DcmInputFileStreamFactory*, factory);
+            std::ostringstream uri;
+            uri << m_filename << "?offset=" << fileFactory->getOffset() << "&length=" << elem.getLengthField();
+            writeJsonOpener(out, m_format, elem.getTag());
+            m_format.printBulkDataURIPrefix(out);
+            DcmJsonFormat::printString(out, uri.str().c_str());
+            writeJsonCloser(out, m_format);
+            return EC_Normal;
+        }
+        return elem.writeJson(out, m_format);
+    }
+
+    DcmJsonFormat& m_format;
+    std::string m_filename;
+    const std::set<DcmTagKey>& m_includeTags;
+    bool m_bulkDataURIs;
+};
+
+} // namespace
+
 ParseAsyncWorker::ParseAsyncWorker(std::string data, Function &callback)
-    : BaseAsyncWorker(data, callback) {
+    : BaseAsyncWorker(data, callback)
+    , m_stopTag(DCM_UndefinedTagKey)
+    , m_bulkDataThreshold(0)
+    , m_compact(false) {
     ns::registerCodecs();
 }
 
@@ -42,16 +164,70 @@ void ParseAsyncWorker::Execute(const ExecutionProgress &progress)
         return;
     }
 
-    OFFilename ifname(in.sourcePath.c_str());
-    DcmFileFormat dfile;
-    OFCondition status = dfile.loadFile(ifname, EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect);
+    if (!setParseOptions(in)) {
+        return;
+    }
+
+    std::string output;
+    OFCondition status = parseFile(in.sourcePath.c_str(), output);
     if (status.bad()) {
         SetErrorJson("Invalid source path set, no DICOM files found");
         return;
     }
+    _jsonOutput = output;
+}
+
+bool ParseAsyncWorker::setParseOptions(const ns::sInput& in)
+{
+    m_compact = in.compact;
+    m_bulkDataThreshold = in.bulkDataThreshold > 0 ? OFstatic_cast(Uint32, in.bulkDataThreshold) : 0;
+
+    m_includeTags.clear();
+    for (const std::string& name : in.includeTags) {
+        DcmTagKey key;
+        if (!toTagKey(name, key)) {
+            SetErrorJson("Unknown tag in includeTags: " + name);
+            return false;
+        }
+        m_includeTags.insert(key);
+    }
+
+    m_stopTag = DCM_UndefinedTagKey;
+    if (!in.stopTag.empty()) {
+        if (!toTagKey(in.stopTag, m_stopTag)) {
+            SetErrorJson("Unknown stopTag: " + in.stopTag);
+            return false;
+        }
+    }
+    else if (!m_includeTags.empty()) {
+        // nothing after the last included attribute is needed
+        DcmTagKey last = *m_includeTags.rbegin();
+        m_stopTag = last.getElement() == 0xffff ? DcmTagKey(OFstatic_cast(Uint16, last.getGroup() + 1), 0)
+            : DcmTagKey(last.getGroup(), OFstatic_cast(Uint16, last.getElement() + 1));
+    }
+    return true;
+}
+
+OFCondition ParseAsyncWorker::parseFile(const OFFilename& filename, std::string& output)
+{
+    DcmFileFormat dfile;
+    Uint32 maxReadLength = m_bulkDataThreshold > 0 ? m_bulkDataThreshold : DCM_MaxReadLength;
+    OFCondition status = dfile.loadFileUntilTag(filename, EXS_Unknown, EGL_noChange, maxReadLength, ERM_autoDetect, m_stopTag);
+    if (status.bad()) {
+        return status;
+    }
     DcmDataset *dset = dfile.getDataset();
     std::ostringstream stream;
-    DcmJsonFormatPretty format;
-    dset->writeJson(stream, format);
-    _jsonOutput = stream.str();
+    DcmJsonFormatPretty pretty;
+    DcmJsonFormatCompact compact;
+    DcmJsonFormat& format = m_compact ? OFstatic_cast(DcmJsonFormat&, compact) : OFstatic_cast(DcmJsonFormat&, pretty);
+    if (m_bulkDataThreshold > 0 || !m_includeTags.empty()) {
+        JsonWriter writer(format, filename.getCharPointer(), m_includeTags, m_bulkDataThreshold > 0);
+        status = writer.writeItem(stream, *dset, false, true);
+    }
+    else {
+        status = dset->writeJson(stream, format);
+    }
+    output = stream.str();
+    return status;
 }
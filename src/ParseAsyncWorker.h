@@ -2,6 +2,12 @@
 
 #include "BaseAsyncWorker.h"
 
+#include "dcmtk/config/osconfig.h" /* make sure OS specific configuration is included first */
+#include "dcmtk/dcmdata/dctagkey.h"
+#include "dcmtk/ofstd/offile.h"
+
+#include <set>
+
 using namespace Napi;
 
 class ParseAsyncWorker : public BaseAsyncWorker
@@ -11,4 +17,19 @@ class ParseAsyncWorker : public BaseAsyncWorker
 
         void Execute(const ExecutionProgress& progress);
 
+    protected:
+        // applies the parse options of the input, returns false and sets the error if an option is invalid
+        bool setParseOptions(const ns::sInput& in);
+
+        // reads the file and writes its dataset as DICOM JSON (without enclosing braces)
+        OFCondition parseFile(const OFFilename& filename, std::string& output);
+
+    private:
+        // parsing stops at this tag, DCM_UndefinedTagKey to read the whole dataset
+        DcmTagKey m_stopTag;
+        // if not empty, only these top level attributes are written
+        std::set<DcmTagKey> m_includeTags;
+        // values larger than this are written as BulkDataURI, 0 to write all values inline
+        Uint32 m_bulkDataThreshold;
+        bool m_compact;
 };
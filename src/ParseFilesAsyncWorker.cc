@@ -0,0 +1,186 @@
+#include "ParseFilesAsyncWorker.h"
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "Utils.h"
+
+#include "dcmtk/config/osconfig.h" /* make sure OS specific configuration is included first */
+
+#include "dcmtk/ofstd/ofstd.h"
+#include "dcmtk/ofstd/offilsys.h" /* for OFdirectory_iterator */
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>  /* for lstat() */
+#endif
+
+namespace
+{
+// number of files the directory walk may be ahead of the parsers
+const size_t MAX_QUEUED_FILES = 4096;
+// number of parsed files per pending response if resultBatchSize is not set
+const size_t DEFAULT_BATCH_SIZE = 100;
+
+// true for symbolic links and, on Windows, junctions
+bool isLink(const OFpath& path)
+{
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+#else
+    struct stat info;
+    return lstat(path.c_str(), &info) == 0 && S_ISLNK(info.st_mode);
+#endif
+}
+}
+
+ParseFilesAsyncWorker::ParseFilesAsyncWorker(std::string data, Function &callback)
+    : ParseAsyncWorker(data, callback)
+    , m_filesComplete(false)
+    , m_batchSize(DEFAULT_BATCH_SIZE)
+    , m_numParsed(0)
+    , m_numFailed(0)
+{
+}
+
+void ParseFilesAsyncWorker::Execute(const ExecutionProgress &progress)
+{
+    ns::sInput in = ns::parseInputJson(_input);
+
+    EnableVerboseLogging(in.verbose);
+
+    if (in.sourcePath.empty() && in.sourcePaths.empty()) {
+        SetErrorJson("No source path set");
+        return;
+    }
+
+    if (!setParseOptions(in)) {
+        return;
+    }
+
+    if (in.resultBatchSize > 0) {
+        m_batchSize = OFstatic_cast(size_t, in.resultBatchSize);
+    }
+
+    size_t numThreads = in.threads > 0 ? OFstatic_cast(size_t, in.threads) : std::thread::hardware_concurrency();
+    if (numThreads == 0) {
+        numThreads = 1;
+    }
+
+    // the directory is walked while the first files are parsed already
+    std::thread walker;
+    for (const std::string& path : in.sourcePaths) {
+        m_files.push_back(OFFilename(path.c_str()));
+    }
+    if (in.sourcePath.empty()) {
+        m_filesComplete = true;
+    }
+    else if (OFStandard::dirExists(OFFilename(in.sourcePath.c_str()))) {
+        walker = std::thread(&ParseFilesAsyncWorker::walkDirectory, this, OFFilename(in.sourcePath.c_str()));
+    }
+    else {
+        m_files.push_back(OFFilename(in.sourcePath.c_str()));
+        m_filesComplete = true;
+    }
+
+    std::vector<std::thread> parsers;
+    for (size_t i = 0; i < numThreads; ++i) {
+        parsers.push_back(std::thread(&ParseFilesAsyncWorker::parseLoop, this, std::ref(progress)));
+    }
+    for (std::thread& parser : parsers) {
+        parser.join();
+    }
+    if (walker.joinable()) {
+        walker.join();
+    }
+
+    json summary = json::object();
+    summary["NumberOfFiles"] = m_numParsed.load() + m_numFailed.load();
+    summary["NumberOfFailures"] = m_numFailed.load();
+    _jsonOutput = summary.dump();
+}
+
+void ParseFilesAsyncWorker::walkDirectory(const OFFilename& directory)
+{
+    std::vector<OFpath> directories;
+    directories.push_back(OFpath(directory.getCharPointer()));
+    while (!directories.empty()) {
+        OFpath current = directories.back();
+        directories.pop_back();
+        for (OFdirectory_iterator it(current); it != OFdirectory_iterator(); ++it) {
+            const OFpath& path = it->path();
+            if (OFStandard::dirExists(OFFilename(path.c_str()))) {
+                // a link to a parent directory would make the walk loop forever, linked directories are not followed
+                if (!isLink(path)) {
+                    directories.push_back(path);
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_spaceAvailable.wait(lock, [this] { return m_files.size() < MAX_QUEUED_FILES; });
+            m_files.push_back(OFFilename(path.c_str()));
+            lock.unlock();
+            m_filesAvailable.notify_one();
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_filesComplete = true;
+    }
+    m_filesAvailable.notify_all();
+}
+
+bool ParseFilesAsyncWorker::nextFile(OFFilename& filename)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_filesAvailable.wait(lock, [this] { return m_filesComplete || !m_files.empty(); });
+    if (m_files.empty()) {
+        return false;
+    }
+    filename = m_files.front();
+    m_files.pop_front();
+    lock.unlock();
+    m_spaceAvailable.notify_one();
+    return true;
+}
+
+void ParseFilesAsyncWorker::parseLoop(const ExecutionProgress& progress)
+{
+    std::string batch;
+    size_t batchCount = 0;
+    std::string output;
+    OFFilename filename;
+    while (nextFile(filename)) {
+        OFCondition status = parseFile(filename, output);
+        batch += batchCount == 0 ? "[" : ",";
+        batch += "{\"Filepath\":" + json(filename.getCharPointer()).dump();
+        if (status.good()) {
+            batch += ",\"Dataset\":{" + output + "}}";
+            ++m_numParsed;
+        }
+        else {
+            batch += ",\"Error\":" + json(status.text()).dump() + "}";
+            ++m_numFailed;
+        }
+        if (++batchCount == m_batchSize) {
+            sendBatch(batch, progress);
+            batchCount = 0;
+        }
+    }
+    if (batchCount > 0) {
+        sendBatch(batch, progress);
+    }
+}
+
+void ParseFilesAsyncWorker::sendBatch(std::string& batch, const ExecutionProgress& progress)
+{
+    batch += "]";
+    std::string msg = ns::createJsonResponse(ns::PENDING, "request pending", batch);
+    batch.clear();
+    std::lock_guard<std::mutex> lock(m_progressMutex);
+    progress.Send(msg.c_str(), msg.length());
+}
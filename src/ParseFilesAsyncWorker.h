@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ParseAsyncWorker.h"
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+using namespace Napi;
+
+class ParseFilesAsyncWorker : public ParseAsyncWorker
+{
+    public:
+        ParseFilesAsyncWorker(std::string data, Function &callback);
+
+        void Execute(const ExecutionProgress& progress);
+
+    protected:
+        // queues the files below directory, blocks while the queue is full
+        void walkDirectory(const OFFilename& directory);
+
+        // takes the next file from the queue, returns false if all files are taken
+        bool nextFile(OFFilename& filename);
+
+        // parses files until the queue is exhausted, run by each parser thread
+        void parseLoop(const ExecutionProgress& progress);
+
+        // sends a json array of parsed files in a pending response
+        void sendBatch(std::string& batch, const ExecutionProgress& progress);
+
+    private:
+        std::deque<OFFilename> m_files;
+        bool m_filesComplete;
+        std::mutex m_mutex;
+        std::condition_variable m_filesAvailable;
+        std::condition_variable m_spaceAvailable;
+        // the parser threads share the progress queue
+        std::mutex m_progressMutex;
+        size_t m_batchSize;
+        std::atomic<size_t> m_numParsed;
+        std::atomic<size_t> m_numFailed;
+};
@@ -0,0 +1,99 @@
+#include "PreviewAsyncWorker.h"
+
+#include <algorithm>
+
+#include "Utils.h"
+
+#include "dcmtk/config/osconfig.h" /* make sure OS specific configuration is included first */
+
+#include "dcmtk/dcmdata/dcdeftag.h"
+#include "dcmtk/dcmdata/dcfilefo.h"
+#include "dcmtk/dcmdata/dcpixel.h"
+#include "dcmtk/dcmdata/dcpixseq.h"
+#include "dcmtk/dcmdata/dcxfer.h"
+#include "dcmtk/dcmj2k/djcodecd.h"
+
+PreviewAsyncWorker::PreviewAsyncWorker(std::string data, Function &callback)
+    : BaseAsyncWorker(data, callback)
+{
+    ns::registerCodecs(ns::parseInputJson(data).codecThreads);
+}
+
+void PreviewAsyncWorker::Execute(const ExecutionProgress &progress)
+{
+    ns::sInput in = ns::parseInputJson(_input);
+
+    EnableVerboseLogging(in.verbose);
+
+    if (in.sourcePath.empty()) {
+        SetErrorJson("No source path set");
+        return;
+    }
+
+    if (in.frame < 0 || in.reduceFactor < 0) {
+        SetErrorJson("Invalid frame or reduceFactor");
+        return;
+    }
+
+    // values above the read limit stay in the file until accessed, so only the fragments of the requested frame are read
+    DcmFileFormat dfile;
+    OFCondition cond = dfile.loadFile(in.sourcePath.c_str(), EXS_Unknown, EGL_noChange, 4096, ERM_autoDetect);
+    if (cond.bad()) {
+        SetErrorJson(std::string("Error loading file: ") + cond.text());
+        return;
+    }
+
+    DcmDataset* dataset = dfile.getDataset();
+    E_TransferSyntax xfer = dataset->getOriginalXfer();
+    if (xfer != EXS_JPEG2000LosslessOnly && xfer != EXS_JPEG2000) {
+        SetErrorJson("Preview needs a JPEG 2000 compressed image, transfer syntax is " + std::string(DcmXfer(xfer).getXferName()));
+        return;
+    }
+
+    DcmElement* elem = NULL;
+    DcmPixelSequence* pixSeq = NULL;
+    if (dataset->findAndGetElement(DCM_PixelData, elem).bad() ||
+        OFstatic_cast(DcmPixelData*, elem)->getEncapsulatedRepresentation(xfer, NULL, pixSeq).bad() || pixSeq == NULL) {
+        SetErrorJson("No compressed pixel data found");
+        return;
+    }
+
+    // coordinates beyond the image are rejected by the decoder
+    const int maxCoord = 65535;
+    Uint32 startFragment = 0;
+    Uint8* buffer = NULL;
+    Uint32 bufSize = 0;
+    Uint16 columns = 0;
+    Uint16 rows = 0;
+    cond = DJPEG2KDecoderBase::decodeFrameRegion(pixSeq, NULL, dataset, OFstatic_cast(Uint32, in.frame), startFragment,
+        OFstatic_cast(Uint32, in.reduceFactor),
+        OFstatic_cast(Uint16, std::min(in.region.left, maxCoord)), OFstatic_cast(Uint16, std::min(in.region.top, maxCoord)),
+        OFstatic_cast(Uint16, std::min(in.region.width, maxCoord)), OFstatic_cast(Uint16, std::min(in.region.height, maxCoord)),
+        buffer, bufSize, columns, rows);
+    if (cond.bad()) {
+        SetErrorJson(std::string("Error decoding preview: ") + cond.text());
+        return;
+    }
+
+    Uint16 samplesPerPixel = 0, bitsAllocated = 0, pixelRepresentation = 0;
+    OFString photometricInterpretation;
+    dataset->findAndGetUint16(DCM_SamplesPerPixel, samplesPerPixel);
+    dataset->findAndGetUint16(DCM_BitsAllocated, bitsAllocated);
+    dataset->findAndGetUint16(DCM_PixelRepresentation, pixelRepresentation);
+    dataset->findAndGetOFString(DCM_PhotometricInterpretation, photometricInterpretation);
+    // the decoder applies the inverse multi-component transform, so these are returned as RGB
+    if (photometricInterpretation == "YBR_RCT" || photometricInterpretation == "YBR_ICT") {
+        photometricInterpretation = "RGB";
+    }
+
+    _jsonOutput = {
+        {"columns", columns},
+        {"rows", rows},
+        {"samplesPerPixel", samplesPerPixel},
+        {"bitsAllocated", bitsAllocated},
+        {"pixelRepresentation", pixelRepresentation},
+        {"photometricInterpretation", photometricInterpretation.c_str()}
+    };
+    // the buffer takes ownership of the decoded pixels
+    SendBuffer(ns::createJsonResponse(ns::PENDING, "PREVIEW", _jsonOutput), buffer, bufSize, progress);
+}
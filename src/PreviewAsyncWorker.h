@@ -0,0 +1,15 @@
+#pragma once
+
+#include "BaseAsyncWorker.h"
+
+using namespace Napi;
+
+// decodes a region of a JPEG 2000 frame at reduced resolution, e.g. for previews of large images.
+// Only the code-blocks of the requested region and resolution are decoded.
+class PreviewAsyncWorker : public BaseAsyncWorker
+{
+    public:
+        PreviewAsyncWorker(std::string data, Function &callback);
+
+        void Execute(const ExecutionProgress& progress);
+};
@@ -5,9 +5,11 @@
 #include <sstream>
 #include <memory>
 #include <list>
+#include <atomic>
 
 #include "json.h"
 #include "Utils.h"
+#include "dcmfilewr.h"
 
 using json = nlohmann::json;
 
@@ -46,20 +48,124 @@ using json = nlohmann::json;
 #define INETD_AVAILABLE
 #endif
 
-#include "base64.h"
 #include <iostream>
 
+// ------------------------------------------------------------------------------------------------------------
+
+RetrieveScp::RetrieveScp(const OFString& outputDirectory, const OFString& aet, bool writeFile, int maxAssociations, ServerWorker* worker,
+    Uint32 maxPdu, bool bitPreserving, DcmQueryRetrieveFileWriter* fileWriter)
+: m_outputDirectory(outputDirectory)
+, m_aet(aet)
+, m_writeFile(writeFile)
+, m_maxAssociations(maxAssociations)
+, m_worker(worker)
+, m_maxPdu(maxPdu)
+, m_bitPreserving(bitPreserving)
+, m_fileWriter(fileWriter)
+, m_busyHandlers(0)
+, m_stopHandlers(false)
+{
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+RetrieveScp::~RetrieveScp()
+{
+    stopHandlers();
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
 struct StoreCallbackData
 {
     char* imageFileName;
     OFString storageDir;
     DcmFileFormat* dcmff;
     T_ASC_Association* assoc;
-    Napi::AsyncProgressQueueWorker<char>::ExecutionProgress* progress;
+    ServerWorker* worker;
+    DcmQueryRetrieveFileWriter* fileWriter;
 };
 
 // ------------------------------------------------------------------------------------------------------------
 
+static void sendProgress(StoreCallbackData* cbdata, const std::string& msg)
+{
+    // several associations may be handled concurrently, the worker passes the messages to JS in the order of their calls
+    if (cbdata->worker) {
+        cbdata->worker->Post(msg);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+// reports a file written by the write-behind stage, which may only happen after the C-STORE-RSP has been sent
+class FileStorageNotifier : public DcmQueryRetrieveFileWriteListener
+{
+public:
+    FileStorageNotifier(ServerWorker* worker, const std::string& msg) : m_worker(worker), m_msg(msg) {}
+
+    void fileWritten(OFBool success)
+    {
+        if (success && m_worker) {
+            m_worker->Post(m_msg);
+        }
+    }
+
+private:
+    ServerWorker* m_worker;
+    std::string m_msg;
+};
+
+// ------------------------------------------------------------------------------------------------------------
+
+static void sendBuffer(StoreCallbackData* cbdata, const std::string& msg, unsigned char* buffer, size_t length)
+{
+    cbdata->worker->Post(msg, buffer, length);
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+// encodes the file into a buffer allocated with new[], returns NULL on error
+static unsigned char* serializeFile(DcmFileFormat* dcmff, E_TransferSyntax xfer, Uint32& length)
+{
+    E_EncodingType encodingType = EET_ExplicitLength;
+
+    dcmff->validateMetaInfo(xfer, EWM_fileformat);
+    dcmff->removeInvalidGroups();
+    length = dcmff->calcElementLength(xfer, encodingType);
+
+    unsigned char* buffer;
+    buffer = new unsigned char[length];
+
+    DcmOutputBufferStream buffStream(buffer, length);
+
+    /* check stream status */
+    OFCondition cond = buffStream.status();
+    if (cond.good())
+    {
+        /* write data to buffer*/
+        try
+        {
+          dcmff->transferInit();
+          cond = dcmff->write(buffStream, xfer, encodingType, NULL, EGL_recalcGL, EPD_noChange, 0, 0, EWM_fileformat);
+          dcmff->transferEnd();
+        }
+        catch(const std::exception& e)
+        {
+          std::cerr << "exception: " << e.what()  << std::endl;
+          cond = EC_IllegalCall;
+        }
+    }
+    if (cond.bad()) {
+        std::cerr << cond.text() << std::endl;
+        delete[] buffer;
+        return NULL;
+    }
+    return buffer;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
 void storeSCPCallback(void* callbackData, T_DIMSE_StoreProgress* progress, T_DIMSE_C_StoreRQ* req,
     char* /*imageFileName*/, DcmDataset** imageDataSet, T_DIMSE_C_StoreRSP* rsp, DcmDataset** statusDetail)
 {
@@ -95,7 +201,8 @@ void storeSCPCallback(void* callbackData, T_DIMSE_StoreProgress* progress, T_DIM
 
                 OFString baseStr;
                 OFStandard::combineDirAndFilename(baseStr, cbdata->storageDir, studyInstanceUID, OFTrue);
-                if (!OFStandard::dirExists(baseStr))
+                // the write-behind stage creates the directory itself and caches its existence
+                if (!cbdata->fileWriter && !OFStandard::dirExists(baseStr))
                 {
                     if (OFStandard::createDirectory(baseStr, cbdata->storageDir).bad())
                     {
@@ -107,7 +214,25 @@ void storeSCPCallback(void* callbackData, T_DIMSE_StoreProgress* progress, T_DIM
                 OFString fileName;
                 OFStandard::combineDirAndFilename(fileName, baseStr, cbdata->imageFileName, OFTrue);
 
-                OFCondition cond = cbdata->dcmff->saveFile(fileName.c_str(), xfer, EET_ExplicitLength, EGL_recalcGL, EPD_withoutPadding, 0, 0, EWM_fileformat);
+                json v = json::object();
+                v["StudyInstanceUID"] = studyInstanceUID.c_str();
+                v["SeriesInstanceUID"] = seriesInstanceUID.c_str();
+                v["SOPInstanceUID"] = sopInstanceUID.c_str();
+                v["Filepath"] = fileName.c_str();
+                std::string msg = ns::createJsonResponse(ns::PENDING, "FILE_STORAGE", v);
+
+                OFCondition cond = EC_Normal;
+                if (cbdata->fileWriter) {
+                    // only the encoding happens on the association thread, the writer takes over the buffer
+                    // and reports the file once it is in place
+                    Uint32 length = 0;
+                    unsigned char* buffer = serializeFile(cbdata->dcmff, xfer, length);
+                    cond = buffer ? cbdata->fileWriter->writeFile(fileName, buffer, length, new FileStorageNotifier(cbdata->worker, msg))
+                        : EC_IllegalCall;
+                }
+                else {
+                    cond = cbdata->dcmff->saveFile(fileName.c_str(), xfer, EET_ExplicitLength, EGL_recalcGL, EPD_withoutPadding, 0, 0, EWM_fileformat);
+                }
 
                 if (cond.bad())
                 {
@@ -115,64 +240,28 @@ void storeSCPCallback(void* callbackData, T_DIMSE_StoreProgress* progress, T_DIM
                     std::cerr << "cannot write DICOM file " << fileName.c_str() << std::endl;
                     rsp->DimseStatus = STATUS_STORE_Refused_OutOfResources;
 
-                    // delete incomplete file
-                    OFStandard::deleteFile(fileName);
+                    // delete incomplete file, the write-behind stage never leaves one behind
+                    if (!cbdata->fileWriter) {
+                        OFStandard::deleteFile(fileName);
+                    }
                 }
-                else {
+                else if (!cbdata->fileWriter) {
+                    sendProgress(cbdata, msg);
+                }
+            }
+            // else we store in buffer and hand it over to JS
+            else if (cbdata->worker) {
+                Uint32 length = 0;
+                unsigned char* buffer = serializeFile(cbdata->dcmff, xfer, length);
+                if (buffer) {
                     json v = json::object();
                     v["StudyInstanceUID"] = studyInstanceUID.c_str();
                     v["SeriesInstanceUID"] = seriesInstanceUID.c_str();
                     v["SOPInstanceUID"] = sopInstanceUID.c_str();
-                    v["Filepath"] = fileName.c_str();
-                    std::string msg = ns::createJsonResponse(ns::PENDING, "FILE_STORAGE", v);
-                    cbdata->progress->Send(msg.c_str(), msg.length());
-                }
-            }
-            // else we store in buffer and send as base64
-            else {
-                E_EncodingType encodingType = EET_ExplicitLength;
-
-                /* open file for output */
-                DcmFileFormat* dcmff = cbdata->dcmff;
-                dcmff->validateMetaInfo(xfer, EWM_fileformat);
-                dcmff->removeInvalidGroups();
-                Uint32 length = dcmff->calcElementLength(xfer, encodingType);
-                
-                unsigned char* buffer;
-                buffer = new unsigned char[length];
-
-                DcmOutputBufferStream buffStream(buffer, length);
-
-                /* check stream status */
-                OFCondition cond = buffStream.status();
-                if (cond.good())
-                {
-                    /* write data to buffer*/
-                    try
-                    {
-                      dcmff->transferInit();
-                      cond = dcmff->write(buffStream, xfer, encodingType, NULL, EGL_recalcGL, EPD_noChange, 0, 0, EWM_fileformat);
-                      dcmff->transferEnd();
-                    }
-                    catch(const std::exception& e)
-                    {
-                      std::cerr << "exception: " << e.what()  << std::endl;
-                    }
-
-                    if (cond.good()) {
-                        std::string encoded = base64_encode(reinterpret_cast<const unsigned char*>(buffer), length);
-                        json v = json::object();
-                        v["StudyInstanceUID"] = studyInstanceUID.c_str();
-                        v["SeriesInstanceUID"] = seriesInstanceUID.c_str();
-                        v["SOPInstanceUID"] = sopInstanceUID.c_str();
-                        v["base64"] = encoded.c_str();
-                        std::string msg = ns::createJsonResponse(ns::PENDING, "BUFFER_STORAGE", v);
-                        cbdata->progress->Send(msg.c_str(), msg.length());
-                    }
-                    delete[] buffer;
-                } 
-                if (cond.bad()) {
-                  std::cerr << cond.text() << std::endl;
+                    v["Length"] = length;
+                    std::string msg = ns::createJsonResponse(ns::PENDING, "BUFFER_STORAGE", v);
+                    // the buffer is passed without copy, it is owned by the JS Buffer from now on
+                    sendBuffer(cbdata, msg, buffer, length);
                 }
             }
 
@@ -201,7 +290,88 @@ void storeSCPCallback(void* callbackData, T_DIMSE_StoreProgress* progress, T_DIM
         }
     }
 }
-    
+
+// ------------------------------------------------------------------------------------------------------------
+
+// callback of the bit preserving mode, the dataset has been received into the temporary file imageFileName
+void storeSCPFileCallback(void* callbackData, T_DIMSE_StoreProgress* progress, T_DIMSE_C_StoreRQ* req,
+    char* imageFileName, DcmDataset** /*imageDataSet*/, T_DIMSE_C_StoreRSP* rsp, DcmDataset** statusDetail)
+{
+    if (progress->state != DIMSE_StoreEnd)
+    {
+        return;
+    }
+
+    // do not send status detail information
+    *statusDetail = NULL;
+
+    StoreCallbackData* cbdata = OFstatic_cast(StoreCallbackData*, callbackData);
+    if (rsp->DimseStatus != STATUS_Success || imageFileName == NULL)
+    {
+        return;
+    }
+
+    // only parse the header up to the UIDs we need, large values are skipped and the pixel data is never read.
+    // Parsing stops at the Study ID, the first attribute after the Series Instance UID.
+    DcmFileFormat dcmff;
+    OFCondition cond = dcmff.loadFileUntilTag(imageFileName, EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_fileOnly,
+        DCM_StudyID);
+    if (cond.bad())
+    {
+        std::cerr << "cannot parse received DICOM file " << imageFileName << ": " << cond.text() << std::endl;
+        rsp->DimseStatus = STATUS_STORE_Error_CannotUnderstand;
+        return;
+    }
+    DcmDataset* dataset = dcmff.getDataset();
+
+    // check the image to make sure it is consistent, i.e. that its sopClass and sopInstance correspond
+    // to those mentioned in the request. If not, set the status in the response message variable.
+    DIC_UI sopClass;
+    DIC_UI sopInstance;
+    if (!DU_findSOPClassAndInstanceInDataSet(dataset, sopClass, sizeof(sopClass), sopInstance, sizeof(sopInstance), OFFalse))
+    {
+        rsp->DimseStatus = STATUS_STORE_Error_CannotUnderstand;
+        return;
+    }
+    if (strcmp(sopClass, req->AffectedSOPClassUID) != 0 || strcmp(sopInstance, req->AffectedSOPInstanceUID) != 0)
+    {
+        rsp->DimseStatus = STATUS_STORE_Error_DataSetDoesNotMatchSOPClass;
+        return;
+    }
+
+    OFString studyInstanceUID;
+    OFString seriesInstanceUID;
+    dataset->findAndGetOFString(DCM_StudyInstanceUID, studyInstanceUID);
+    dataset->findAndGetOFString(DCM_SeriesInstanceUID, seriesInstanceUID);
+
+    OFString baseStr;
+    OFStandard::combineDirAndFilename(baseStr, cbdata->storageDir, studyInstanceUID, OFTrue);
+    if (!OFStandard::dirExists(baseStr) && OFStandard::createDirectory(baseStr, cbdata->storageDir).bad())
+    {
+        std::cerr << "failed to create directory " << baseStr.c_str() << std::endl;
+        rsp->DimseStatus = STATUS_STORE_Refused_OutOfResources;
+        return;
+    }
+
+    // move the complete file to its final location, an earlier copy of the same instance is replaced atomically
+    OFString fileName;
+    OFStandard::combineDirAndFilename(fileName, baseStr, cbdata->imageFileName, OFTrue);
+    if (!DcmFileWriteQueue::replaceFile(imageFileName, fileName.c_str()))
+    {
+        std::cerr << "cannot write DICOM file " << fileName.c_str() << std::endl;
+        rsp->DimseStatus = STATUS_STORE_Refused_OutOfResources;
+        return;
+    }
+
+    json v = json::object();
+    v["StudyInstanceUID"] = studyInstanceUID.c_str();
+    v["SeriesInstanceUID"] = seriesInstanceUID.c_str();
+    v["SOPInstanceUID"] = sopInstance;
+    v["Filepath"] = fileName.c_str();
+    std::string msg = ns::createJsonResponse(ns::PENDING, "FILE_STORAGE", v);
+    sendProgress(cbdata, msg);
+}
+
 // ------------------------------------------------------------------------------------------------------------
 
 OFCondition RetrieveScp::echoSCP(T_ASC_Association* assoc, T_DIMSE_Message* msg, T_ASC_PresentationContextID presID)
@@ -216,7 +386,7 @@ OFCondition RetrieveScp::echoSCP(T_ASC_Association* assoc, T_DIMSE_Message* msg,
     
 // ------------------------------------------------------------------------------------------------------------
 
-OFCondition RetrieveScp::storeSCP(T_ASC_Association* assoc, T_DIMSE_Message* msg, T_ASC_PresentationContextID presID, const OFString& outputDirectory, const Napi::AsyncProgressQueueWorker<char>::ExecutionProgress& progress)
+OFCondition RetrieveScp::storeSCP(T_ASC_Association* assoc, T_DIMSE_Message* msg, T_ASC_PresentationContextID presID, const OFString& outputDirectory)
 {
     OFCondition cond = EC_Normal;
     T_DIMSE_C_StoreRQ* req;
@@ -235,7 +405,32 @@ OFCondition RetrieveScp::storeSCP(T_ASC_Association* assoc, T_DIMSE_Message* msg
     callbackData.storageDir = outputDirectory;
     DcmFileFormat dcmff;
     callbackData.dcmff = &dcmff;
-    callbackData.progress = const_cast<Napi::AsyncProgressQueueWorker<char>::ExecutionProgress*>(&progress);
+    callbackData.worker = m_worker;
+    callbackData.fileWriter = m_fileWriter;
+
+    if (m_writeFile && m_bitPreserving)
+    {
+        // receive the PDVs straight into a temporary file next to the study directories,
+        // the callback moves it into place once the UIDs are known
+        static std::atomic<unsigned long> tempFileCounter(0);
+        std::ostringstream tempName;
+        tempName << imageFileName << "." << tempFileCounter++ << ".part";
+        OFString tempFileName;
+        OFStandard::combineDirAndFilename(tempFileName, outputDirectory, tempName.str().c_str(), OFTrue);
+
+        cond = DIMSE_storeProvider(assoc, presID, req, tempFileName.c_str(), OFTrue, NULL, storeSCPFileCallback, &callbackData, DIMSE_BLOCKING, 0);
+        if (cond.bad())
+        {
+            std::cerr << "Store SCP failed: " << cond.text() << std::endl;
+        }
+
+        // the file is left behind if receiving failed or the dataset was rejected
+        if (OFStandard::fileExists(tempFileName))
+        {
+            OFStandard::deleteFile(tempFileName);
+        }
+        return cond;
+    }
 
     // define an address where the information which will be received over the network will be stored
     DcmDataset* dset = dcmff.getDataset();
@@ -256,7 +451,7 @@ OFCondition RetrieveScp::storeSCP(T_ASC_Association* assoc, T_DIMSE_Message* msg
 
 // ------------------------------------------------------------------------------------------------------------
 
-OFCondition RetrieveScp::processCommands(T_ASC_Association* assoc, const OFString& outputDirectory, const Napi::AsyncProgressQueueWorker<char>::ExecutionProgress& progress)
+OFCondition RetrieveScp::processCommands(T_ASC_Association* assoc, const OFString& outputDirectory)
 {
     OFCondition cond = EC_Normal;
     T_DIMSE_Message msg;
@@ -266,8 +461,12 @@ OFCondition RetrieveScp::processCommands(T_ASC_Association* assoc, const OFStrin
     // start a loop to be able to receive more than one DIMSE command
     while (cond == EC_Normal || cond == DIMSE_NODATAAVAILABLE || cond == DIMSE_OUTOFRESOURCES)
     {
-        // receive a DIMSE command over the network
-        cond = DIMSE_receiveCommand(assoc, DIMSE_BLOCKING, 0, &presID, &msg, &statusDetail);
+        // receive a DIMSE command over the network, wake up once per second to notice a stop request
+        cond = DIMSE_receiveCommand(assoc, DIMSE_NONBLOCKING, 1, &presID, &msg, &statusDetail);
+        if (cond == DIMSE_NODATAAVAILABLE && stopRequested())
+        {
+            break;
+        }
 
         // if the command which was received has extra status
         // detail information, dump this information
@@ -290,7 +489,7 @@ OFCondition RetrieveScp::processCommands(T_ASC_Association* assoc, const OFStrin
                 break;
             case DIMSE_C_STORE_RQ:
                 // process C-STORE-Request
-                cond = storeSCP(assoc, &msg, presID, outputDirectory, progress);
+                cond = storeSCP(assoc, &msg, presID, outputDirectory);
                 break;
             default:
                 OFString tempStr;
@@ -306,10 +505,9 @@ OFCondition RetrieveScp::processCommands(T_ASC_Association* assoc, const OFStrin
 
 // ------------------------------------------------------------------------------------------------------------
 
-OFCondition RetrieveScp::acceptAssociation(T_ASC_Network* net, DcmAssociationConfiguration& asccfg, OFBool secureConnection, const OFString& outputDirectory, const OFString& aet, const Napi::AsyncProgressQueueWorker<char>::ExecutionProgress& progress)
+OFCondition RetrieveScp::negotiateAssociation(T_ASC_Network* net, OFBool secureConnection, const OFString& aet, T_ASC_Association*& assoc)
 {
     char buf[BUFSIZ];
-    T_ASC_Association* assoc;
     OFCondition cond;
     OFString temp_str;
 
@@ -322,7 +520,7 @@ OFCondition RetrieveScp::acceptAssociation(T_ASC_Network* net, DcmAssociationCon
                                         NULL };                                                      // +1
     int numTransferSyntaxes = 0;
 
-    cond = ASC_receiveAssociation(net, &assoc, ASC_DEFAULTMAXPDU, NULL, NULL, secureConnection);
+    cond = ASC_receiveAssociation(net, &assoc, m_maxPdu, NULL, NULL, secureConnection);
 
     // if some kind of error occurred, take care of it
     if (cond.bad())
@@ -422,11 +620,29 @@ OFCondition RetrieveScp::acceptAssociation(T_ASC_Network* net, DcmAssociationCon
             goto cleanup;
         }
     }
+    return cond;
+
+cleanup:
+    OFCondition dropCond = ASC_dropSCPAssociation(assoc);
+    if (dropCond.bad())
+    {
+        std::cerr << dropCond.text() << std::endl;
+    }
+    ASC_destroyAssociation(&assoc);
+    assoc = NULL;
+    return cond.good() ? DUL_ASSOCIATIONREJECTED : cond;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+OFCondition RetrieveScp::handleAssociation(T_ASC_Association* assoc, const OFString& outputDirectory)
+{
+    OFCondition cond;
 
     /* now do the real work, i.e. receive DIMSE commands over the network connection */
     /* which was established and handle these commands correspondingly. In case of */
     /* storescp only C-ECHO-RQ and C-STORE-RQ commands can be processed. */
-    cond = processCommands(assoc, outputDirectory, progress);
+    cond = processCommands(assoc, outputDirectory);
 
     if (cond == DUL_PEERREQUESTEDRELEASE)
     {
@@ -436,6 +652,11 @@ OFCondition RetrieveScp::acceptAssociation(T_ASC_Network* net, DcmAssociationCon
     {
         std::cerr << "Peer aborted association" << std::endl;
     }
+    else if (cond == DIMSE_NODATAAVAILABLE)
+    {
+        // idle association, the server is stopping
+        cond = ASC_abortAssociation(assoc);
+    }
     else
     {
         /* some kind of error so abort the association */
@@ -444,7 +665,6 @@ OFCondition RetrieveScp::acceptAssociation(T_ASC_Network* net, DcmAssociationCon
         cond = ASC_abortAssociation(assoc);
     }
 
-cleanup:
     cond = ASC_dropSCPAssociation(assoc);
     if (cond.bad())
     {
@@ -461,7 +681,130 @@ cleanup:
 }
 
 
-OFCondition RetrieveScp::waitForAssociation(T_ASC_Network* theNet, const Napi::AsyncProgressQueueWorker<char>::ExecutionProgress& progress)
+// ------------------------------------------------------------------------------------------------------------
+
+OFCondition RetrieveScp::acceptAssociation(T_ASC_Network* net, DcmAssociationConfiguration& /*asccfg*/, OFBool secureConnection, const OFString& outputDirectory, const OFString& aet)
+{
+    T_ASC_Association* assoc = NULL;
+    negotiateAssociation(net, secureConnection, aet, assoc);
+    if (assoc == NULL)
+    {
+        // negotiation failed, but the association has been cleaned up so we can continue listening
+        return EC_Normal;
+    }
+    return handleAssociation(assoc, outputDirectory);
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+void RetrieveScp::handlerLoop()
+{
+    while (true)
+    {
+        T_ASC_Association* assoc = NULL;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_associationQueued.wait(lock, [this] { return m_stopHandlers || !m_pending.empty(); });
+            if (m_pending.empty())
+            {
+                // stop requested and nothing left to do
+                return;
+            }
+            assoc = m_pending.front();
+            m_pending.pop_front();
+            ++m_busyHandlers;
+        }
+
+        handleAssociation(assoc, m_outputDirectory);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_busyHandlers;
+        }
+        m_handlerAvailable.notify_one();
+    }
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+bool RetrieveScp::stopRequested()
+{
+    if (m_worker != NULL && m_worker->StopRequested())
+    {
+        return true;
+    }
+    // the server loop has ended, e.g. because of a network error
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stopHandlers;
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+void RetrieveScp::startHandlers()
+{
+    m_stopHandlers = false;
+    for (int i = 0; i < m_maxAssociations; ++i)
+    {
+        m_handlers.push_back(std::thread(&RetrieveScp::handlerLoop, this));
+    }
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+void RetrieveScp::stopHandlers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopHandlers = true;
+    }
+    m_associationQueued.notify_all();
+    for (std::thread& handler : m_handlers)
+    {
+        handler.join();
+    }
+    m_handlers.clear();
+}
+
+// ------------------------------------------------------------------------------------------------------------
+
+OFCondition RetrieveScp::waitForAssociation(T_ASC_Network* theNet)
 {
-    return acceptAssociation(theNet, asccfg, false, m_outputDirectory, m_aet, progress);
-}
\ No newline at end of file
+    // return at least once per second, so the caller can stop the server
+    if (!ASC_associationWaiting(theNet, 1))
+    {
+        return EC_Normal;
+    }
+
+    if (m_maxAssociations <= 1)
+    {
+        return acceptAssociation(theNet, asccfg, false, m_outputDirectory, m_aet);
+    }
+
+    if (m_handlers.empty())
+    {
+        startHandlers();
+    }
+
+    // do not accept more associations than we have handlers, further peers have to wait in the TCP backlog.
+    // Return after a second without a free handler, so the caller can stop the server.
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_handlerAvailable.wait_for(lock, std::chrono::seconds(1),
+            [this] { return m_busyHandlers + m_pending.size() < OFstatic_cast(size_t, m_maxAssociations); }))
+        {
+            return EC_Normal;
+        }
+    }
+
+    T_ASC_Association* assoc = NULL;
+    negotiateAssociation(theNet, false, m_aet, assoc);
+    if (assoc != NULL)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending.push_back(assoc);
+        }
+        m_associationQueued.notify_one();
+    }
+    return EC_Normal;
+}
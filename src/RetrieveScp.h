@@ -2,27 +2,68 @@
 
 #include <napi.h>
 
+#include "ServerWorker.h"
+
 #include "dcmtk/config/osconfig.h"    /* make sure OS specific configuration is included first */
 #include "dcmtk/ofstd/oftypes.h"
 #include "dcmtk/dcmnet/assoc.h"
 #include "dcmtk/dcmnet/dimse.h"
 #include "dcmtk/dcmnet/dcasccfg.h"
+#include "dcmtk/dcmqrdb/dcmqropt.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 
 class RetrieveScp 
 {
 public:
-    RetrieveScp(const OFString& outputDirectory, const OFString& aet, bool writeFile) : m_outputDirectory(outputDirectory), m_aet(aet), m_writeFile(writeFile) {}
+    /**
+     * @param maxAssociations number of associations handled concurrently, values > 1
+     *        hand accepted associations over to a fixed-size pool of handler threads
+     * @param worker receives the progress messages, and the serialized objects if writeFile is false
+     * @param maxPdu maximum PDU length accepted from the peers
+     * @param bitPreserving if writeFile is true, received datasets are streamed to disk exactly as received
+     *        instead of being decoded into memory and written again
+     * @param fileWriter if set, writes the received files on its own threads, the directories are created by the writer
+     */
+    RetrieveScp(const OFString& outputDirectory, const OFString& aet, bool writeFile, int maxAssociations = 1, ServerWorker* worker = NULL,
+        Uint32 maxPdu = ASC_DEFAULTMAXPDU, bool bitPreserving = false, DcmQueryRetrieveFileWriter* fileWriter = NULL);
+
+    // waits for the handler threads to finish their current association, idle associations are aborted
+    // within a second once the worker has been asked to stop
+    ~RetrieveScp();
 
-    OFCondition waitForAssociation(T_ASC_Network* theNet, const Napi::AsyncProgressQueueWorker<char>::ExecutionProgress& progress);
+    // waits up to one second for an association and handles it, handling is passed to the pool if maxAssociations > 1
+    OFCondition waitForAssociation(T_ASC_Network* theNet);
 
 protected:
 
-    OFCondition acceptAssociation(T_ASC_Network* net, DcmAssociationConfiguration& asccfg, OFBool secureConnection, const OFString& outputDirectory, const OFString& aet, const Napi::AsyncProgressQueueWorker<char>::ExecutionProgress& progress);
-    
-    OFCondition processCommands(T_ASC_Association* assoc, const OFString& outputDirectory, const Napi::AsyncProgressQueueWorker<char>::ExecutionProgress& progress);
+    OFCondition acceptAssociation(T_ASC_Network* net, DcmAssociationConfiguration& asccfg, OFBool secureConnection, const OFString& outputDirectory, const OFString& aet);
+
+    // receives and negotiates an association, on success assoc is acknowledged and must be passed to handleAssociation()
+    OFCondition negotiateAssociation(T_ASC_Network* net, OFBool secureConnection, const OFString& aet, T_ASC_Association*& assoc);
+
+    // processes all commands of an acknowledged association, then drops and destroys it
+    OFCondition handleAssociation(T_ASC_Association* assoc, const OFString& outputDirectory);
+
+    // main loop of a handler thread in concurrent mode
+    void handlerLoop();
 
-    OFCondition storeSCP(T_ASC_Association* assoc, T_DIMSE_Message* msg, T_ASC_PresentationContextID presID, const OFString& outputDirectory, const Napi::AsyncProgressQueueWorker<char>::ExecutionProgress& progress);
+    void startHandlers();
+
+    void stopHandlers();
+
+    // true if the server worker has been asked to stop or the handlers are being stopped
+    bool stopRequested();
+
+    OFCondition processCommands(T_ASC_Association* assoc, const OFString& outputDirectory);
+
+    OFCondition storeSCP(T_ASC_Association* assoc, T_DIMSE_Message* msg, T_ASC_PresentationContextID presID, const OFString& outputDirectory);
 
     OFCondition echoSCP(T_ASC_Association* assoc, T_DIMSE_Message* msg, T_ASC_PresentationContextID presID);
 
@@ -31,4 +72,18 @@ private:
     OFString m_aet;
     DcmAssociationConfiguration asccfg;
     bool m_writeFile;
+    int m_maxAssociations;
+    ServerWorker* m_worker;
+    Uint32 m_maxPdu;
+    bool m_bitPreserving;
+    DcmQueryRetrieveFileWriter* m_fileWriter;
+
+    // handler thread pool, only used if m_maxAssociations > 1
+    std::vector<std::thread> m_handlers;
+    std::deque<T_ASC_Association*> m_pending;
+    std::mutex m_mutex;
+    std::condition_variable m_associationQueued;
+    std::condition_variable m_handlerAvailable;
+    size_t m_busyHandlers;
+    bool m_stopHandlers;
 };
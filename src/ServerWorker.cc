@@ -0,0 +1,272 @@
+#include "ServerWorker.h"
+
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <list>
+#include <thread>
+
+#include "json.h"
+#include "Utils.h"
+
+using json = nlohmann::json;
+
+#include "dcmtk/config/osconfig.h" /* make sure OS specific configuration is included first */
+#include "dcmtk/oflog/oflog.h"
+#include "dcmtk/ofstd/ofstd.h"
+#include "dcmtk/dcmnet/diutil.h"
+#include "dcmtk/dcmdata/dcdict.h"
+#include "dcmtk/dcmqrdb/dcmqrsrv.h"
+#include "dcmtk/dcmqrdb/dcmqrcbf.h" 
+#include "dcmtk/dcmqrdb/dcmqrcbm.h" 
+#include "dcmtk/dcmqrdb/dcmqrcbg.h"
+#include "dcmtk/dcmqrdb/dcmqrcbs.h"
+#include "dcmtk/dcmqrdb/dcmqropt.h"
+
+#include "dcmsqlhdl.h"
+#include "dcmfilewr.h"
+#include "RetrieveScp.h"
+
+ServerWorker::ServerWorker(std::string data, Function &callback) : CallbackWorker(data, callback, "ServerWorker"), _stop(false)
+{
+    ns::registerCodecs(ns::parseInputJson(data).codecThreads);
+}
+
+ServerWorker::~ServerWorker()
+{
+}
+
+void ServerWorker::Start()
+{
+    std::shared_ptr<ServerWorker> self = shared_from_this();
+    std::thread([self]() {
+        self->Execute();
+        self->Finish(ns::createJsonResponse(ns::SUCCESS, "request succeeded"));
+    }).detach();
+}
+
+void ServerWorker::Stop()
+{
+    _stop = true;
+}
+
+bool ServerWorker::StopRequested() const
+{
+    return _stop;
+}
+
+void ServerWorker::SendInfo(const std::string& msg, ns::eStatus status)
+{
+    Post(ns::createJsonResponse(status, msg));
+}
+
+void ServerWorker::Execute()
+{
+  ns::sInput in = ns::parseInputJson(_input);
+
+  EnableVerboseLogging(in.verbose);
+
+  if (!in.source.valid())
+  {
+    SetErrorJson("Source not set");
+    return;
+  }
+
+  if (in.storagePath.empty())
+  {
+    in.storagePath = "./data";
+    SendInfo("storage path not set, defaulting to " + in.storagePath);
+  }
+
+  int opt_port = in.source.port;
+  // not static, several servers with different storage paths may run in one process
+  OFString opt_outputDirectory =  OFString(in.storagePath.c_str());
+
+  T_ASC_Network *net = NULL;
+  T_ASC_Network *network = NULL;
+  DcmAssociationConfiguration asccfg;
+
+  // frees the networks on every return after they have been created
+  auto dropNetworks = [&net, &network]() {
+    if (network) ASC_dropNetwork(&network);
+    if (net) ASC_dropNetwork(&net);
+    OFStandard::shutdownNetwork();
+  };
+
+  /* make sure data dictionary is loaded */
+  if (!dcmDataDict.isDictionaryLoaded())
+  {
+    SetErrorJson(std::string("No data dictionary loaded"));
+  }
+
+  /* if the output directory does not equal "." (default directory) */
+  if (opt_outputDirectory != ".")
+  {
+    /* if there is a path separator at the end of the path, get rid of it */
+    OFStandard::normalizeDirName(opt_outputDirectory, opt_outputDirectory);
+
+    /* check if the specified directory exists and if it is a directory.
+     * If the output directory is invalid, dump an error message and terminate execution.
+     */
+    if (!OFStandard::dirExists(opt_outputDirectory))
+    {
+      SetErrorJson(std::string("Specified output directory does not exist: ") + std::string(opt_outputDirectory.c_str()));
+      return;
+    }
+  }
+
+  /* check if the output directory is writeable */
+  if (!OFStandard::isWriteable(opt_outputDirectory))
+  {
+    SetErrorJson(std::string("Specified output directory is not writeable: ") + std::string(opt_outputDirectory.c_str()));
+    return;
+  }
+
+  OFStandard::initializeNetwork();
+
+  /* initialize network, i.e. create an instance of T_ASC_Network*. */
+  OFCondition cond = ASC_initializeNetwork(NET_ACCEPTOR, opt_port, 30, &net);
+  if (cond.bad())
+  {
+    SetErrorJson(std::string("Cannot create network: ") + std::string(cond.text()));
+    dropNetworks();
+    return;
+  }
+
+  /* drop root privileges now and revert to the calling user id (if we are running as setuid root) */
+  if (OFStandard::dropPrivileges().bad())
+  {
+    SetErrorJson(std::string("setuid() failed, maximum number of threads for uid already running"));
+    dropNetworks();
+    return;
+  }
+
+  cond = ASC_initializeNetwork(NET_REQUESTOR, 0, 10000, &network);
+
+  if (cond.bad()) {
+      OFString temp_str;
+      DCMNET_ERROR("Failed to create requestor network: " << DimseCondition::dump(temp_str, cond));
+      SetErrorJson(std::string("Cannot create requestor network: ") + std::string(cond.text()));
+      dropNetworks();
+      return;
+  }
+  // received files are written by a write-behind stage, the durability defines when the C-STORE-RSP is sent
+  DcmFileWriteOptions fileWriteOptions;
+  if (in.fileDurability == "full") {
+      fileWriteOptions.durability = FILE_DURABILITY_FULL;
+  }
+  else if (in.fileDurability == "async") {
+      fileWriteOptions.durability = FILE_DURABILITY_ASYNC;
+  }
+  else if (!in.fileDurability.empty() && in.fileDurability != "normal") {
+      DCMNET_WARN("unknown file durability " << in.fileDurability << ", using normal");
+  }
+  if (in.fileWriterThreads > 0) {
+      fileWriteOptions.threads = in.fileWriterThreads;
+  }
+  DcmFileWriteQueue fileWriter(fileWriteOptions);
+
+  if (in.storeOnly) {
+      // associations are handled one after another unless concurrent handling is requested
+      int maxAssociations = in.maxAssociations > 0 ? in.maxAssociations : 1;
+      DCMNET_INFO("max associations: " << maxAssociations);
+      RetrieveScp scp(opt_outputDirectory, in.source.aet.c_str(), in.writeFile, maxAssociations, this, ns::maxReceivePdu(in),
+          in.bitPreserving, &fileWriter);
+      while (cond.good() && !StopRequested()) {
+          cond = scp.waitForAssociation(net);
+      }
+      // release the port before waiting for the running associations
+      ASC_dropNetwork(&net);
+  }
+  else {
+      DcmQueryRetriveConfigExt cfg;
+      for (auto peer: in.peers) {
+          cfg.addPeer(peer.aet.c_str(), peer.ip.c_str(), peer.port);
+      }
+      cfg.setStorageArea(in.storagePath.c_str());
+      cfg.setPermissiveMode(in.permissive);
+
+      DcmSQLiteIngestOptions ingestOptions;
+      if (in.dbDurability == "full") {
+          ingestOptions.durability = SQLITE_DURABILITY_FULL;
+      }
+      else if (in.dbDurability == "async") {
+          ingestOptions.durability = SQLITE_DURABILITY_ASYNC;
+      }
+      else if (!in.dbDurability.empty() && in.dbDurability != "normal") {
+          DCMNET_WARN("unknown db durability " << in.dbDurability << ", using normal");
+      }
+      if (!in.dbIndexes.empty()) {
+          ingestOptions.indexedAttributes.clear();
+          for (auto name : in.dbIndexes) {
+              DcmTag tag;
+              if (DcmTag::findTagFromName(name.c_str(), tag).good()) {
+                  ingestOptions.indexedAttributes.push_back(tag);
+              }
+              else {
+                  DCMNET_WARN("unknown attribute " << name << ", not indexed");
+              }
+          }
+      }
+      cfg.setIngestOptions(ingestOptions);
+
+      // keeps the ingest queue and its writer connection open while the server runs, otherwise the writer
+      // would be set up again (migration, indexes, PRAGMA optimize) for every association
+      DcmSQLiteDatabase db(in.storagePath.c_str(), ingestOptions);
+
+      if (in.rebuildDbCounters) {
+          SendInfo("rebuilding study and series counters");
+          if (!db.rebuildCounters()) {
+              SetErrorJson("Failed to rebuild database counters");
+              dropNetworks();
+              return;
+          }
+      }
+
+      DcmXfer netTransPrefer = in.netTransferPrefer.empty() ? DcmXfer(EXS_Unknown) : DcmXfer(in.netTransferPrefer.c_str());
+      DcmXfer netTransPropose = in.netTransferPropose.empty() ? DcmXfer(EXS_Unknown) : DcmXfer(in.netTransferPropose.c_str());
+      DcmXfer writeTrans = in.writeTransfer.empty() ? DcmXfer(EXS_Unknown) : DcmXfer(in.writeTransfer.c_str());
+
+      DCMNET_INFO("preferred (accepted) network transfer syntax for incoming associations: " << netTransPrefer.getXferName());
+      DCMNET_INFO("proposed network transfer syntax for outgoing associations: " << netTransPropose.getXferName());
+      DCMNET_INFO("write transfer syntax (recompress if different to accepted ts): " << writeTrans.getXferName());
+      DCMNET_INFO("permissive mode: " << in.permissive);
+
+ 
+      DcmQueryRetrieveOptions options;
+      options.net_ = network;
+      options.allowShutdown_ = true;
+      options.disableGetSupport_ = false;
+      options.maxAssociations_ = in.maxAssociations > 0 ? in.maxAssociations : 128;
+      if (in.maxMoveSubAssociations > 0) {
+          options.maxMoveSubAssociations_ = in.maxMoveSubAssociations;
+      }
+      // never fork the node process, associations are handled by a thread pool
+      options.singleProcess_ = OFTrue;
+      // return from waitForAssociation() at least once per second, so a stop request is noticed in time
+      options.association_wait_timeout_ = 1;
+      options.correctUIDPadding_ = true;
+      options.maxPDU_ = ns::maxReceivePdu(in);
+      options.networkTransferSyntax_ = netTransPrefer.getXfer();
+      options.networkTransferSyntaxOut_ = netTransPropose.getXfer();
+      options.writeTransferSyntax_ = writeTrans.getXfer();
+      options.fileWriter_ = &fileWriter;
+
+      DCMNET_INFO("max associations: " << options.maxAssociations_);
+
+      DcmQueryRetrieveSQLiteDatabaseHandleFactory factory(&cfg);
+      DcmAssociationConfiguration associationConfiguration;
+
+      DcmQueryRetrieveSCP scp(cfg, options, factory, associationConfiguration);
+      while (cond.good() && !StopRequested()) {
+          cond = scp.waitForAssociation(net);
+      }
+      // release the port before waiting for the running associations, idle ones are aborted
+      ASC_dropNetwork(&net);
+      scp.stop();
+  }
+    
+  /* drop the networks, i.e. free memory of T_ASC_Network* structures. This call */
+  /* is the counterpart of ASC_initializeNetwork(...) which was called above. */
+  dropNetworks();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <napi.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "Utils.h"
+#include "CallbackWorker.h"
+
+using namespace Napi;
+
+// runs a SCP on a dedicated thread, a long-lived server would otherwise occupy a libuv pool thread for its whole lifetime
+class ServerWorker : public CallbackWorker, public std::enable_shared_from_this<ServerWorker>
+{
+    public:
+        ServerWorker(std::string data, Function &callback);
+
+        ~ServerWorker();
+
+        // starts the server thread, the thread keeps the worker alive until the server has stopped
+        void Start();
+
+        // asks the server to stop listening, returns immediately. Running commands are finished, idle associations
+        // are aborted within a second and the callback receives the final response once the server has stopped.
+        void Stop();
+
+        bool StopRequested() const;
+
+    private:
+        void Execute();
+
+        void SendInfo(const std::string& msg, ns::eStatus status = ns::PENDING);
+
+        std::atomic<bool> _stop;
+};
@@ -4,6 +4,12 @@
 #include <sstream>
 #include <memory>
 #include <list>
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <algorithm>
 
 #include "json.h"
 #include "Utils.h"
@@ -20,6 +26,8 @@ using json = nlohmann::json;
 #include "dcmtk/dcmdata/cmdlnarg.h"  /* for prepareCmdLineArgs */
 #include "dcmtk/dcmdata/dcostrmz.h"  /* for dcmZlibCompressionLevel */
 #include "dcmtk/dcmnet/dstorscu.h"   /* for DcmStorageSCU */
+#include "dcmtk/dcmdata/dcfilefo.h"  /* for DcmFileFormat */
+#include "dcmtk/dcmdata/dcdeftag.h"  /* for DCM_StudyInstanceUID */
 
 #include "dcmtk/dcmjpeg/djdecode.h"  /* for JPEG decoders */
 #include "dcmtk/dcmjpls/djdecode.h"  /* for JPEG-LS decoders */
@@ -32,12 +40,36 @@ using json = nlohmann::json;
 #define PATTERN_MATCHING_AVAILABLE
 #endif
 
+namespace {
+
+// storage SCU which reports each processed SOP instance as json
+class ProgressStorageSCU : public DcmStorageSCU
+{
+public:
+    std::function<void(const json&)> instanceSent;
+
+protected:
+    virtual void notifySOPInstanceSent(const TransferEntry& transferEntry) {
+        DcmStorageSCU::notifySOPInstanceSent(transferEntry);
+        if (!instanceSent) return;
+        json v = json::object();
+        v["SOPClassUID"] = transferEntry.SOPClassUID.c_str();
+        v["SOPInstanceUID"] = transferEntry.SOPInstanceUID.c_str();
+        v["Filepath"] = transferEntry.Filename.getCharPointer() ? transferEntry.Filename.getCharPointer() : "";
+        v["Status"] = transferEntry.ResponseStatusCode;
+        instanceSent(v);
+    }
+};
+
+}
+
 StoreAsyncWorker::StoreAsyncWorker(std::string data, Function &callback) : BaseAsyncWorker(data, callback)
 {
     ns::registerCodecs();
 
     m_acse_timeout = 60;
     m_dimse_timeout = 60;
+    m_maxPdu = ASC_DEFAULTMAXPDU;
     m_sourceDirectory = "";
 }
 
@@ -46,6 +78,7 @@ void StoreAsyncWorker::Execute(const ExecutionProgress &progress)
     ns::sInput in = ns::parseInputJson(_input);
 
     EnableVerboseLogging(in.verbose);
+    m_maxPdu = ns::maxReceivePdu(in);
 
     if (!in.source.valid())
     {
@@ -68,7 +101,64 @@ void StoreAsyncWorker::Execute(const ExecutionProgress &progress)
     // DCMNET_INFO("proposed network transfer syntax for outgoing associations: " << netTransPropose.getXferName());
     // m_networkTransferSyntax = netTransPropose.getXfer();
 
-    bool success = sendStoreRequest(in.target.aet.c_str(), in.target.ip.c_str(), OFstatic_cast(Uint16, in.target.port), in.source.aet.c_str() );
+    /* make sure data dictionary is loaded */
+    if (!dcmDataDict.isDictionaryLoaded())
+    {
+        DCMNET_WARN("no data dictionary loaded, check environment variable: " << DCM_DICT_ENVIRONMENT_VARIABLE);
+    }
+
+    /* create list of input files */
+    DCMNET_INFO("determining input files ...");
+    OFList<OFFilename> inputFiles;
+    OFStandard::searchDirectoryRecursively(m_sourceDirectory, inputFiles,
+        OFFilename() /*Pattern */, OFFilename() /*dirPrefix*/, OFTrue);
+
+    /* check whether there are any input files at all */
+    if (inputFiles.empty())
+    {
+        DCMNET_ERROR("no input files to be sent");
+        SetErrorJson("Failed to send DICOM files to target");
+        return;
+    }
+
+    // the scheduler grants at most the free slots of the target, each association uses one of them
+    size_t maxAssociations = std::min(in.maxAssociations > 1 ? OFstatic_cast(size_t, in.maxAssociations) : 1, _associations);
+
+    /* the header of each file is read once, for the transfer list and for the grouping by study */
+    std::vector<InputFile> files;
+    size_t numInvalidFiles = scanFiles(inputFiles, files);
+    if (numInvalidFiles > 0) {
+        DCMNET_WARN(numInvalidFiles << " invalid files are ignored");
+    }
+    if (files.empty()) {
+        DCMNET_FATAL("no valid input files to be processed");
+        SetErrorJson("Failed to send DICOM files to target");
+        return;
+    }
+
+    bool success = true;
+    if (maxAssociations == 1 || files.size() == 1) {
+        success = sendStoreRequest(files, in.target.aet.c_str(), in.target.ip.c_str(), OFstatic_cast(Uint16, in.target.port),
+            in.source.aet.c_str(), progress);
+    }
+    else {
+        std::vector< std::vector<InputFile> > shards;
+        shardByStudy(files, maxAssociations, shards);
+        DCMNET_INFO("sending " << files.size() << " files over " << shards.size() << " associations");
+
+        std::vector<char> results(shards.size(), 0);
+        std::vector<std::thread> senders;
+        for (size_t i = 0; i < shards.size(); ++i) {
+            senders.push_back(std::thread([&, i] {
+                results[i] = sendStoreRequest(shards[i], in.target.aet.c_str(), in.target.ip.c_str(),
+                    OFstatic_cast(Uint16, in.target.port), in.source.aet.c_str(), progress);
+            }));
+        }
+        for (std::thread& sender : senders) {
+            sender.join();
+        }
+        success = std::find(results.begin(), results.end(), 0) == results.end();
+    }
 
     if (!success) {
         SetErrorJson("Failed to send DICOM files to target");
@@ -98,47 +188,93 @@ bool StoreAsyncWorker::setScanDirectory(const OFFilename &dir)
 
 }
 
-bool StoreAsyncWorker::sendStoreRequest(const OFString& peerTitle, const OFString& peerIP, Uint16 peerPort, const OFString& ourTitle)
+size_t StoreAsyncWorker::scanFiles(const OFList<OFFilename>& inputFiles, std::vector<InputFile>& files)
 {
-    bool m_checkUIDValues = false;
-
-    /* make sure data dictionary is loaded */
-    if (!dcmDataDict.isDictionaryLoaded())
-    {
-        DCMNET_WARN("no data dictionary loaded, check environment variable: " << DCM_DICT_ENVIRONMENT_VARIABLE);
+    std::vector<OFFilename> names;
+    for (OFListConstIterator(OFFilename) it = inputFiles.begin(); it != inputFiles.end(); ++it) {
+        names.push_back(*it);
     }
+    std::vector<InputFile> scanned(names.size());
+    std::vector<char> valid(names.size(), 0);
 
-    OFList<OFFilename> inputFiles;
-
-    OFList<OFFilename> fileNameList;     // list of files to transfer to SCP
-    OFList<OFString> sopClassUIDList;    // the list of SOP classes
-    OFList<OFString> sopInstanceUIDList; // the list of SOP instances
-
-    DcmAssociationConfiguration asccfg;  // handler for association configuration profiles
-
-    OFString temp_str;
-
-    T_ASC_Association* assoc = NULL;
-    T_ASC_Network* net = NULL;
-    T_ASC_Parameters* params = NULL;
-
-    /* create list of input files */
-    DCMNET_INFO("determining input files ...");
-
-    OFStandard::searchDirectoryRecursively(m_sourceDirectory, inputFiles,
-        OFFilename() /*Pattern */, OFFilename() /*dirPrefix*/, OFTrue);
+    /* read the headers, each reader takes every n-th file */
+    DCMNET_INFO("checking input files ...");
+    size_t numReaders = std::max(1u, std::thread::hardware_concurrency());
+    numReaders = std::min(numReaders, names.size());
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < numReaders; ++r) {
+        readers.push_back(std::thread([&names, &scanned, &valid, numReaders, r] {
+            for (size_t i = r; i < names.size(); i += numReaders) {
+                DcmFileFormat fileformat;
+                // the UIDs to send the file are taken from the meta header like DcmStorageSCU does,
+                // reading stops before the Series Instance UID, the pixel data is never read
+                if (fileformat.loadFileUntilTag(names[i], EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_fileOnly,
+                        DCM_SeriesInstanceUID).bad()) {
+                    DCMNET_ERROR("bad DICOM file: " << names[i] << ", ignoring file");
+                    continue;
+                }
+                InputFile& file = scanned[i];
+                file.filename = names[i];
+                DcmMetaInfo* metaInfo = fileformat.getMetaInfo();
+                metaInfo->findAndGetOFStringArray(DCM_MediaStorageSOPClassUID, file.sopClassUID);
+                metaInfo->findAndGetOFStringArray(DCM_MediaStorageSOPInstanceUID, file.sopInstanceUID);
+                metaInfo->findAndGetOFStringArray(DCM_TransferSyntaxUID, file.transferSyntaxUID);
+                fileformat.getDataset()->findAndGetOFString(DCM_StudyInstanceUID, file.studyInstanceUID);
+                valid[i] = 1;
+            }
+        }));
+    }
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
 
+    files.clear();
+    for (size_t i = 0; i < scanned.size(); ++i) {
+        if (valid[i]) {
+            files.push_back(scanned[i]);
+        }
+    }
+    return names.size() - files.size();
+}
 
-    /* check whether there are any input files at all */
-    if (inputFiles.empty())
-    {
-        DCMNET_ERROR("no input files to be sent");
-        return false;
+void StoreAsyncWorker::shardByStudy(const std::vector<InputFile>& files, size_t numShards, std::vector< std::vector<InputFile> >& shards)
+{
+    /* keep the files of a study in their original order, studies in order of appearance */
+    std::map<OFString, size_t> studyIndex;
+    std::vector< std::vector<size_t> > studyFiles;
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::map<OFString, size_t>::iterator it = studyIndex.find(files[i].studyInstanceUID);
+        if (it == studyIndex.end()) {
+            it = studyIndex.insert(std::make_pair(files[i].studyInstanceUID, studyFiles.size())).first;
+            studyFiles.push_back(std::vector<size_t>());
+        }
+        studyFiles[it->second].push_back(i);
     }
 
+    /* assign the largest studies first, always to the shard with the fewest files */
+    std::vector<size_t> order(studyFiles.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&studyFiles](size_t a, size_t b) {
+        return studyFiles[a].size() > studyFiles[b].size();
+    });
+
+    shards.assign(std::min(numShards, studyFiles.size()), std::vector<InputFile>());
+    std::vector<size_t> shardSize(shards.size(), 0);
+    for (size_t study : order) {
+        size_t target = std::min_element(shardSize.begin(), shardSize.end()) - shardSize.begin();
+        for (size_t i : studyFiles[study]) {
+            shards[target].push_back(files[i]);
+        }
+        shardSize[target] += studyFiles[study].size();
+    }
+}
 
+bool StoreAsyncWorker::sendStoreRequest(const std::vector<InputFile>& files, const OFString& peerTitle, const OFString& peerIP, Uint16 peerPort,
+    const OFString& ourTitle, const ExecutionProgress& progress)
+{
+    bool m_checkUIDValues = false;
 
-    DcmStorageSCU storageSCU;
+    ProgressStorageSCU storageSCU;
     OFCondition status;
     unsigned long numInvalidFiles = 0;
 
@@ -146,26 +282,16 @@ bool StoreAsyncWorker::sendStoreRequest(const OFString& peerTitle, const OFStrin
     storageSCU.setReadFromDICOMDIRMode(OFFalse);
     storageSCU.setHaltOnInvalidFileMode(OFFalse);
 
-    DCMNET_INFO("checking input files ...");
-    /* iterate over all input filenames */
-    const char* currentFilename = NULL;
-    OFListIterator(OFFilename) if_iter = inputFiles.begin();
-    OFListIterator(OFFilename) if_last = inputFiles.end();
-    while (if_iter != if_last)
+    /* add the scanned files to the list of instances to be transmitted, they are not read again before they are sent */
+    for (const InputFile& file : files)
     {
-        const OFFilename& currentFilename = (*if_iter);
-        const char* filename = currentFilename.getCharPointer();
-        /* and add them to the list of instances to be transmitted */
-        status = storageSCU.addDicomFile(currentFilename, ERM_fileOnly, m_checkUIDValues);
+        status = storageSCU.addDicomFile(file.filename, file.sopClassUID, file.sopInstanceUID, file.transferSyntaxUID,
+            ERM_fileOnly, m_checkUIDValues);
         if (status.bad())
         {
-            /* check for empty filename */
-            if (strlen(filename) == 0)
-                filename = "<empty string>";
-            DCMNET_ERROR("bad DICOM file: " << filename << ": " << status.text() << ", ignoring file");
+            DCMNET_ERROR("bad DICOM file: " << file.filename << ": " << status.text() << ", ignoring file");
             ++numInvalidFiles;
         }
-        ++if_iter;
     }
 
     /* check whether there are any valid input files */
@@ -184,7 +310,7 @@ bool StoreAsyncWorker::sendStoreRequest(const OFString& peerTitle, const OFStrin
     storageSCU.setPeerPort(OFstatic_cast(Uint16, peerPort));
     storageSCU.setPeerAETitle(peerTitle);
     storageSCU.setAETitle(ourTitle);
-    storageSCU.setMaxReceivePDULength(OFstatic_cast(Uint32, ASC_DEFAULTMAXPDU));
+    storageSCU.setMaxReceivePDULength(m_maxPdu);
     storageSCU.setACSETimeout(OFstatic_cast(Uint32, m_acse_timeout));
     storageSCU.setDIMSETimeout(OFstatic_cast(Uint32, m_dimse_timeout));
     storageSCU.setDIMSEBlockingMode(DIMSE_BLOCKING);
@@ -194,6 +320,12 @@ bool StoreAsyncWorker::sendStoreRequest(const OFString& peerTitle, const OFStrin
     storageSCU.setHaltOnUnsuccessfulStoreMode(OFFalse);
     storageSCU.setAllowIllegalProposalMode(OFTrue);
 
+    storageSCU.instanceSent = [this, &progress](const json& v) {
+        std::string msg = ns::createJsonResponse(ns::PENDING, "INSTANCE_SENT", v);
+        std::lock_guard<std::mutex> lock(m_progressMutex);
+        progress.Send(msg.c_str(), msg.length());
+    };
+
 
     /* add presentation contexts to be negotiated (if there are still any) */
     while ((status = storageSCU.addPresentationContexts()).good())
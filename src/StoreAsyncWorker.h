@@ -11,6 +11,9 @@
 #include "dcmtk/ofstd/ofstdinc.h"
 #include "dcmtk/ofstd/offile.h"
 
+#include <vector>
+#include <mutex>
+
 
 using namespace Napi;
 
@@ -26,13 +29,33 @@ class StoreAsyncWorker : public BaseAsyncWorker
         void Execute(const ExecutionProgress& progress);
 
     protected:
+        // the values of an input file needed to send it, read once before the transfer
+        struct InputFile {
+            OFFilename filename;
+            OFString sopClassUID;
+            OFString sopInstanceUID;
+            OFString transferSyntaxUID;
+            OFString studyInstanceUID;
+        };
+
         bool setScanDirectory(const OFFilename &dir);
 
-        bool sendStoreRequest(const OFString& peerTitle, const OFString& peerIP, Uint16 peerPort,  const OFString& ourTitle);
+        // reads the header of each file in parallel, returns the number of files that are no DICOM files
+        size_t scanFiles(const OFList<OFFilename>& inputFiles, std::vector<InputFile>& files);
+
+        // distributes the files to at most numShards lists, all files of a study end up in the same list
+        void shardByStudy(const std::vector<InputFile>& files, size_t numShards, std::vector< std::vector<InputFile> >& shards);
+
+        // sends the files over one association at a time, may be called concurrently for different files
+        bool sendStoreRequest(const std::vector<InputFile>& files, const OFString& peerTitle, const OFString& peerIP, Uint16 peerPort,
+            const OFString& ourTitle, const ExecutionProgress& progress);
 
 private:
 
         OFFilename            m_sourceDirectory;
         unsigned long         m_acse_timeout;
         unsigned long         m_dimse_timeout;
+        Uint32                m_maxPdu;
+        // the associations share the progress queue
+        std::mutex            m_progressMutex;
 };
@@ -5,6 +5,9 @@
 #include <memory>
 #include <list>
 #include <iomanip>
+#include <thread>
+#include <mutex>
+#include <algorithm>
 
 #include "json.h"
 using json = nlohmann::json;
@@ -25,6 +28,7 @@ using json = nlohmann::json;
 #include "dcmtk/dcmjpls/djencode.h"     /* for dcmjpls encoder */
 #include "dcmtk/dcmj2k/djdecode.h"     /* for dcmj2k decoder*/
 #include "dcmtk/dcmj2k/djencode.h"     /* for dcmj2k encoder */
+#include "dcmtk/dcmdata/dcfrmpar.h"    /* for DcmFrameProcessor */
 
 namespace ns {
 
@@ -71,8 +75,17 @@ namespace ns {
         } 
     };
 
+    // region of an image in full resolution coordinates, a width or height of 0 extends it to the image border
+    struct sRegion {
+        sRegion() : left(0), top(0), width(0), height(0) {}
+        int left;
+        int top;
+        int width;
+        int height;
+    };
+
     struct sInput {
-        sInput() : verbose(false), permissive(false), storeOnly(false), writeFile(true), lossyQuality(80), enableRecompression(false) {}
+        sInput() : verbose(false), permissive(false), storeOnly(false), writeFile(true), rebuildDbCounters(false), lossyQuality(80), maxAssociations(0), maxMoveSubAssociations(0), resultBatchSize(0), bulkDataThreshold(0), threads(0), codecThreads(0), maxPdu(0), fileWriterThreads(0), priority(0), frame(0), reduceFactor(0), compact(false), enableRecompression(false), bitPreserving(false) {}
         sIdent source;
         sIdent target;
         std::string storagePath;
@@ -82,14 +95,35 @@ namespace ns {
         std::string netTransferPropose;
         std::string writeTransfer;
         std::string charset;
+        std::string dbDurability;
+        std::string fileDurability;
+        std::string stopTag;
         std::vector<sTag> tags;
         std::vector<sIdent> peers;
+        std::vector<std::string> dbIndexes;
+        std::vector<std::string> includeTags;
+        std::vector<std::string> sourcePaths;
         int lossyQuality;
+        int maxAssociations;
+        int maxMoveSubAssociations;
+        int resultBatchSize;
+        int bulkDataThreshold;
+        int threads;
+        int codecThreads;
+        int maxPdu;
+        int fileWriterThreads;
+        int priority;
+        int frame;
+        int reduceFactor;
+        sRegion region;
         bool verbose;
         bool permissive;
         bool storeOnly;
         bool writeFile;
+        bool rebuildDbCounters;
+        bool compact;
         bool enableRecompression;
+        bool bitPreserving;
         inline bool valid() {
             return source.valid() && target.valid();
         }
@@ -124,19 +158,38 @@ namespace ns {
     }
 
 
-    static bool codecsRegistered = false;
+    // codecThreads: threads OpenJPEG uses within a single frame, 0 keeps the current value (initially 1).
+    // The codecs are registered once per process, the setting is process-wide and applies to frames started afterwards.
+    inline void registerCodecs(int codecThreads = 0) {
+        static std::mutex codecMutex;
+        static bool codecsRegistered = false;
+        std::lock_guard<std::mutex> lock(codecMutex);
+        if (codecsRegistered) {
+            if (codecThreads > 0) {
+                FMJPEG2KDecoderRegistration::setCodecThreads(OFstatic_cast(Uint32, codecThreads));
+                FMJPEG2KEncoderRegistration::setCodecThreads(OFstatic_cast(Uint32, codecThreads));
+            }
+        }
+        else {
+            // the frames of multi-frame images are compressed and decompressed in parallel. Concurrent operations
+            // share one set of frame workers, so all of them together use at most one thread per core
+            Uint32 frameThreads = std::max(1u, std::thread::hardware_concurrency());
+            DcmFrameProcessor::setMaxWorkerThreads(frameThreads - 1);
+            // OpenJPEG starts its threads for every frame and does not share the frame workers' budget, it only pays off
+            // for large single frames and is therefore left to the caller
+            Uint32 j2kThreads = codecThreads > 0 ? OFstatic_cast(Uint32, codecThreads) : 1;
 
-    static void registerCodecs() {
-        if (!codecsRegistered) {
             DcmRLEDecoderRegistration::registerCodecs();
             DJDecoderRegistration::registerCodecs();
-            DJLSDecoderRegistration::registerCodecs();
-            FMJPEG2KDecoderRegistration::registerCodecs();
+            DJLSDecoderRegistration::registerCodecs(EJLSUC_default, EJLSPC_restore, OFFalse, OFFalse, frameThreads);
+            FMJPEG2KDecoderRegistration::registerCodecs(EJ2KUC_default, EJ2KPC_restore, OFFalse, frameThreads, j2kThreads);
             
-            DJEncoderRegistration::registerCodecs();
-            DJLSEncoderRegistration::registerCodecs();
+            DJEncoderRegistration::registerCodecs(ECC_lossyYCbCr, EUC_default, OFFalse, 0, 0, 0, OFTrue, ESS_422, OFTrue,
+                OFFalse, 0, 0, 0.0, 0.0, 0, 0, 0, 0, OFTrue, OFFalse, OFFalse, OFFalse, OFTrue, frameThreads);
+            DJLSEncoderRegistration::registerCodecs(0, 0, 0, 0, OFTrue, 0, OFTrue, EJLSUC_default, OFFalse,
+                DJLSCodecParameter::interleaveDefault, OFTrue, frameThreads);
             DcmRLEEncoderRegistration::registerCodecs();
-            FMJPEG2KEncoderRegistration::registerCodecs();
+            FMJPEG2KEncoderRegistration::registerCodecs(OFFalse, 64, 64, OFTrue, 0, OFTrue, EJ2KUC_default, OFFalse, frameThreads, j2kThreads);
             codecsRegistered = true;
         }
     }
@@ -161,6 +214,13 @@ namespace ns {
     }
 
 
+    inline void from_json(const json& j, sRegion& p) {
+        p.left = std::max(0, toInt(j, "left"));
+        p.top = std::max(0, toInt(j, "top"));
+        p.width = std::max(0, toInt(j, "width"));
+        p.height = std::max(0, toInt(j, "height"));
+    }
+
     inline sInput parseInputJson(const std::string& _input) {
        	json j = json::parse(_input);
         sInput in;
@@ -177,6 +237,9 @@ namespace ns {
         in.netTransferPropose = toString(j, "netTransferPropose");
         in.writeTransfer = toString(j, "writeTransfer");
         in.charset = toString(j, "charset");
+        in.dbDurability = toString(j, "dbDurability");
+        in.fileDurability = toString(j, "fileDurability");
+        in.stopTag = toString(j, "stopTag");
         try {
             auto tags = j.at("tags");
             for (json::iterator it = tags.begin(); it != tags.end(); ++it) {
@@ -191,6 +254,15 @@ namespace ns {
                 in.peers.push_back(peer);
             }
         } catch(...) {}
+        try {
+            in.dbIndexes = j.at("dbIndexes").get<std::vector<std::string>>();
+        } catch(...) {}
+        try {
+            in.includeTags = j.at("includeTags").get<std::vector<std::string>>();
+        } catch(...) {}
+        try {
+            in.sourcePaths = j.at("sourcePaths").get<std::vector<std::string>>();
+        } catch(...) {}
         try {
             in.permissive = j.at("permissive");
         } catch(...) {}
@@ -208,13 +280,88 @@ namespace ns {
             in.enableRecompression = j.at("enableRecompression");
         }
         catch (...) {}
+        try {
+            in.rebuildDbCounters = j.at("rebuildDbCounters");
+        }
+        catch (...) {}
+        try {
+            in.compact = j.at("compact");
+        }
+        catch (...) {}
+        try {
+            in.bitPreserving = j.at("bitPreserving");
+        }
+        catch (...) {}
         try {
             in.lossyQuality = toInt(j, "lossyQuality");
         }
         catch (...) {}
+        try {
+            in.maxAssociations = toInt(j, "maxAssociations");
+        }
+        catch (...) {}
+        try {
+            in.maxMoveSubAssociations = toInt(j, "maxMoveSubAssociations");
+        }
+        catch (...) {}
+        try {
+            in.resultBatchSize = toInt(j, "resultBatchSize");
+        }
+        catch (...) {}
+        try {
+            in.bulkDataThreshold = toInt(j, "bulkDataThreshold");
+        }
+        catch (...) {}
+        try {
+            in.threads = toInt(j, "threads");
+        }
+        catch (...) {}
+        try {
+            in.codecThreads = toInt(j, "codecThreads");
+        }
+        catch (...) {}
+        try {
+            in.maxPdu = toInt(j, "maxPdu");
+        }
+        catch (...) {}
+        try {
+            in.fileWriterThreads = toInt(j, "fileWriterThreads");
+        }
+        catch (...) {}
+        try {
+            in.priority = j.at("priority").get<int>();
+        }
+        catch (...) {}
+        try {
+            in.frame = j.at("frame").get<int>();
+        }
+        catch (...) {}
+        try {
+            in.reduceFactor = j.at("reduceFactor").get<int>();
+        }
+        catch (...) {}
+        try {
+            in.region = j.at("region").get<sRegion>();
+        }
+        catch (...) {}
         return in;
     }
 
+    // maximum PDU length we receive on an association, maxPdu limited to the range dcmnet supports or ASC_DEFAULTMAXPDU if not set
+    inline Uint32 maxReceivePdu(const sInput& in) {
+        if (in.maxPdu <= 0) {
+            return ASC_DEFAULTMAXPDU;
+        }
+        Uint32 maxPdu = OFstatic_cast(Uint32, in.maxPdu);
+        if (maxPdu < ASC_MINIMUMPDUSIZE) {
+            return ASC_MINIMUMPDUSIZE;
+        }
+        if (maxPdu > ASC_MAXIMUMPDUSIZE) {
+            return ASC_MAXIMUMPDUSIZE;
+        }
+        return maxPdu & ~1u; // must be even
+    }
+
 
     enum eStatus {
         SUCCESS = 0,
@@ -0,0 +1,204 @@
+#include "dcmfilewr.h"
+
+#include "dcmtk/config/osconfig.h"  /* make sure OS specific configuration is included first */
+#include "dcmtk/ofstd/ofstd.h"
+#include "dcmtk/dcmnet/diutil.h"
+
+#include <cstdio>
+#include <future>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>      /* for _commit() */
+#else
+#include <fcntl.h>
+#include <unistd.h>  /* for fsync() */
+#endif
+
+makeOFConditionConst(FILEWRITE_EC_WriteFailed, OFM_dcmqrdb, 100, OF_error, "Could not write file");
+
+// bounds the directory cache of a long running server, the working set are the studies currently received
+static const size_t maxCachedDirectories = 1024;
+
+//--------------------------------------------------------------------------------------------
+
+static bool syncFile(FILE* file) {
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// makes the rename of a file in the directory durable, not needed on Windows
+static void syncDirectory(const std::string& dir) {
+#ifndef _WIN32
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+#else
+    (void)dir;
+#endif
+}
+
+bool DcmFileWriteQueue::replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+//--------------------------------------------------------------------------------------------
+
+struct DcmFileWriteQueue::Item {
+    std::string fileName;
+    std::unique_ptr<Uint8[]> buffer;
+    size_t length;
+    std::unique_ptr<DcmQueryRetrieveFileWriteListener> listener;
+    std::promise<bool> written;
+};
+
+DcmFileWriteQueue::DcmFileWriteQueue(const DcmFileWriteOptions& options)
+    : m_options(options), m_queuedBytes(0), m_stop(false), m_tempCounter(0) {
+    if (m_options.threads == 0) {
+        m_options.threads = 1;
+    }
+    for (size_t i = 0; i < m_options.threads; ++i) {
+        m_threads.push_back(std::thread(&DcmFileWriteQueue::run, this));
+    }
+}
+
+DcmFileWriteQueue::~DcmFileWriteQueue() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_itemQueued.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+OFCondition DcmFileWriteQueue::writeFile(const OFString& fileName, Uint8* buffer, size_t length,
+    DcmQueryRetrieveFileWriteListener* listener) {
+    std::shared_ptr<Item> item = std::make_shared<Item>();
+    item->fileName = fileName.c_str();
+    item->buffer.reset(buffer);
+    item->length = length;
+    item->listener.reset(listener);
+    std::future<bool> written = item->written.get_future();
+    {
+        // bound the memory held by the queue, the association waits for the writers to catch up
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_spaceAvailable.wait(lock, [&] { return m_queuedBytes == 0 || m_queuedBytes + length <= m_options.maxQueuedBytes; });
+        m_items.push_back(item);
+        m_queuedBytes += length;
+    }
+    m_itemQueued.notify_one();
+
+    if (m_options.durability == FILE_DURABILITY_ASYNC) {
+        return EC_Normal;
+    }
+    return written.get() ? EC_Normal : OFCondition(FILEWRITE_EC_WriteFailed);
+}
+
+OFBool DcmFileWriteQueue::isAsynchronous() const {
+    return m_options.durability == FILE_DURABILITY_ASYNC;
+}
+
+void DcmFileWriteQueue::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_itemQueued.wait(lock, [this] { return m_stop || !m_items.empty(); });
+        if (m_items.empty()) {
+            break;
+        }
+        std::shared_ptr<Item> item = m_items.front();
+        m_items.pop_front();
+        lock.unlock();
+
+        bool ok = write(*item);
+        if (!ok) {
+            DCMNET_ERROR("cannot write DICOM file " << item->fileName);
+        }
+        item->buffer.reset();
+        // in asynchronous mode the file is only reported or indexed once it is in place
+        if (item->listener) {
+            item->listener->fileWritten(ok);
+            item->listener.reset();
+        }
+        item->written.set_value(ok);
+
+        lock.lock();
+        m_queuedBytes -= item->length;
+        m_spaceAvailable.notify_all();
+    }
+}
+
+bool DcmFileWriteQueue::write(const Item& item) {
+    OFString dir;
+    OFStandard::getDirNameFromPath(dir, item.fileName.c_str(), OFFalse);
+    if (!dir.empty() && !ensureDirectory(dir.c_str())) {
+        return false;
+    }
+
+    // the temporary file lives in the target directory, so the rename never crosses file systems
+    std::ostringstream tempName;
+    tempName << item.fileName << "." << m_tempCounter++ << ".part";
+
+    FILE* file = fopen(tempName.str().c_str(), "wb");
+    if (file == NULL && !dir.empty()) {
+        // the directory may have been removed since it was cached
+        {
+            std::lock_guard<std::mutex> lock(m_directoryMutex);
+            m_directories.erase(dir.c_str());
+        }
+        if (ensureDirectory(dir.c_str())) {
+            file = fopen(tempName.str().c_str(), "wb");
+        }
+    }
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(item.buffer.get(), 1, item.length, file) == item.length;
+    ok = (fflush(file) == 0) && ok;
+    if (ok && m_options.durability == FILE_DURABILITY_FULL) {
+        ok = syncFile(file);
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (ok) {
+        ok = replaceFile(tempName.str(), item.fileName);
+    }
+    if (!ok) {
+        OFStandard::deleteFile(tempName.str().c_str());
+        return false;
+    }
+    if (m_options.durability == FILE_DURABILITY_FULL && !dir.empty()) {
+        syncDirectory(dir.c_str());
+    }
+    return true;
+}
+
+bool DcmFileWriteQueue::ensureDirectory(const std::string& dir) {
+    {
+        std::lock_guard<std::mutex> lock(m_directoryMutex);
+        if (m_directories.count(dir)) {
+            return true;
+        }
+    }
+    // another writer may create the same directory concurrently, which is fine as long as it exists afterwards
+    if (OFStandard::createDirectory(dir.c_str(), OFFilename()).bad() && !OFStandard::dirExists(dir.c_str())) {
+        DCMNET_ERROR("failed to create directory " << dir);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_directoryMutex);
+    if (m_directories.size() >= maxCachedDirectories) {
+        m_directories.clear();
+    }
+    m_directories.insert(dir);
+    return true;
+}
@@ -0,0 +1,86 @@
+#ifndef DCMFILEWR_H
+#define DCMFILEWR_H
+
+#include "dcmtk/config/osconfig.h"     /* make sure OS specific configuration is included first */
+#include "dcmtk/dcmqrdb/dcmqropt.h"
+
+#include <deque>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+// defines when a C-STORE is reported as stored in relation to the file write
+enum DcmFileWriteDurability {
+    // wait until the file has been written, synced to disk and renamed into place
+    FILE_DURABILITY_FULL,
+    // wait until the file has been written and renamed into place (default)
+    FILE_DURABILITY_NORMAL,
+    // do not wait, respond as soon as the file is queued
+    FILE_DURABILITY_ASYNC
+};
+
+struct DcmFileWriteOptions {
+    DcmFileWriteOptions() : durability(FILE_DURABILITY_NORMAL), threads(2), maxQueuedBytes(256 * 1024 * 1024) {}
+    DcmFileWriteDurability durability;
+    // number of writer threads
+    size_t threads;
+    // callers block while the queued files exceed this size, a single larger file is still accepted
+    size_t maxQueuedBytes;
+};
+
+// write-behind stage for received files: serialized files are written by dedicated threads to a
+// temporary file next to their target and renamed into place, so readers never see a partial file
+class DcmFileWriteQueue : public DcmQueryRetrieveFileWriter {
+public:
+    explicit DcmFileWriteQueue(const DcmFileWriteOptions& options = DcmFileWriteOptions());
+
+    // writes all queued files, then stops the writer threads
+    virtual ~DcmFileWriteQueue();
+
+    // queues the file, returns according to the durability, creates the directory of the file if needed,
+    // the listener is notified on the writer thread
+    virtual OFCondition writeFile(const OFString& fileName, Uint8* buffer, size_t length,
+        DcmQueryRetrieveFileWriteListener* listener = NULL);
+
+    // true for FILE_DURABILITY_ASYNC
+    virtual OFBool isAsynchronous() const;
+
+    // atomically replaces an existing target, rename() on Windows fails if the target exists
+    static bool replaceFile(const std::string& from, const std::string& to);
+
+private:
+    struct Item;
+
+    void run();
+
+    // writes the temporary file and renames it, returns false on error
+    bool write(const Item& item);
+
+    // creates the directory unless it is known to exist
+    bool ensureDirectory(const std::string& dir);
+
+    DcmFileWriteOptions m_options;
+    std::deque< std::shared_ptr<Item> > m_items;
+    size_t m_queuedBytes;
+    std::mutex m_mutex;
+    std::condition_variable m_itemQueued;
+    std::condition_variable m_spaceAvailable;
+    bool m_stop;
+    std::vector<std::thread> m_threads;
+
+    // directories created or found by the writers, avoids a stat() for every file. Each study has its own
+    // directory, so the set is cleared once it reaches maxCachedDirectories.
+    std::set<std::string> m_directories;
+    std::mutex m_directoryMutex;
+
+    // makes the names of concurrently written temporary files unique
+    std::atomic<unsigned long> m_tempCounter;
+};
+
+#endif
@@ -15,6 +15,13 @@
 #include <string>
 #include <random>
 #include <sstream>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <condition_variable>
 
 namespace uuid {
     static std::random_device              rd;
@@ -209,23 +216,427 @@ namespace {
         return result;
     }
 
+    // column names of all defined attributes are looked up once, getTagName() locks the global dictionary
+    std::string columnName(const DcmTagKey& tag) {
+        static const std::map<DcmTagKey, std::string> columns = []() {
+            std::map<DcmTagKey, std::string> result;
+            for (auto attr : definedAttribs()) {
+                result[attr.tag] = getTagName(attr.tag);
+            }
+            return result;
+        }();
+
+        auto it = columns.find(tag);
+        if (it != columns.end()) {
+            return it->second;
+        }
+        return getTagName(tag);
+    }
+
+    // names and dates get an additional column holding the value normalized for matching
+    DcmEVR matchColumnType(const DcmTagKey& tag) {
+        static const std::map<DcmTagKey, DcmEVR> types = []() {
+            std::map<DcmTagKey, DcmEVR> result;
+            for (auto attr : definedAttribs()) {
+                DcmEVR evr = DcmTag(attr.tag).getEVR();
+                if (evr == EVR_PN || evr == EVR_DA) {
+                    result[attr.tag] = evr;
+                }
+            }
+            return result;
+        }();
+
+        auto it = types.find(tag);
+        if (it != types.end()) {
+            return it->second;
+        }
+        return EVR_UNKNOWN;
+    }
+
+    std::string matchColumnName(const DcmTagKey& tag) {
+        return columnName(tag) + "Match";
+    }
+
+    // upper case without trailing empty components, the same as UPPER(rtrim(value, ' ^')) in SQL
+    std::string normalizedName(const std::string& value) {
+        std::string result = value.substr(0, value.find_last_not_of(" ^") + 1);
+        for (auto& c : result) {
+            if (c >= 'a' && c <= 'z') {
+                c = c - 'a' + 'A';
+            }
+        }
+        return result;
+    }
+
+    // YYYYMMDD, old ACR-NEMA dates may contain dots, returns an empty string for invalid dates
+    std::string normalizedDate(const std::string& value) {
+        std::string result;
+        for (auto c : value) {
+            if (c >= '0' && c <= '9') {
+                result.push_back(c);
+            }
+            else if (c != '.' && c != ' ') {
+                return std::string();
+            }
+        }
+        return result.length() == 8 ? result : std::string();
+    }
+
+    // bounds of a DA matching value, a single date or a range with at least one bound, both normalized.
+    // Returns false for other values, e.g. wildcards or invalid dates, which are matched as strings
+    bool normalizedDateRange(const std::string& value, std::string& lower, std::string& upper) {
+        std::size_t pos = value.find("-");
+        if (pos == std::string::npos) {
+            lower = upper = normalizedDate(value);
+            return !lower.empty();
+        }
+        std::string first = value.substr(0, pos);
+        std::string second = value.substr(pos + 1);
+        lower = normalizedDate(first);
+        upper = normalizedDate(second);
+        if ((lower.empty() && first.find_first_not_of(" ") != std::string::npos) ||
+            (upper.empty() && second.find_first_not_of(" ") != std::string::npos)) {
+            return false;
+        }
+        return !lower.empty() || !upper.empty();
+    }
+
+    // a value of only "*" matches any value, including none
+    bool isUniversalMatch(const std::string& value) {
+        return !value.empty() && value.find_first_not_of('*') == std::string::npos;
+    }
+
+    std::string normalizedValue(DcmEVR evr, const std::string& value) {
+        return evr == EVR_DA ? normalizedDate(value) : normalizedName(value);
+    }
+
+    // resets a cached statement when leaving the scope, so that it does not keep its read transaction open
+    class StatementReset {
+    public:
+        explicit StatementReset(sqlite3pp::statement& stmt) : stmt_(stmt) {}
+        ~StatementReset() { stmt_.reset(); }
+    private:
+        sqlite3pp::statement& stmt_;
+    };
+
 }
 
 
+// Collects the inserts of all connections to one database file and commits them in batches
+// from a single writer thread, so that the number of transactions does not grow with the
+// number of received instances.
+class DcmSQLiteIngestQueue {
+public:
+    typedef std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare > KeyValueList;
+
+    DcmSQLiteIngestQueue(const std::string& dbFile, const DcmSQLiteIngestOptions& options)
+        : m_options(options), m_writer(dbFile, options, true), m_stop(false) {
+        if (m_options.batchSize == 0) {
+            m_options.batchSize = 1;
+        }
+        m_thread = std::thread(&DcmSQLiteIngestQueue::run, this);
+    }
+
+    ~DcmSQLiteIngestQueue() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+    }
+
+    // returns the queue of the given database file, the first caller defines the options
+    static std::shared_ptr<DcmSQLiteIngestQueue> acquire(const std::string& dbFile, const DcmSQLiteIngestOptions& options) {
+        static std::mutex registryMutex;
+        static std::map< std::string, std::weak_ptr<DcmSQLiteIngestQueue> > registry;
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        std::shared_ptr<DcmSQLiteIngestQueue> queue = registry[dbFile].lock();
+        if (!queue) {
+            queue = std::make_shared<DcmSQLiteIngestQueue>(dbFile, options);
+            registry[dbFile] = queue;
+        }
+        return queue;
+    }
+
+    // queues the instance, returns once its batch has been committed unless durability is async
+    bool insert(const KeyValueList& keyValueList) {
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->keyValueList = keyValueList;
+        std::future<bool> committed = item->committed.get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_items.push_back(item);
+        }
+        m_cond.notify_one();
+
+        if (m_options.durability == SQLITE_DURABILITY_ASYNC) {
+            return true;
+        }
+        return committed.get();
+    }
+
+private:
+    struct Item {
+        KeyValueList keyValueList;
+        std::promise<bool> committed;
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_cond.wait(lock, [this] { return m_stop || !m_items.empty(); });
+            if (m_items.empty()) {
+                break;
+            }
+
+            // give other associations the chance to join this transaction
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_options.maxDelayMs);
+            while (!m_stop && m_items.size() < m_options.batchSize) {
+                if (m_cond.wait_until(lock, deadline) == std::cv_status::timeout) {
+                    break;
+                }
+            }
+
+            std::vector< std::shared_ptr<Item> > batch;
+            while (!m_items.empty() && batch.size() < m_options.batchSize) {
+                batch.push_back(m_items.front());
+                m_items.pop_front();
+            }
+            lock.unlock();
+
+            std::vector<const KeyValueList*> lists;
+            for (auto item : batch) {
+                lists.push_back(&item->keyValueList);
+            }
+            std::vector<bool> results = m_writer.insertBatch(lists);
+            for (size_t i = 0; i < batch.size(); ++i) {
+                batch[i]->committed.set_value(results[i]);
+            }
+
+            lock.lock();
+        }
+    }
+
+    DcmSQLiteIngestOptions m_options;
+    DcmSQLiteDatabase m_writer;
+    std::deque< std::shared_ptr<Item> > m_items;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_stop;
+    std::thread m_thread;
+};
+
+//--------------------------------------------------------------------------------------------
+
 class DcmSQLiteDatabasePrivate {
 public:
+    DcmSQLiteDatabasePrivate() : db(NULL), initialized(false) {}
+
+    // returns the compiled statement for the given SQL, the SQL text encodes level and column set
+    sqlite3pp::query& cachedQuery(const std::string& sql) {
+        std::unique_ptr<sqlite3pp::query>& stmt = queries[sql];
+        if (!stmt) {
+            stmt.reset(new sqlite3pp::query(*db, sql.c_str()));
+        }
+        stmt->reset();
+        return *stmt;
+    }
+
+    // removes the compiled statement from the cache, so it can stay open while other statements are run
+    std::unique_ptr<sqlite3pp::query> takeQuery(const std::string& sql) {
+        std::unique_ptr<sqlite3pp::query> stmt;
+        auto it = queries.find(sql);
+        if (it != queries.end()) {
+            stmt = std::move(it->second);
+            queries.erase(it);
+        }
+        if (!stmt) {
+            stmt.reset(new sqlite3pp::query(*db, sql.c_str()));
+        }
+        stmt->reset();
+        return stmt;
+    }
+
+    void returnQuery(const std::string& sql, std::unique_ptr<sqlite3pp::query> stmt) {
+        stmt->reset();
+        queries[sql] = std::move(stmt);
+    }
+
+    sqlite3pp::command& cachedCommand(const std::string& sql) {
+        std::unique_ptr<sqlite3pp::command>& stmt = commands[sql];
+        if (!stmt) {
+            stmt.reset(new sqlite3pp::command(*db, sql.c_str()));
+        }
+        stmt->reset();
+        return *stmt;
+    }
+
+    // statements have to be finalized before the connection is closed
+    void clearCache() {
+        queries.clear();
+        commands.clear();
+    }
+
     std::vector<DB_FindAttrExt> definedTags;
     sqlite3pp::database* db;
     bool initialized;
+    // shared by all connections to the same file, not set for the writer connection itself
+    std::shared_ptr<DcmSQLiteIngestQueue> ingest;
+    std::map< std::string, std::unique_ptr<sqlite3pp::query> > queries;
+    std::map< std::string, std::unique_ptr<sqlite3pp::command> > commands;
+};
+
+//--------------------------------------------------------------------------------------------
+
+// a C-FIND identifier translated into a single SELECT joining the required levels
+struct DcmSQLiteFindPlan {
+    DcmSQLiteFindPlan() : charset(false) {}
+    std::string sql;
+    // FROM and WHERE clause of the statement
+    std::string filter;
+    std::vector<std::string> bindingNames;
+    std::vector<std::string> bindingValues;
+    // tag of each selected attribute column
+    std::vector<DcmTagKey> columns;
+    bool charset;
+};
+
+// an open statement over the matches of a C-FIND, owned exclusively until it is finished
+class DcmSQLiteFindCursor {
+public:
+    DcmSQLiteFindPlan plan;
+    std::unique_ptr<sqlite3pp::query> statement;
+    sqlite3pp::query::iterator row;
 };
 
 //--------------------------------------------------------------------------------------------
 
-DcmSQLiteDatabase::DcmSQLiteDatabase(const OFFilename& path) : d(new DcmSQLiteDatabasePrivate)
+DcmSQLiteDatabase::DcmSQLiteDatabase(const OFFilename& path, const DcmSQLiteIngestOptions& ingestOptions) : d(new DcmSQLiteDatabasePrivate)
 {
      std::string storage(path.getCharPointer());
      storage.append("/image.db");
-     d->db = new sqlite3pp::database(storage.c_str());
+     // the writer connection creates the tables and enables WAL mode
+     d->ingest = DcmSQLiteIngestQueue::acquire(storage, ingestOptions);
+     open(storage);
+}
+
+//--------------------------------------------------------------------------------------------
+
+DcmSQLiteDatabase::DcmSQLiteDatabase(const std::string& dbFile, const DcmSQLiteIngestOptions& ingestOptions, bool /* ingestWriter */) : d(new DcmSQLiteDatabasePrivate)
+{
+     open(dbFile);
+     // WAL allows readers to proceed while the writer commits
+     d->db->execute("PRAGMA journal_mode=WAL");
+     if (ingestOptions.durability == SQLITE_DURABILITY_FULL) {
+         d->db->execute("PRAGMA synchronous=FULL");
+     }
+     else {
+         d->db->execute("PRAGMA synchronous=NORMAL");
+     }
+     if (d->initialized) {
+         migrate();
+         createIndexes(ingestOptions.indexedAttributes);
+     }
+}
+
+//--------------------------------------------------------------------------------------------
+
+void DcmSQLiteDatabase::migrate()
+{
+     int version = 0;
+     {
+         sqlite3pp::query query(*d->db, "PRAGMA user_version");
+         for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
+             version = (*i).get<int>(0);
+         }
+     }
+
+     // version 1: counters and modality sets are maintained on insert
+     if (version < 1) {
+         DCMNET_INFO("computing study and series counters of existing database");
+         if (!rebuildCounters()) {
+             return;
+         }
+         d->db->execute("PRAGMA user_version = 1");
+     }
+
+     // version 2: normalized match columns for names and dates
+     if (version < 2) {
+         DCMNET_INFO("adding normalized name and date columns to existing database");
+         if (!addMatchColumns()) {
+             return;
+         }
+         d->db->execute("PRAGMA user_version = 2");
+     }
+}
+
+//--------------------------------------------------------------------------------------------
+
+bool DcmSQLiteDatabase::addMatchColumns()
+{
+     try {
+         sqlite3pp::transaction xct(*d->db, false, true);
+         for (int level = PATIENT_LEVEL; level <= IMAGE_LEVEL; ++level) {
+             std::string table = levelName(static_cast<DB_LEVEL>(level));
+
+             std::set<std::string> existing;
+             std::string prepare = "PRAGMA table_info(" + table + ")";
+             sqlite3pp::query query(*d->db, prepare.c_str());
+             for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
+                 existing.insert((*i).get<const char*>(1));
+             }
+
+             for (auto attr : d->definedTags) {
+                 DcmEVR evr = matchColumnType(attr.tag);
+                 if (attr.level != level || evr == EVR_UNKNOWN) {
+                     continue;
+                 }
+
+                 std::string column = columnName(attr.tag);
+                 std::string match = matchColumnName(attr.tag);
+                 std::vector<std::string> statements;
+                 if (existing.find(match) == existing.end()) {
+                     statements.push_back("ALTER TABLE " + table + " ADD COLUMN " + match + (evr == EVR_DA ? " INTEGER" : " TEXT"));
+                 }
+                 if (evr == EVR_DA) {
+                     std::string digits = "trim(replace(" + column + ", '.', ''))";
+                     statements.push_back("UPDATE " + table + " SET " + match + " = CASE WHEN " + digits
+                         + " GLOB '[0-9][0-9][0-9][0-9][0-9][0-9][0-9][0-9]' THEN CAST(" + digits + " AS INTEGER) END");
+                 }
+                 else {
+                     statements.push_back("UPDATE " + table + " SET " + match + " = NULLIF(UPPER(rtrim(" + column + ", ' ^')), '')");
+                 }
+
+                 for (auto statement : statements) {
+                     if (d->db->execute(statement.c_str()) != SQLITE_OK) {
+                         DCMNET_ERROR("Failed to add match column " << match << ": " << d->db->error_msg());
+                         return false;
+                     }
+                 }
+             }
+         }
+         if (xct.commit() != SQLITE_OK) {
+             DCMNET_ERROR("Failed to commit match columns: " << d->db->error_msg());
+             d->db->execute("ROLLBACK");
+             return false;
+         }
+     }
+     catch (const std::exception& e) {
+         DCMNET_ERROR("Failed to add match columns: " << e.what());
+         return false;
+     }
+     return true;
+}
+
+//--------------------------------------------------------------------------------------------
+
+void DcmSQLiteDatabase::open(const std::string& dbFile)
+{
+     d->db = new sqlite3pp::database(dbFile.c_str());
+     // readers may still collide with a running checkpoint
+     d->db->set_busy_timeout(10000);
      d->definedTags = definedAttribs();
      d->initialized = createTables();
 }
@@ -234,6 +645,8 @@ DcmSQLiteDatabase::DcmSQLiteDatabase(const OFFilename& path) : d(new DcmSQLiteDa
 
 DcmSQLiteDatabase::~DcmSQLiteDatabase()
 {
+    d->clearCache();
+    delete d->db;
     delete d;
     d = NULL;
 }
@@ -256,255 +669,253 @@ std::list< std::list<DcmSmallDcmElm> > DcmSQLiteDatabase::find(std::list<DcmSmal
         return resultContainer;
     }
 
-    sQRes queryRoot;
-    queryRoot.id = 0;
+    DcmSQLiteFindCursor* cursor = startFind(findRequestList, queryLevel);
+    if (cursor == NULL) {
+        return resultContainer;
+    }
 
-    std::list< sQRes > patRes = query(findRequestList, queryLevel, PATIENT_LEVEL, queryRoot, resultContainer);
-    for(auto queryPat: patRes) {
-        std::list< sQRes > stdRes = query(findRequestList, queryLevel, STUDY_LEVEL, queryPat, resultContainer);
-        for(auto queryStd: stdRes) {
-            std::list< sQRes > serRes = query(findRequestList, queryLevel, SERIE_LEVEL, queryStd, resultContainer);
-            for(auto querySer: serRes) {
-                std::list< sQRes > imgRes = query(findRequestList, queryLevel, IMAGE_LEVEL, querySer, resultContainer);
-                for(auto queryImg: imgRes) {
-                    query(findRequestList, PATIENT_LEVEL, IMAGE_LEVEL, queryImg, resultContainer);
-                }
-            }
-        }
+    std::list<DcmSmallDcmElm> result;
+    while (nextFindResult(cursor, result)) {
+        resultContainer.push_back(result);
     }
+    finishFind(cursor);
     return resultContainer;
 }
 
 //--------------------------------------------------------------------------------------------
 
-std::list< sQRes > DcmSQLiteDatabase::query(const std::list<DcmSmallDcmElm> & findRequestList, 
-    DB_LEVEL queryLevel, DB_LEVEL currentLevel, const sQRes & preResults, std::list< std::list<DcmSmallDcmElm> > & finalResuls) const
+void DcmSQLiteDatabase::planFind(const std::list<DcmSmallDcmElm>& findRequestList, DB_LEVEL queryLevel,
+    DcmSQLiteFindPlan& plan) const
 {
-    std::list< sQRes > responseContainer;
-
-    if (queryLevel < currentLevel) {
-        finalResuls.push_back(preResults.resultList);
-        return responseContainer;
-    }
-
-    std::vector <DcmTagKey> trackList;
     std::vector < std::string > selectColumns;
     std::vector < std::string > whereColumns;
-    std::vector < std::string > whereBindings;
-    std::vector < std::string > whereBindingNames;
 
-    DcmSmallDcmElm modInStudyElm;
-    DcmSmallDcmElm numStudiesElm;
-    DcmSmallDcmElm numSeriesElm;
-    DcmSmallDcmElm charsetElm;
+    // the topmost level that is constrained or returned, all levels down to the query level are joined
+    DB_LEVEL topLevel = queryLevel;
 
     for(auto e: findRequestList) {
 
-        if (tagLevel(e.XTag()) != currentLevel) {
+        DB_LEVEL level = tagLevel(e.XTag());
+        if (level > queryLevel) {
             continue;
         }
 
         if (e.XTag() == DCM_SpecificCharacterSet) {
-            charsetElm = e;
+            plan.charset = true;
             continue;
         }
 
-        if (e.XTag() == DCM_ModalitiesInStudy) {
-            modInStudyElm = e;
-            continue;
+        if (level < topLevel) {
+            topLevel = level;
         }
 
-        if (e.XTag() == DCM_NumberOfStudyRelatedSeries) {
-            numStudiesElm = e;
-            continue;
-        }
+        std::string bindName = columnName( e.XTag() );
+        std::string whereStr = levelName(level) + "." + bindName;
+        std::string lowerDate, upperDate;
 
-        if (e.XTag() == DCM_NumberOfSeriesRelatedInstances) {
-            numSeriesElm = e;
-            continue;
+        if (isUniversalMatch(e.valueField())) {
+            // universal matching, also entities with an empty or missing value match (PS3.4 C.2.2.2.3)
         }
+        else if (e.XTag() == DCM_ModalitiesInStudy && !e.valueField().empty()) {
+            // the study matches if any of the requested modalities is contained in its modality set
+            std::vector<std::string> modalities;
+            split('\\', modalities, e.valueField());
+            std::vector<std::string> matches;
+            for (size_t i = 0; i < modalities.size(); ++i) {
+                std::string name = ":" + bindName + std::to_string(i);
+                matches.push_back("instr('\\' || " + whereStr + " || '\\', '\\' || " + name + " || '\\') > 0");
+                plan.bindingValues.push_back(modalities[i]);
+                plan.bindingNames.push_back(name);
+            }
+            whereColumns.push_back("( " + join(matches, " OR ") + " )");
+        }
+        else if (matchColumnType(e.XTag()) == EVR_DA && normalizedDateRange(e.valueField(), lowerDate, upperDate)) {
+            // dates are compared as integers on the normalized column, so that ranges can use an index.
+            // Wildcards and invalid dates fall through to the string matching below
+            std::string matchStr = levelName(level) + "." + matchColumnName(e.XTag());
+            if (lowerDate == upperDate) {
+                whereColumns.push_back(matchStr + " = :" + bindName);
+                plan.bindingValues.push_back(lowerDate);
+                plan.bindingNames.push_back(std::string(":") + bindName);
+            }
+            else {
+                if (!lowerDate.empty()) {
+                    whereColumns.push_back(matchStr + " >= :" + bindName + "1");
+                    plan.bindingValues.push_back(lowerDate);
+                    plan.bindingNames.push_back(std::string(":") + bindName + "1");
+                }
+                if (!upperDate.empty()) {
+                    whereColumns.push_back(matchStr + " <= :" + bindName + "2");
+                    plan.bindingValues.push_back(upperDate);
+                    plan.bindingNames.push_back(std::string(":") + bindName + "2");
+                }
+            }
+        }
+        else if (matchColumnType(e.XTag()) == EVR_PN && !e.valueField().empty()) {
+            // names are matched case-insensitive on the normalized column, GLOB keeps prefix searches on an index
+            std::string matchStr = levelName(level) + "." + matchColumnName(e.XTag());
+            std::string valueStr;
+            for (auto c : normalizedName(e.valueField())) {
+                if (c == '[') {
+                    valueStr += "[[]";
+                }
+                else {
+                    valueStr.push_back(c);
+                }
+            }
+            whereColumns.push_back(matchStr + " GLOB :" + bindName);
+            plan.bindingValues.push_back(valueStr);
+            plan.bindingNames.push_back(std::string(":") + bindName);
+        }
+        else if ( !e.valueField().empty() ) {
 
-        if ( !e.valueField().empty() ) {
-
-            std::string whereStr = getTagName( e.XTag() );
             std::string valueStr = e.valueField();
 
             if (contains(valueStr, "*") || contains(valueStr, "?") || contains(valueStr, "^") || contains(valueStr, " ")) {
-                std::string whereColumnStr = whereStr + " LIKE UPPER( :" +  whereStr + " )";
-                std::string testStr = valueStr;
-                whereColumns.push_back(whereColumnStr);
+                whereColumns.push_back(whereStr + " LIKE UPPER( :" + bindName + " )");
                 replace(valueStr, std::string("*"), std::string("%"));
                 replace(valueStr, std::string("?"), std::string("_"));
-                whereBindings.push_back(valueStr);
-                whereBindingNames.push_back(std::string(":") + whereStr);
+                plan.bindingValues.push_back(valueStr);
+                plan.bindingNames.push_back(std::string(":") + bindName);
             }
             else if ( isDateOrTimeField(e.XTag()) && contains(valueStr, "-")) {
-                whereColumns.push_back(whereStr + std::string(" BETWEEN :" ) + whereStr + "1 AND :" + whereStr + "2");
-                whereBindings.push_back(firstp(valueStr));
-                whereBindings.push_back(secondp(valueStr));
-                whereBindingNames.push_back(std::string(":") + whereStr + "1");
-                whereBindingNames.push_back(std::string(":") + whereStr + "2");
+                whereColumns.push_back(whereStr + std::string(" BETWEEN :" ) + bindName + "1 AND :" + bindName + "2");
+                plan.bindingValues.push_back(firstp(valueStr));
+                plan.bindingValues.push_back(secondp(valueStr));
+                plan.bindingNames.push_back(std::string(":") + bindName + "1");
+                plan.bindingNames.push_back(std::string(":") + bindName + "2");
             }
             else {
-                whereColumns.push_back(whereStr + std::string(" = :") + whereStr);
-                whereBindings.push_back(valueStr);
-                whereBindingNames.push_back(std::string(":") + whereStr);
+                whereColumns.push_back(whereStr + std::string(" = :") + bindName);
+                plan.bindingValues.push_back(valueStr);
+                plan.bindingNames.push_back(std::string(":") + bindName);
             }
         }
 
-        selectColumns.push_back(getTagName( e.XTag() ));
-        trackList.push_back( e.XTag() );
+        selectColumns.push_back(whereStr);
+        plan.columns.push_back( e.XTag() );
     }
 
-    selectColumns.push_back("id");
-    whereColumns.push_back("referenceId = :referenceId");
-    whereBindings.push_back(std::to_string(preResults.id));
-    trackList.push_back(DcmTagKey());
- 
-    std::string prepare = std::string("SELECT ") + join(selectColumns, " , ") + std::string(" FROM ") + levelName(currentLevel) 
-        + std::string(" WHERE ") + join(whereColumns, " AND ");
-
-    sqlite3pp::query query(*d->db, prepare.c_str());
-    for (int i = 0; i < whereBindings.size(); ++i) {
-        const std::string bindValue = whereBindings.at(i);
-        if (i == whereBindings.size() -1) {
-            query.bind(":referenceId", std::stoi(bindValue));
-        }
-        else {
-            const std::string bindName = whereBindingNames.at(i);
-            query.bind(bindName.c_str(), bindValue, sqlite3pp::copy);
-        }
+    // each level references the primary key of its parent level
+    std::string from = levelName(topLevel);
+    for (int level = topLevel + 1; level <= queryLevel; ++level) {
+        std::string child = levelName(static_cast<DB_LEVEL>(level));
+        std::string parent = levelName(static_cast<DB_LEVEL>(level - 1));
+        from += " JOIN " + child + " ON " + child + ".referenceId = " + parent + ".id";
     }
 
-    for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
+    // keeps the statement valid if no attribute column is requested
+    selectColumns.push_back(levelName(queryLevel) + ".id");
 
-        std::list<DcmSmallDcmElm> responseList;
-        if (trackList.size() == selectColumns.size() ) {
-            for (int j = 0; j < selectColumns.size(); j++) {
-                if (j == selectColumns.size() - 1) {
-                    OFlonglong value = (*i).get<OFlonglong>(j);
-                    DcmSmallDcmElm newElem(trackList[j], std::to_string(value));
-                    responseList.push_back(newElem);
-                }
-                else {
-                    const char* value = (*i).get<char const*>(j);
-                    DcmSmallDcmElm newElem(trackList[j], value ? value : "");
-                    responseList.push_back(newElem);
-                }
-            }
-        }
-        else {
-            DCMNET_ERROR("track list doesn't match selection");
-        }
-
-        sQRes res;
-        res.id = std::stoi(responseList.back().valueField());
-        responseList.pop_back();
-
-        for (auto elm : preResults.resultList) {
-            responseList.push_back(elm);
-        }
+    plan.filter = std::string(" FROM ") + from;
+    if (!whereColumns.empty()) {
+        plan.filter += std::string(" WHERE ") + join(whereColumns, " AND ");
+    }
+    plan.sql = std::string("SELECT ") + join(selectColumns, " , ") + plan.filter;
+}
 
-        bool discardResult = false;
+//--------------------------------------------------------------------------------------------
 
-        int numberOfSeries = 0;
+DcmSQLiteFindCursor* DcmSQLiteDatabase::startFind(const std::list<DcmSmallDcmElm>& findRequestList, DB_LEVEL queryLevel) const
+{
+    if (!d->initialized) {
+        DCMNET_WARN("database not initialized");
+        return NULL;
+    }
 
-        if (charsetElm.XTag() == DCM_SpecificCharacterSet) {
-            DcmSmallDcmElm specificCharset(charsetElm.XTag(), "ISO_IR 192");
-            responseList.push_back(specificCharset);
-        }
+    std::unique_ptr<DcmSQLiteFindCursor> cursor(new DcmSQLiteFindCursor);
+    planFind(findRequestList, queryLevel, cursor->plan);
 
-        if (modInStudyElm.XTag() == DCM_ModalitiesInStudy) {
-            std::vector<std::string> modalities = modalitiesInStudy(res.id, numberOfSeries);
-            if (!modInStudyElm.valueField().empty()) {
-                if (!contains( modalities, modInStudyElm.valueField())) {
-                    discardResult = true;
-                }
-            }
-            DcmSmallDcmElm modalitiesInStudy(modInStudyElm.XTag(), join(modalities, "\\"));
-            responseList.push_back(modalitiesInStudy);
-        }
-
-        if (numStudiesElm.XTag() == DCM_NumberOfStudyRelatedSeries) {
-            if (numberOfSeries == 0)
-                modalitiesInStudy(res.id, numberOfSeries);
-            std::string numSeriesString;
-            numSeriesString = std::to_string(numberOfSeries);
-            if (!numStudiesElm.valueField().empty()) {
-                if (numSeriesString != numStudiesElm.valueField()) {
-                    discardResult = true;
-                }
-            }
-            DcmSmallDcmElm numberOfStudyRelatedSeries(numStudiesElm);
-            numberOfStudyRelatedSeries.setValue(numSeriesString);
-            responseList.push_back(numberOfStudyRelatedSeries);
-        }
-
-        if (numSeriesElm.XTag() == DCM_NumberOfSeriesRelatedInstances) {
-            std::string numberOfInstancesInSeries;
-            int nb = numSeriesInstances(res.id);
-            numberOfInstancesInSeries = std::to_string(nb);
-            if (!numSeriesElm.valueField().empty()) {
-                if (numberOfInstancesInSeries != numSeriesElm.valueField()) {
-                    discardResult = true;
-                }
-            }
-            DcmSmallDcmElm numberOfSeriesRelatedInstances(numSeriesElm);
-            numberOfSeriesRelatedInstances.setValue(numberOfInstancesInSeries);
-            responseList.push_back(numberOfSeriesRelatedInstances);
+    try {
+        cursor->statement = d->takeQuery(cursor->plan.sql);
+        for (size_t i = 0; i < cursor->plan.bindingNames.size(); ++i) {
+            cursor->statement->bind(cursor->plan.bindingNames[i].c_str(), cursor->plan.bindingValues[i], sqlite3pp::copy);
         }
-
-        if (!discardResult) {
-            res.resultList = responseList;
-            responseContainer.push_back(res);
+        cursor->row = cursor->statement->begin();
+    }
+    catch (const std::exception& e) {
+        DCMNET_ERROR("Failed to query database: " << e.what());
+        if (cursor->statement) {
+            d->returnQuery(cursor->plan.sql, std::move(cursor->statement));
         }
-
+        return NULL;
     }
-    return responseContainer;
+    return cursor.release();
 }
 
 //--------------------------------------------------------------------------------------------
 
-std::vector<std::string> DcmSQLiteDatabase::modalitiesInStudy(long long studyReferenceId, int& seriesSearched) const
+long long DcmSQLiteDatabase::countMatches(const std::list<DcmSmallDcmElm>& findRequestList, DB_LEVEL queryLevel) const
 {
-    seriesSearched = 0;
-    std::vector<std::string> resultString;
-    std::set<std::string> resultSet;
-   
-    std::string prepare = "SELECT " + getTagName(DCM_Modality) + " FROM " 
-        + levelName(SERIE_LEVEL) + " WHERE referenceId = :refId";
+    if (!d->initialized) {
+        DCMNET_WARN("database not initialized");
+        return -1;
+    }
 
-    sqlite3pp::query query(*d->db, prepare.c_str());
-    query.bind(":refId", studyReferenceId);
+    DcmSQLiteFindPlan plan;
+    planFind(findRequestList, queryLevel, plan);
 
-    for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
-        for (int j = 0; j < query.column_count(); ++j) {
-            seriesSearched++;
-            resultSet.insert((*i).get<char const*>(j));
+    long long result = -1;
+    try {
+        sqlite3pp::query& query = d->cachedQuery("SELECT COUNT(*)" + plan.filter);
+        StatementReset queryReset(query);
+        for (size_t i = 0; i < plan.bindingNames.size(); ++i) {
+            query.bind(plan.bindingNames[i].c_str(), plan.bindingValues[i], sqlite3pp::nocopy);
         }
+        for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
+            result = (*i).get<long long>(0);
+        }
+    }
+    catch (const std::exception& e) {
+        DCMNET_ERROR("Failed to count matches: " << e.what());
     }
+    return result;
+}
 
-    for(auto modality: resultSet) {
-        resultString.push_back(modality);
+//--------------------------------------------------------------------------------------------
+
+void DcmSQLiteDatabase::finishFind(DcmSQLiteFindCursor* cursor) const
+{
+    if (cursor == NULL) {
+        return;
     }
-    return resultString;
+    if (cursor->statement) {
+        d->returnQuery(cursor->plan.sql, std::move(cursor->statement));
+    }
+    delete cursor;
 }
 
 //--------------------------------------------------------------------------------------------
 
-int DcmSQLiteDatabase::numSeriesInstances(long long seriesReferenceId) const
+bool DcmSQLiteDatabase::nextFindResult(DcmSQLiteFindCursor* cursor, std::list<DcmSmallDcmElm>& result) const
 {
-    int result = 0;
-    std::string prepare = "SELECT " + getTagName(DCM_SOPInstanceUID) + " FROM "
-        + levelName(IMAGE_LEVEL) + " WHERE referenceId = :refId";
+    const DcmSQLiteFindPlan& plan = cursor->plan;
 
-    sqlite3pp::query query(*d->db, prepare.c_str());
-    query.bind(":refId", seriesReferenceId);
+    if (cursor->row == cursor->statement->end()) {
+        return false;
+    }
 
-    for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
-        result++;
+    sqlite3pp::query::rows row = *cursor->row;
+    result.clear();
+
+    for (size_t j = 0; j < plan.columns.size(); j++) {
+        const char* value = row.get<char const*>(static_cast<int>(j));
+        result.push_back(DcmSmallDcmElm(plan.columns[j], value ? value : ""));
     }
-    return result;
+
+    if (plan.charset) {
+        result.push_back(DcmSmallDcmElm(DCM_SpecificCharacterSet, "ISO_IR 192"));
+    }
+
+    try {
+        ++cursor->row;
+    }
+    catch (const std::exception& e) {
+        // the current result is still valid, the error ends the iteration
+        DCMNET_ERROR("Failed to read from database: " << e.what());
+        cursor->row = cursor->statement->end();
+    }
+    return true;
 }
 
 //--------------------------------------------------------------------------------------------
@@ -525,6 +936,16 @@ bool DcmSQLiteDatabase::isTimeField(const DcmTagKey& key) const
 
 //------------------------------------------------------------------------------------------------------
 
+bool DcmSQLiteDatabase::isCounterField(const DcmTagKey& key) const
+{
+    return key == DCM_NumberOfPatientRelatedStudies || key == DCM_NumberOfPatientRelatedSeries
+        || key == DCM_NumberOfPatientRelatedInstances || key == DCM_NumberOfStudyRelatedSeries
+        || key == DCM_NumberOfStudyRelatedInstances || key == DCM_ModalitiesInStudy
+        || key == DCM_NumberOfSeriesRelatedInstances;
+}
+
+//------------------------------------------------------------------------------------------------------
+
 bool DcmSQLiteDatabase::isDateOrTimeField(const DcmTagKey& key) const
 {
     DcmTag t(key);
@@ -541,7 +962,7 @@ std::string DcmSQLiteDatabase::firstp( const std::string& value ) const
         DCMNET_WARN("no range sign found");
         return value;
     }
-    return value.substr(0, pos-1);
+    return value.substr(0, pos);
 }
 
 //--------------------------------------------------------------------------------------------
@@ -586,13 +1007,48 @@ OFCondition DcmSQLiteDatabase::insertMetaData(DcmDataset* dataset, const OFStrin
 
     OFCondition status = EC_Normal;
 
-    dataset->convertToUTF8();
-    DcmXfer original_xfer(dataset->getOriginalXfer());
+    std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare > insertMap;
+    collectMetaData(dataset, filename, insertMap);
+
+    bool inserted = d->ingest ? d->ingest->insert(insertMap) : insertDb(insertMap);
+    if (!inserted) {
+        DCMNET_ERROR("Failed inserting metadata into db");
+        status = EC_IllegalParameter;
+    }
+    return status;
+}
+
+//--------------------------------------------------------------------------------------------
+
+std::function<bool()> DcmSQLiteDatabase::prepareInsert(DcmDataset* dataset, const OFString& filename)
+{
+    // only the shared ingest queue outlives this connection
+    if (!d->initialized || !d->ingest) {
+        return std::function<bool()>();
+    }
 
     std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare > insertMap;
+    collectMetaData(dataset, filename, insertMap);
+
+    std::shared_ptr<DcmSQLiteIngestQueue> ingest = d->ingest;
+    return [ingest, insertMap]() { return ingest->insert(insertMap); };
+}
+
+//--------------------------------------------------------------------------------------------
+
+void DcmSQLiteDatabase::collectMetaData(DcmDataset* dataset, const OFString& filename,
+    std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare >& insertMap) const
+{
+    dataset->convertToUTF8();
+    DcmXfer original_xfer(dataset->getOriginalXfer());
 
     for (int i = 0; i < d->definedTags.size(); ++i) {
 
+        // maintained by the database, values of the instance would be meaningless
+        if (isCounterField(d->definedTags[i].tag)) {
+            continue;
+        }
+
         OFCondition ec = EC_Normal;
         const char* strPtr = NULL;
         Uint16 intPtr = 0;
@@ -612,12 +1068,6 @@ OFCondition DcmSQLiteDatabase::insertMetaData(DcmDataset* dataset, const OFStrin
 
     // add filename to private field
     insertMap[DB_FindAttrExt(DCM_PrivateFileName, IMAGE_LEVEL, OPTIONAL_KEY)] = filename.c_str();
-
-    if (!insertDb(insertMap)) {
-        DCMNET_ERROR("Failed inserting metadata into db");
-        status = EC_IllegalParameter;
-    }
-    return status;
 }
 
 //--------------------------------------------------------------------------------------------
@@ -625,20 +1075,196 @@ OFCondition DcmSQLiteDatabase::insertMetaData(DcmDataset* dataset, const OFStrin
 bool DcmSQLiteDatabase::insertDb(const std::map< DB_FindAttrExt, std::string, 
     DB_FindAttrExtCompare >& keyValueList)
 {
+    // a negative key means the insert failed, the caller rolls back the transaction
     Db_Id patIdent = insertpat(keyValueList);
+    if (patIdent.primaryKey < 0) {
+        return false;
+    }
     Db_Id stdIdent = insertstd(keyValueList, patIdent);
+    if (stdIdent.primaryKey < 0) {
+        return false;
+    }
     Db_Id serIdent = insertser(keyValueList, stdIdent);
+    if (serIdent.primaryKey < 0) {
+        return false;
+    }
     Db_Id imgIdent = insertimg(keyValueList, serIdent);
+    if (imgIdent.primaryKey < 0) {
+        return false;
+    }
 
     if (!imgIdent.isNew) {
         DCMNET_WARN("instance already registered, ignoring");
+        return true;
+    }
+
+    return updateCounters(keyValueList, patIdent, stdIdent, serIdent);
+}
+
+//--------------------------------------------------------------------------------------------
+
+bool DcmSQLiteDatabase::updateCounters(const std::map< DB_FindAttrExt, std::string,
+    DB_FindAttrExtCompare >& keyValueList, const Db_Id& patIdent, const Db_Id& stdIdent, const Db_Id& serIdent)
+{
+    const int newStudy = stdIdent.isNew ? 1 : 0;
+    const int newSeries = serIdent.isNew ? 1 : 0;
+
+    std::string instances = columnName(DCM_NumberOfSeriesRelatedInstances);
+    std::string prepare = "UPDATE series SET " + instances + " = COALESCE(" + instances + ", 0) + 1 WHERE id = :id";
+    sqlite3pp::command& seriesCmd = d->cachedCommand(prepare);
+    StatementReset seriesReset(seriesCmd);
+    seriesCmd.bind(":id", serIdent.primaryKey);
+    if (seriesCmd.execute() != SQLITE_OK) {
+        DCMNET_ERROR("Failed to update series counters: " << d->db->error_msg());
+        return false;
+    }
+
+    // the modality set is a multi-valued string, a modality is only appended if not yet contained
+    std::string modalities = columnName(DCM_ModalitiesInStudy);
+    std::string series = columnName(DCM_NumberOfStudyRelatedSeries);
+    instances = columnName(DCM_NumberOfStudyRelatedInstances);
+    prepare = "UPDATE study SET "
+        + instances + " = COALESCE(" + instances + ", 0) + 1, "
+        + series + " = COALESCE(" + series + ", 0) + :newSeries, "
+        + modalities + " = CASE WHEN :modality = '' THEN " + modalities
+        + " WHEN " + modalities + " IS NULL OR " + modalities + " = '' THEN :modality"
+        + " WHEN instr('\\' || " + modalities + " || '\\', '\\' || :modality || '\\') > 0 THEN " + modalities
+        + " ELSE " + modalities + " || '\\' || :modality END"
+        + " WHERE id = :id";
+    std::string modality = hashv(keyValueList, DCM_Modality);
+    sqlite3pp::command& studyCmd = d->cachedCommand(prepare);
+    StatementReset studyReset(studyCmd);
+    studyCmd.bind(":newSeries", newSeries);
+    studyCmd.bind(":modality", modality, sqlite3pp::nocopy);
+    studyCmd.bind(":id", stdIdent.primaryKey);
+    if (studyCmd.execute() != SQLITE_OK) {
+        DCMNET_ERROR("Failed to update study counters: " << d->db->error_msg());
+        return false;
+    }
+
+    std::string studies = columnName(DCM_NumberOfPatientRelatedStudies);
+    series = columnName(DCM_NumberOfPatientRelatedSeries);
+    instances = columnName(DCM_NumberOfPatientRelatedInstances);
+    prepare = "UPDATE patient SET "
+        + instances + " = COALESCE(" + instances + ", 0) + 1, "
+        + series + " = COALESCE(" + series + ", 0) + :newSeries, "
+        + studies + " = COALESCE(" + studies + ", 0) + :newStudy"
+        + " WHERE id = :id";
+    sqlite3pp::command& patientCmd = d->cachedCommand(prepare);
+    StatementReset patientReset(patientCmd);
+    patientCmd.bind(":newSeries", newSeries);
+    patientCmd.bind(":newStudy", newStudy);
+    patientCmd.bind(":id", patIdent.primaryKey);
+    if (patientCmd.execute() != SQLITE_OK) {
+        DCMNET_ERROR("Failed to update patient counters: " << d->db->error_msg());
+        return false;
+    }
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------
+
+bool DcmSQLiteDatabase::rebuildCounters()
+{
+    if (!d->initialized) {
+        DCMNET_WARN("database not initialized");
+        return false;
     }
 
+    std::string seriesInstances = columnName(DCM_NumberOfSeriesRelatedInstances);
+    std::string studySeries = columnName(DCM_NumberOfStudyRelatedSeries);
+    std::string studyInstances = columnName(DCM_NumberOfStudyRelatedInstances);
+    std::string modalities = columnName(DCM_ModalitiesInStudy);
+    std::string modality = columnName(DCM_Modality);
+
+    std::vector<std::string> statements;
+    statements.push_back("UPDATE series SET " + seriesInstances
+        + " = (SELECT COUNT(*) FROM image WHERE image.referenceId = series.id)");
+    // modalities never contain a comma, so the default separator of group_concat can be replaced
+    statements.push_back("UPDATE study SET "
+        + studySeries + " = (SELECT COUNT(*) FROM series WHERE series.referenceId = study.id), "
+        + studyInstances + " = (SELECT COUNT(*) FROM image JOIN series ON image.referenceId = series.id WHERE series.referenceId = study.id), "
+        + modalities + " = (SELECT replace(group_concat(DISTINCT " + modality + "), ',', '\\') FROM series WHERE series.referenceId = study.id AND "
+        + modality + " <> '')");
+    statements.push_back("UPDATE patient SET "
+        + columnName(DCM_NumberOfPatientRelatedStudies) + " = (SELECT COUNT(*) FROM study WHERE study.referenceId = patient.id), "
+        + columnName(DCM_NumberOfPatientRelatedSeries) + " = (SELECT COUNT(*) FROM series JOIN study ON series.referenceId = study.id WHERE study.referenceId = patient.id), "
+        + columnName(DCM_NumberOfPatientRelatedInstances) + " = (SELECT COUNT(*) FROM image JOIN series ON image.referenceId = series.id"
+        + " JOIN study ON series.referenceId = study.id WHERE study.referenceId = patient.id)");
+
+    try {
+        sqlite3pp::transaction xct(*d->db, false, true);
+        for (auto statement : statements) {
+            if (d->db->execute(statement.c_str()) != SQLITE_OK) {
+                DCMNET_ERROR("Failed to rebuild counters: " << d->db->error_msg());
+                return false;
+            }
+        }
+        if (xct.commit() != SQLITE_OK) {
+            DCMNET_ERROR("Failed to commit rebuilt counters: " << d->db->error_msg());
+            d->db->execute("ROLLBACK");
+            return false;
+        }
+    }
+    catch (const std::exception& e) {
+        DCMNET_ERROR("Failed to rebuild counters: " << e.what());
+        return false;
+    }
     return true;
 }
 
 //--------------------------------------------------------------------------------------------
 
+std::vector<bool> DcmSQLiteDatabase::insertBatch(const std::vector< const std::map< DB_FindAttrExt, std::string,
+    DB_FindAttrExtCompare >* >& batch)
+{
+    std::vector<bool> results(batch.size(), false);
+
+    if (!d->initialized) {
+        DCMNET_WARN("database not initialized");
+        return results;
+    }
+
+    try {
+        sqlite3pp::transaction xct(*d->db, false, true);
+        bool inserted = true;
+        for (auto keyValueList : batch) {
+            if (!insertDb(*keyValueList)) {
+                inserted = false;
+                break;
+            }
+        }
+        if (inserted && xct.commit() == SQLITE_OK) {
+            results.assign(batch.size(), true);
+            return results;
+        }
+        if (inserted) {
+            DCMNET_ERROR("Failed to commit batch: " << d->db->error_msg());
+        }
+        d->db->execute("ROLLBACK");
+    }
+    catch (const std::exception& e) {
+        DCMNET_ERROR("Failed to insert batch: " << e.what());
+    }
+
+    // retry one by one, so a single broken instance does not fail the whole batch
+    for (size_t i = 0; i < batch.size(); ++i) {
+        try {
+            sqlite3pp::transaction xct(*d->db, false, true);
+            results[i] = insertDb(*batch[i]) && xct.commit() == SQLITE_OK;
+            if (!results[i]) {
+                d->db->execute("ROLLBACK");
+            }
+        }
+        catch (const std::exception& e) {
+            DCMNET_ERROR("Failed to insert instance: " << e.what());
+        }
+    }
+    return results;
+}
+
+//--------------------------------------------------------------------------------------------
+
 Db_Id DcmSQLiteDatabase::insertpat(const std::map< DB_FindAttrExt, std::string, 
     DB_FindAttrExtCompare >& keyValueList)
 {
@@ -652,8 +1278,9 @@ Db_Id DcmSQLiteDatabase::insertpat(const std::map< DB_FindAttrExt, std::string,
 
     // if patient id is empty, try to find the patient first
     if (patientId.empty()) {
-        std::string prepare("SELECT " + getTagName(DCM_PatientID) + " FROM patient WHERE " + getTagName(DCM_PatientName) + "= :patName");
-        sqlite3pp::query query(*d->db, prepare.c_str());
+        std::string prepare("SELECT " + columnName(DCM_PatientID) + " FROM patient WHERE " + columnName(DCM_PatientName) + "= :patName");
+        sqlite3pp::query& query = d->cachedQuery(prepare);
+        StatementReset queryReset(query);
         query.bind(":patName", patientName.c_str(), sqlite3pp::nocopy);
         
         for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
@@ -669,8 +1296,9 @@ Db_Id DcmSQLiteDatabase::insertpat(const std::map< DB_FindAttrExt, std::string,
         patientId = uuid::generate_uuid_v4();
     }
 
-    std::string prepare("SELECT id FROM patient WHERE " + getTagName(DCM_PatientID) + "= :patId AND " + getTagName(DCM_PatientName) + "= :patName");
-    sqlite3pp::query query(*d->db, prepare.c_str());
+    std::string prepare("SELECT id FROM patient WHERE " + columnName(DCM_PatientID) + "= :patId AND " + columnName(DCM_PatientName) + "= :patName");
+    sqlite3pp::query& query = d->cachedQuery(prepare);
+    StatementReset queryReset(query);
 
     query.bind(":patId", patientId.c_str(), sqlite3pp::nocopy);
     query.bind(":patName", patientName.c_str(), sqlite3pp::nocopy);
@@ -728,9 +1356,10 @@ Db_Id DcmSQLiteDatabase::insert(const std::map< DB_FindAttrExt, std::string,
 
     std::string uid = hashv(keyValueList, primary);
 
-    std::string prepare("SELECT id FROM " + table + " WHERE " + getTagName(primary) + "= :uid");
+    std::string prepare("SELECT id FROM " + table + " WHERE " + columnName(primary) + "= :uid");
 
-    sqlite3pp::query query(*d->db, prepare.c_str());
+    sqlite3pp::query& query = d->cachedQuery(prepare);
+    StatementReset queryReset(query);
     query.bind(":uid", uid, sqlite3pp::nocopy);
 
     for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
@@ -756,10 +1385,17 @@ OFlonglong DcmSQLiteDatabase::insertatt(const std::map< DB_FindAttrExt,
     std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare>::const_iterator iter;
     for (iter = keyValueList.begin(); iter != keyValueList.end(); iter++) {
         if (iter->first.level == level) {
-            std::string attr = getTagName(iter->first.tag);
+            std::string attr = columnName(iter->first.tag);
             if (!attr.empty()) {
                 attributs.push_back(attr);
                 values.push_back(iter->second);
+
+                DcmEVR evr = matchColumnType(iter->first.tag);
+                std::string match = evr != EVR_UNKNOWN ? normalizedValue(evr, iter->second) : std::string();
+                if (!match.empty()) {
+                    attributs.push_back(matchColumnName(iter->first.tag));
+                    values.push_back(match);
+                }
             }
             else {
                 DCMNET_WARN("Tag not found:" << iter->first.tag.toString());
@@ -774,14 +1410,18 @@ OFlonglong DcmSQLiteDatabase::insertatt(const std::map< DB_FindAttrExt,
     std::string prepare = "INSERT INTO " + levelName(level) + " ( " + join(attributs, " , ")
         + ", referenceId ) VALUES ( :" + join(attributs, ", :") + ", :referenceId ) ";
 
-    sqlite3pp::command cmd(*d->db, prepare.c_str());
+    sqlite3pp::command& cmd = d->cachedCommand(prepare);
+    StatementReset cmdReset(cmd);
 
     for (int u = 0; u < attributs.size(); u++) {
         cmd.bind(std::string(std::string(":") + attributs.at(u)).c_str(), values.at(u), sqlite3pp::nocopy);
     }
     cmd.bind(":referenceId", id);
 
-    cmd.execute();
+    if (cmd.execute() != SQLITE_OK) {
+        DCMNET_ERROR("Failed to insert into " << levelName(level) << ": " << d->db->error_msg());
+        return -1;
+    }
     return d->db->last_insert_rowid();
 }
 
@@ -825,7 +1465,12 @@ bool DcmSQLiteDatabase::createTable(DB_LEVEL level)
             std::string terminator = ",";
             if (attr.keyAttr == UNIQUE_KEY)
                 terminator = "UNIQUE,";
-            list.push_back(getTagName(attr.tag) + " TEXT " + terminator);
+            list.push_back(columnName(attr.tag) + " TEXT " + terminator);
+
+            DcmEVR evr = matchColumnType(attr.tag);
+            if (evr != EVR_UNKNOWN) {
+                list.push_back(matchColumnName(attr.tag) + (evr == EVR_DA ? " INTEGER," : " TEXT,"));
+            }
         }
     }
     list.push_back(" PlaceHoler TEXT");
@@ -856,4 +1501,51 @@ bool DcmSQLiteDatabase::createIndex(DB_LEVEL level)
 
 //--------------------------------------------------------------------------------------------
 
+void DcmSQLiteDatabase::createIndexes(const std::vector<DcmTagKey>& attributes)
+{
+    std::set<std::string> indexes;
+    for (auto tag : attributes) {
+        std::vector<DB_FindAttrExt>::const_iterator attr = d->definedTags.begin();
+        while (attr != d->definedTags.end() && attr->tag != tag) {
+            ++attr;
+        }
+        if (attr == d->definedTags.end()) {
+            DCMNET_WARN("Cannot index " << tag << ", attribute is not stored in the database");
+            continue;
+        }
+
+        // searches on names and dates use the normalized column
+        std::string table = levelName(attr->level);
+        std::string column = matchColumnType(tag) != EVR_UNKNOWN ? matchColumnName(tag) : columnName(tag);
+        std::string name = "idx_" + table + "_" + column;
+        indexes.insert(name);
+
+        std::string prepare = "CREATE INDEX IF NOT EXISTS " + name + " ON " + table + "(" + column + ")";
+        if (d->db->execute(prepare.c_str()) != SQLITE_OK) {
+            DCMNET_ERROR("Failed to create index " << name << ": " << d->db->error_msg());
+        }
+    }
+
+    // indexes of attributes which are no longer configured only slow down inserts
+    std::vector<std::string> unused;
+    {
+        sqlite3pp::query query(*d->db, "SELECT name FROM sqlite_master WHERE type = 'index' AND name GLOB 'idx_*'");
+        for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
+            std::string name = (*i).get<const char*>(0);
+            if (indexes.find(name) == indexes.end()) {
+                unused.push_back(name);
+            }
+        }
+    }
+    for (auto name : unused) {
+        std::string prepare = "DROP INDEX IF EXISTS " + name;
+        d->db->execute(prepare.c_str());
+    }
+
+    // let the query planner know about the new indexes
+    d->db->execute("PRAGMA optimize");
+}
+
+//--------------------------------------------------------------------------------------------
+
 
@@ -5,13 +5,19 @@
 
 #include "dcmtk/config/osconfig.h"     /* make sure OS specific configuration is included first */
 #include "dcmtk/dcmqrdb/dcmqrcnf.h"
+#include "dcmtk/dcmdata/dcdeftag.h"
 
+#include <functional>
 #include <vector>
 #include <list>
 #include <map>
+#include <string>
 
 class DcmTagKey;
 class DcmSQLiteDatabasePrivate;
+class DcmSQLiteIngestQueue;
+struct DcmSQLiteFindPlan;
+class DcmSQLiteFindCursor;
 
 
 // private field to be used to store filename of imported files
@@ -27,34 +33,79 @@ public:
     bool isNew;
 };
 
-struct sQRes {
-    OFlonglong id;
-    std::list< DcmSmallDcmElm > resultList;
+
+// defines when a C-STORE is reported as stored in relation to the database commit
+enum DcmSQLiteDurability {
+    // wait for the commit, sync the database file on every commit
+    SQLITE_DURABILITY_FULL,
+    // wait for the commit, sync only at WAL checkpoints (default)
+    SQLITE_DURABILITY_NORMAL,
+    // do not wait for the commit
+    SQLITE_DURABILITY_ASYNC
 };
 
+struct DcmSQLiteIngestOptions {
+    DcmSQLiteIngestOptions() : durability(SQLITE_DURABILITY_NORMAL), batchSize(64), maxDelayMs(5) {
+        indexedAttributes.push_back(DCM_PatientID);
+        indexedAttributes.push_back(DCM_PatientName);
+        indexedAttributes.push_back(DCM_AccessionNumber);
+        indexedAttributes.push_back(DCM_StudyDate);
+        indexedAttributes.push_back(DCM_Modality);
+    }
+    DcmSQLiteDurability durability;
+    // maximum number of instances committed in one transaction
+    size_t batchSize;
+    // maximum time the writer waits for further instances before committing
+    int maxDelayMs;
+    // attributes with a secondary index, created and dropped by the writer on startup
+    std::vector<DcmTagKey> indexedAttributes;
+};
 
 class DcmSQLiteDatabase
 {
 public:
-    DcmSQLiteDatabase(const OFFilename& path);
+    DcmSQLiteDatabase(const OFFilename& path, const DcmSQLiteIngestOptions& ingestOptions = DcmSQLiteIngestOptions());
     ~DcmSQLiteDatabase();
 
     std::list< std::list<DcmSmallDcmElm> > find(std::list<DcmSmallDcmElm> findRequestList,
         DB_LEVEL queryLevel, DB_LEVEL qLevel, DB_LEVEL lLevel) const;
 
+    // opens a cursor over the matches of the request, returns NULL if the query fails
+    DcmSQLiteFindCursor* startFind(const std::list<DcmSmallDcmElm>& findRequestList, DB_LEVEL queryLevel) const;
+
+    // reads the next match of the cursor, returns false if there are no more results
+    bool nextFindResult(DcmSQLiteFindCursor* cursor, std::list<DcmSmallDcmElm>& result) const;
+
+    // finalizes and deletes the cursor
+    void finishFind(DcmSQLiteFindCursor* cursor) const;
+
+    // number of matches of the request, -1 if the query fails
+    long long countMatches(const std::list<DcmSmallDcmElm>& findRequestList, DB_LEVEL queryLevel) const;
+
     OFCondition insertMetaData(DcmDataset* dataset, const OFString& filename);
 
+    // reads the attributes to index now and returns a function that inserts them later, it stays valid
+    // after this database has been closed. Empty if the database cannot defer the insert.
+    std::function<bool()> prepareInsert(DcmDataset* dataset, const OFString& filename);
+
     std::vector<DB_FindAttrExt> definedAttributes() const;
 
+    // recomputes all NumberOf*Related* counters and the modality sets from the stored instances
+    bool rebuildCounters();
 
-protected:
 
-    std::vector<std::string> modalitiesInStudy(long long studyReferenceId, int& seriesSearched) const;
+protected:
 
-    int numSeriesInstances(long long seriesReferenceId) const;
+    // reads the indexed attributes and the file name of the instance
+    void collectMetaData(DcmDataset* dataset, const OFString& filename,
+        std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare >& insertMap) const;
 
     bool insertDb(const std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare >& keyValueList);
 
+    // increments the counters of all parents of a new instance, returns false on error
+    bool updateCounters(const std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare >& keyValueList,
+        const Db_Id& patIdent, const Db_Id& stdIdent, const Db_Id& serIdent);
+
     Db_Id insertpat(const std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare >& keyValueList);
 
     Db_Id insertstd(const std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare >& keyValueList, Db_Id patientIdent);
@@ -65,16 +116,18 @@ protected:
 
     Db_Id insert(const std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare >& keyValueList, Db_Id parentIdent, const DcmTagKey& primary);
 
+    // returns the key of the new row, -1 on error
     OFlonglong insertatt(const std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare>& keyValueList, OFlonglong id, DB_LEVEL level);
 
     std::string hashv(const std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare >& keyValueList, DcmTagKey key);
 
-    std::list< sQRes > query(const std::list<DcmSmallDcmElm>& findRequestList, DB_LEVEL queryLevel, DB_LEVEL currentLevel,
-        const sQRes& preResults, std::list< std::list<DcmSmallDcmElm> >& finalResuls) const;
+    // translates the request into a single statement across all levels needed for the query level
+    void planFind(const std::list<DcmSmallDcmElm>& findRequestList, DB_LEVEL queryLevel, DcmSQLiteFindPlan& plan) const;
 
     bool isDateField(const DcmTagKey& key) const;
     bool isTimeField(const DcmTagKey& key) const;
     bool isDateOrTimeField(const DcmTagKey& key) const;
+    bool isCounterField(const DcmTagKey& key) const;
 
     std::string firstp(const std::string& value) const;
     std::string secondp(const std::string& value) const;
@@ -84,8 +137,25 @@ protected:
     bool createTables();
     bool createTable(DB_LEVEL level);
     bool createIndex(DB_LEVEL level);
+    void createIndexes(const std::vector<DcmTagKey>& attributes);
 
 private:
+    friend class DcmSQLiteIngestQueue;
+
+    // creates the connection used by the ingest writer thread
+    DcmSQLiteDatabase(const std::string& dbFile, const DcmSQLiteIngestOptions& ingestOptions, bool ingestWriter);
+
+    // inserts a batch of instances in a single transaction
+    std::vector<bool> insertBatch(const std::vector< const std::map< DB_FindAttrExt, std::string, DB_FindAttrExtCompare >* >& batch);
+
+    void open(const std::string& dbFile);
+
+    // upgrades databases created by older versions, tracked by the user_version pragma
+    void migrate();
+
+    // adds and fills the normalized name and date columns
+    bool addMatchColumns();
+
     DcmSQLiteDatabasePrivate* d;
 
 };
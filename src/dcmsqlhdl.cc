@@ -13,8 +13,6 @@
 #include "dcmtk/ofstd/ofstd.h"
 #include "dcmtk/dcmdata/dcdeftag.h"
 
-#include <queue>
-
 
 //------------------------------------------------------------------------------------------------------
 
@@ -75,7 +73,7 @@ int DcmQueryRetriveConfigExt::checkForSameVendor(const char* AETitle1, const cha
 
 //------------------------------------------------------------------------------------------------------
 
-DcmQueryRetrieveSQLiteDatabaseHandleFactory::DcmQueryRetrieveSQLiteDatabaseHandleFactory(const DcmQueryRetrieveConfig* config)
+DcmQueryRetrieveSQLiteDatabaseHandleFactory::DcmQueryRetrieveSQLiteDatabaseHandleFactory(const DcmQueryRetriveConfigExt* config)
     : DcmQueryRetrieveDatabaseHandleFactory()
     , config_(config)
 {
@@ -89,7 +87,7 @@ DcmQueryRetrieveDatabaseHandle* DcmQueryRetrieveSQLiteDatabaseHandleFactory::cre
     const char* calledAETitle,
     OFCondition& result) const
 {
-    return new DcmQueryRetrieveSQLiteDatabaseHandle(config_->getStorageArea(calledAETitle));
+    return new DcmQueryRetrieveSQLiteDatabaseHandle(config_->getStorageArea(calledAETitle), config_->ingestOptions());
 }
 
 //------------------------------------------------------------------------------------------------------
@@ -105,7 +103,7 @@ public:
         CECHO
     };
 
-    DcmQueryRetrieveSQLiteDatabaseHandlePrivate(const OFFilename& path);
+    DcmQueryRetrieveSQLiteDatabaseHandlePrivate(const OFFilename& path, const DcmSQLiteIngestOptions& ingestOptions);
     ~DcmQueryRetrieveSQLiteDatabaseHandlePrivate();
 
     bool isSOPClassSupported(const std::string& SOPClassUID, ctype type);
@@ -116,8 +114,6 @@ public:
 
     void DB_DuplicateElement(DB_SmallDcmElmt* src, DB_SmallDcmElmt* dst);
 
-    void DB_MakeResponseList(std::list<DcmSmallDcmElm> lst);
-
     OFCondition DB_FreeElementList(DB_ElementList* lst);
 
     OFCondition DB_GetTagLevel(DcmTagKey tag, DB_LEVEL* level);
@@ -134,30 +130,44 @@ public:
 
     bool containsAttribute(const std::list<DcmSmallDcmElm>& list, DcmTagKey key);
 
+    // reads the next match into cursorResult, finishes the cursor once it is exhausted
+    void fetchCursorResult();
+
+    void closeCursor();
+
     DcmSQLiteDatabase* db;
     DB_Private_Handle* handle;
     OFFilename storagePath;
-    std::queue< std::list< DcmSmallDcmElm > > findResult;
+    // matches of the running C-FIND or C-MOVE/C-GET, read one ahead
+    DcmSQLiteFindCursor* cursor;
+    std::list<DcmSmallDcmElm> cursorResult;
+    bool hasCursorResult;
+    long long remainingResults;
     OFFilename rootPath;
 };
 
 
 
-DcmQueryRetrieveSQLiteDatabaseHandlePrivate::DcmQueryRetrieveSQLiteDatabaseHandlePrivate(const OFFilename& path)
+DcmQueryRetrieveSQLiteDatabaseHandlePrivate::DcmQueryRetrieveSQLiteDatabaseHandlePrivate(const OFFilename& path, const DcmSQLiteIngestOptions& ingestOptions)
 {
-    db = new DcmSQLiteDatabase(path);
+    db = new DcmSQLiteDatabase(path, ingestOptions);
     handle = new DB_Private_Handle;
     storagePath = path;
+    cursor = NULL;
+    hasCursorResult = false;
+    remainingResults = 0;
 }
 
 //------------------------------------------------------------------------------------------------------
 
 DcmQueryRetrieveSQLiteDatabaseHandlePrivate::~DcmQueryRetrieveSQLiteDatabaseHandlePrivate()
 {
+    closeCursor();
     DB_FreeElementList(handle->findRequestList);
-    DB_FreeElementList(handle->findResponseList);
     delete handle;
     handle = NULL;
+    delete db;
+    db = NULL;
 }
 
 //------------------------------------------------------------------------------------------------------
@@ -332,51 +342,23 @@ void DcmQueryRetrieveSQLiteDatabaseHandlePrivate::DB_DuplicateElement(DB_SmallDc
 
 //------------------------------------------------------------------------------------------------------
 
-void DcmQueryRetrieveSQLiteDatabaseHandlePrivate::DB_MakeResponseList(std::list<DcmSmallDcmElm> lst)
+void DcmQueryRetrieveSQLiteDatabaseHandlePrivate::fetchCursorResult()
 {
-    DB_ElementList* pRequestList = NULL;
-    DB_ElementList* plist = NULL;
-    DB_ElementList* last = NULL;
-
-    this->handle->findResponseList = NULL;
-
-    for (pRequestList = this->handle->findRequestList; pRequestList; pRequestList = pRequestList->next) {
-
-        DB_SmallDcmElmt dcmElm;
-        bool elemFound = false;
-        for (auto qElm : lst) {
-            if (qElm.XTag() == pRequestList->elem.XTag) {
-                elemFound = true;
-                dcmElm.XTag = qElm.XTag();
-                char* cstr = new char[qElm.valueField().length() + 1];
-                strcpy(cstr, qElm.valueField().c_str());
-                dcmElm.PValueField = cstr;
-                dcmElm.ValueLength = (Uint32)qElm.valueField().length() + 1;
-                break;
-            }
-
-        }
-
-        if (!elemFound)
-            continue;
-
-        plist = (DB_ElementList*)malloc(sizeof(DB_ElementList));
-        if (plist == NULL) {
-            DCMNET_ERROR("DB_MakeResponseList: out of memory");
-            return;
-        }
-        plist->next = NULL;
-        DB_DuplicateElement(&dcmElm, &plist->elem);
+    hasCursorResult = cursor != NULL && db->nextFindResult(cursor, cursorResult);
+    if (!hasCursorResult) {
+        closeCursor();
+    }
+}
 
-        if (this->handle->findResponseList == NULL) {
-            this->handle->findResponseList = last = plist;
-        }
-        else {
-            last->next = plist;
-            last = plist;
-        }
+//------------------------------------------------------------------------------------------------------
 
-    }
+void DcmQueryRetrieveSQLiteDatabaseHandlePrivate::closeCursor()
+{
+    db->finishFind(cursor);
+    cursor = NULL;
+    hasCursorResult = false;
+    cursorResult.clear();
+    remainingResults = 0;
 }
 
 //------------------------------------------------------------------------------------------------------
@@ -586,8 +568,8 @@ bool DcmQueryRetrieveSQLiteDatabaseHandlePrivate::containsAttribute(const std::l
 
 //------------------------------------------------------------------------------------------------------
 
-DcmQueryRetrieveSQLiteDatabaseHandle::DcmQueryRetrieveSQLiteDatabaseHandle(const OFFilename& path) 
-    : d(new DcmQueryRetrieveSQLiteDatabaseHandlePrivate(path))
+DcmQueryRetrieveSQLiteDatabaseHandle::DcmQueryRetrieveSQLiteDatabaseHandle(const OFFilename& path, const DcmSQLiteIngestOptions& ingestOptions) 
+    : d(new DcmQueryRetrieveSQLiteDatabaseHandlePrivate(path, ingestOptions))
 {
 }
 
@@ -635,17 +617,14 @@ OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::startFindRequest( const char *
 
     std::list<DcmSmallDcmElm> findRequestList = d->convertList(d->handle->findRequestList);
 
-    std::list< std::list<DcmSmallDcmElm> > resultList = d->db->find(findRequestList, d->handle->queryLevel, qLevel, lLevel);
-
-    for( auto lst: resultList) {
-        d->findResult.push(lst);
-    }
-
-    if (!d->findResult.empty()) {
-        auto item = d->findResult.front();
-        d->findResult.pop();
-        d->DB_MakeResponseList(item);
+    // the matches are read one at a time while the responses are sent
+    d->closeCursor();
+    d->cursor = d->db->startFind(findRequestList, d->handle->queryLevel);
+    if (d->cursor == NULL) {
+        status->setStatus(STATUS_FIND_Failed_UnableToProcess);
+        return QR_EC_IndexDatabaseError;
     }
+    d->fetchCursorResult();
 
     return cond;
 }
@@ -655,11 +634,10 @@ OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::startFindRequest( const char *
 OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::nextFindResponse(DcmDataset **findResponseIdentifiers,
     DcmQueryRetrieveDatabaseStatus *status, const DcmQueryRetrieveCharacterSetOptions& characterSetOptions)
 {
-    DB_ElementList*     plist = NULL;
     const char*         queryLevelString = NULL;
     OFCondition         cond = EC_Normal;
 
-    if (d->handle->findResponseList == NULL) {
+    if (!d->hasCursorResult) {
        DCMNET_INFO("nextFindResponse() : STATUS_Success");
         *findResponseIdentifiers = NULL;
         status->setStatus(STATUS_Success);
@@ -670,16 +648,16 @@ OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::nextFindResponse(DcmDataset **
     if (*findResponseIdentifiers != NULL) {
 
         // Put responses
-        for (plist = d->handle->findResponseList; plist != NULL; plist = plist->next) {
-            DcmTag t(plist->elem.XTag);
+        for (const DcmSmallDcmElm& elm : d->cursorResult) {
+            DcmTag t(elm.XTag());
             DcmElement* dce = DcmItem::newDicomElement(t);
             if (dce == NULL) {
                 status->setStatus(STATUS_FIND_Refused_OutOfResources);
                 return QR_EC_IndexDatabaseError;
             }
-            if (plist->elem.PValueField != NULL &&
-                strlen(plist->elem.PValueField) > 0) {
-                OFCondition ec = dce->putString(plist->elem.PValueField);
+            std::string value = elm.valueField();
+            if (!value.empty()) {
+                OFCondition ec = dce->putString(value.c_str());
                 if (ec != EC_Normal) {
                     DCMNET_WARN("nextFindResponse(): cannot put");
                     status->setStatus(STATUS_FIND_Failed_UnableToProcess);
@@ -714,14 +692,7 @@ OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::nextFindResponse(DcmDataset **
         return (QR_EC_IndexDatabaseError);
     }
 
-    d->DB_FreeElementList(d->handle->findResponseList);
-    d->handle->findResponseList = NULL;
-
-    if (!d->findResult.empty()) {
-        auto item = d->findResult.front();
-        d->findResult.pop();
-        d->DB_MakeResponseList(item);
-    }
+    d->fetchCursorResult();
 
     return cond;
 
@@ -733,11 +704,7 @@ OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::cancelFindRequest( DcmQueryRet
 {
     d->DB_FreeElementList(d->handle->findRequestList);
     d->handle->findRequestList = NULL;
-    d->DB_FreeElementList(d->handle->findResponseList);
-    d->handle->findResponseList = NULL;
-    while (!d->findResult.empty()) {
-        d->findResult.pop();
-    }
+    d->closeCursor();
 
     status->setStatus(STATUS_FIND_Cancel_MatchingTerminatedDueToCancelRequest);
     return (EC_Normal);
@@ -773,33 +740,38 @@ OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::startMoveRequest( const char *
 
     std::list<DcmSmallDcmElm> findRequestList = d->convertList(d->handle->findRequestList);
 
-    if (!d->containsAttribute(findRequestList, DCM_SeriesInstanceUID)) {
-        findRequestList.push_back(DcmSmallDcmElm(DCM_SeriesInstanceUID, ""));
+    // the instances to send are enumerated by a single image level query, read while the sub-operations run
+    if (!d->containsAttribute(findRequestList, DCM_SOPInstanceUID)) {
+        findRequestList.push_back(DcmSmallDcmElm(DCM_SOPInstanceUID, ""));
     }
+    if (!d->containsAttribute(findRequestList, DCM_SOPClassUID)) {
+        findRequestList.push_back(DcmSmallDcmElm(DCM_SOPClassUID, ""));
+    }
+    findRequestList.push_back(DcmSmallDcmElm(DCM_PrivateFileName, ""));
 
-    std::list< std::list<DcmSmallDcmElm> > seriesResult = d->db->find(findRequestList, SERIE_LEVEL, qLevel, lLevel);
-    for (auto seriesList: seriesResult) {
-        std::list<DcmSmallDcmElm> imgRequestList(seriesList);
-
-        if (!d->containsAttribute(findRequestList, DCM_SOPInstanceUID)) {
-            imgRequestList.push_back(DcmSmallDcmElm(DCM_SOPInstanceUID, ""));
-        }
-
-        imgRequestList.push_back(DcmSmallDcmElm(DCM_PrivateFileName, ""));
-        imgRequestList.push_back(DcmSmallDcmElm(DCM_SOPClassUID, ""));
-
-        std::list< std::list<DcmSmallDcmElm> > imgResult = d->db->find(imgRequestList, IMAGE_LEVEL, qLevel, lLevel);
-        status->setStatus(STATUS_Pending);
+    d->closeCursor();
+    d->cursor = d->db->startFind(findRequestList, IMAGE_LEVEL);
+    if (d->cursor == NULL) {
+        status->setStatus(STATUS_MOVE_Failed_UnableToProcess);
+        return QR_EC_IndexDatabaseError;
+    }
 
-        for(auto imgList: imgResult) {
-            d->findResult.push(imgList);
-        }
+    // the open cursor holds the read transaction, so the count sees the same snapshot
+    d->remainingResults = d->db->countMatches(findRequestList, IMAGE_LEVEL);
+    d->fetchCursorResult();
+    if (d->remainingResults < 0) {
+        d->closeCursor();
+        status->setStatus(STATUS_MOVE_Failed_UnableToProcess);
+        return QR_EC_IndexDatabaseError;
     }
 
-    if (d->findResult.empty()) {
+    if (!d->hasCursorResult) {
         DCMNET_ERROR("MoveRequest: no image found.");
         status->setStatus(STATUS_Success);
     }
+    else {
+        status->setStatus(STATUS_Pending);
+    }
 
     return cond;
 }
@@ -810,16 +782,20 @@ OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::nextMoveResponse(char* SOPClas
     char* SOPInstanceUID, size_t SOPInstanceUIDSize, char* imageFileName, size_t imageFileNameSize, 
     unsigned short* numberOfRemainingSubOperations, DcmQueryRetrieveDatabaseStatus* status)
 {
-    if (d->findResult.empty()) {
+    if (!d->hasCursorResult) {
        DCMNET_INFO("no more images to send, finishing");
         *numberOfRemainingSubOperations = 0;
         status->setStatus(STATUS_Success);
         return (EC_Normal);
     }
 
-    std::list<DcmSmallDcmElm> lst = d->findResult.front();
-    d->findResult.pop();
-    *numberOfRemainingSubOperations = (int)d->findResult.size();
+    std::list<DcmSmallDcmElm> lst;
+    lst.swap(d->cursorResult);
+    long long remaining = d->remainingResults > 0 ? d->remainingResults - 1 : 0;
+    d->fetchCursorResult();
+    d->remainingResults = d->hasCursorResult ? remaining : 0;
+    // the DIMSE field has 16 bits, larger moves report the maximum until the count fits
+    *numberOfRemainingSubOperations = (unsigned short)(remaining > 65535 ? 65535 : remaining);
 
     for(auto el: lst) {
         if (el.XTag() == DCM_PrivateFileName) {
@@ -848,7 +824,8 @@ OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::nextMoveResponse(char* SOPClas
 
 OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::cancelMoveRequest( DcmQueryRetrieveDatabaseStatus *status )
 {
-    // not implemented on purpose
+    // the remaining sub-operations are not reported, but the cursor must not keep its read transaction
+    d->closeCursor();
     return OFCondition(EC_IllegalParameter);
 }
 
@@ -883,9 +860,22 @@ OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::makeNewStoreFileName(const cha
 OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::storeRequest(const char* SOPClassUID, 
     const char* SOPInstanceUID, const char* imageFileName, DcmQueryRetrieveDatabaseStatus* status, OFBool isNew)
 {
+    return storeDatasetRequest(SOPClassUID, SOPInstanceUID, imageFileName, NULL, status, isNew);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::storeDatasetRequest(const char* SOPClassUID,
+    const char* SOPInstanceUID, const char* imageFileName, DcmDataset* dataset, DcmQueryRetrieveDatabaseStatus* status, OFBool isNew)
+{
+    if (dataset != NULL)
+    {
+        return d->db->insertMetaData(dataset, imageFileName);
+    }
+
+    // only the file is available, none of the indexed attributes is located after the pixel data
     DcmFileFormat dcmff;
-    OFFilename file(imageFileName);
-    if (dcmff.loadFile(imageFileName).bad())
+    if (dcmff.loadFileUntilTag(imageFileName, EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect, DCM_PixelData).bad())
     {
         DCMNET_ERROR("DB: Cannot open file: " << imageFileName << ": " << OFStandard::getLastSystemErrorCode().message());
         status->setStatus(STATUS_STORE_Error_CannotUnderstand);
@@ -897,3 +887,39 @@ OFCondition DcmQueryRetrieveSQLiteDatabaseHandle::storeRequest(const char* SOPCl
 
 //------------------------------------------------------------------------------------------------------
 
+// inserts the instance once the write-behind stage has written its file
+class DcmSQLiteDeferredInsert : public DcmQueryRetrieveFileWriteListener
+{
+public:
+    DcmSQLiteDeferredInsert(const std::function<bool()>& insert, const OFString& imageFileName)
+        : m_insert(insert), m_imageFileName(imageFileName) {}
+
+    void fileWritten(OFBool success)
+    {
+        if (!success) {
+            DCMNET_WARN("DB: not indexing " << m_imageFileName << ", the file could not be written");
+        }
+        else if (!m_insert()) {
+            DCMNET_ERROR("DB: Failed inserting metadata of " << m_imageFileName << " into db");
+        }
+    }
+
+private:
+    std::function<bool()> m_insert;
+    OFString m_imageFileName;
+};
+
+//------------------------------------------------------------------------------------------------------
+
+DcmQueryRetrieveFileWriteListener* DcmQueryRetrieveSQLiteDatabaseHandle::deferStoreRequest(const char* /* SOPClassUID */,
+    const char* /* SOPInstanceUID */, const char* imageFileName, DcmDataset* dataset)
+{
+    std::function<bool()> insert = d->db->prepareInsert(dataset, imageFileName);
+    if (!insert) {
+        return NULL;
+    }
+    return new DcmSQLiteDeferredInsert(insert, imageFileName);
+}
+
+//------------------------------------------------------------------------------------------------------
+
@@ -6,6 +6,8 @@
 #include "dcmtk/ofstd/offile.h"
 #include "dcmtk/dcmqrdb/dcmqrcnf.h"
 
+#include "dcmsqldb.h"
+
 #include <list>
 
 class DcmQueryRetrieveSQLiteDatabaseHandlePrivate;
@@ -20,6 +22,8 @@ public:
     void addPeer(const char* AETitle, const char* HostName, int PortNumber);
     void setStorageArea(const OFFilename& filename) { _storageArea = filename; }
     void setPermissiveMode(bool enabled) { _permissive = enabled;  }
+    void setIngestOptions(const DcmSQLiteIngestOptions& options) { _ingestOptions = options; }
+    const DcmSQLiteIngestOptions& ingestOptions() const { return _ingestOptions; }
 
     // override
     int peerForAETitle(const char* AETitle, const char** HostName, int* PortNumber) const;
@@ -38,13 +42,14 @@ private:
     std::list<sPeer> _peers;
     OFFilename _storageArea;
     bool _permissive;
+    DcmSQLiteIngestOptions _ingestOptions;
 };
 
 class DcmQueryRetrieveSQLiteDatabaseHandleFactory : public DcmQueryRetrieveDatabaseHandleFactory
 {
 public:
 
-     DcmQueryRetrieveSQLiteDatabaseHandleFactory(const DcmQueryRetrieveConfig* config);
+     DcmQueryRetrieveSQLiteDatabaseHandleFactory(const DcmQueryRetriveConfigExt* config);
      ~DcmQueryRetrieveSQLiteDatabaseHandleFactory() {}
 
      DcmQueryRetrieveDatabaseHandle* createDBHandle(
@@ -55,7 +60,7 @@ public:
 private:
     DcmQueryRetrieveSQLiteDatabaseHandleFactory(const DcmQueryRetrieveSQLiteDatabaseHandleFactory& other);
     DcmQueryRetrieveSQLiteDatabaseHandleFactory& operator=(const DcmQueryRetrieveSQLiteDatabaseHandleFactory& other);
-    const DcmQueryRetrieveConfig* config_;
+    const DcmQueryRetriveConfigExt* config_;
 };
 
 
@@ -63,7 +68,7 @@ class DcmQueryRetrieveSQLiteDatabaseHandle : public DcmQueryRetrieveDatabaseHand
 {
 public:
 
-    DcmQueryRetrieveSQLiteDatabaseHandle(const OFFilename &path);
+    DcmQueryRetrieveSQLiteDatabaseHandle(const OFFilename &path, const DcmSQLiteIngestOptions& ingestOptions = DcmSQLiteIngestOptions());
 
     ~DcmQueryRetrieveSQLiteDatabaseHandle();
 
@@ -102,6 +107,12 @@ public:
      OFCondition storeRequest( const char *SOPClassUID, const char *SOPInstanceUID, const char *imageFileName, 
         DcmQueryRetrieveDatabaseStatus  *status, OFBool isNew = OFTrue );
 
+     OFCondition storeDatasetRequest( const char *SOPClassUID, const char *SOPInstanceUID, const char *imageFileName,
+        DcmDataset *dataset, DcmQueryRetrieveDatabaseStatus  *status, OFBool isNew = OFTrue );
+
+     DcmQueryRetrieveFileWriteListener* deferStoreRequest( const char *SOPClassUID, const char *SOPInstanceUID,
+        const char *imageFileName, DcmDataset *dataset );
+
      OFCondition pruneInvalidRecords() { return OFCondition(EC_IllegalParameter); }
 
      void setIdentifierChecking(OFBool checkFind, OFBool checkMove) { }
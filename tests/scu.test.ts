@@ -1,4 +1,7 @@
-import { echoScu } from '../index';
+import { echoScu, findScu, storeScu, startStoreScp } from '../index';
+import * as fs from 'fs';
+import * as os from 'os';
+import * as path from 'path';
 
 const options = {
   source: {
@@ -21,4 +24,106 @@ test('echo should run', () => {
         expect(parsed.code).toBe(0);
     });
       
-});
\ No newline at end of file
+});
+
+// explicit VR little endian element, values are padded to even length
+function element(group: number, elem: number, vr: string, value: string | Buffer): Buffer {
+    let data = typeof value === 'string' ? Buffer.from(value, 'latin1') : value;
+    if (data.length % 2) {
+        data = Buffer.concat([data, Buffer.from(vr === 'UI' ? '\0' : ' ')]);
+    }
+    const longForm = vr === 'OB';
+    const header = Buffer.alloc(longForm ? 12 : 8);
+    header.writeUInt16LE(group, 0);
+    header.writeUInt16LE(elem, 2);
+    header.write(vr, 4, 'latin1');
+    if (longForm) {
+        header.writeUInt32LE(data.length, 8);
+    } else {
+        header.writeUInt16LE(data.length, 6);
+    }
+    return Buffer.concat([header, data]);
+}
+
+// minimal secondary capture object without pixel data
+function dicomFile(patientName: string, patientId: string, studyUid: string): Buffer {
+    const sopClass = "1.2.840.10008.5.1.4.1.1.7";
+    const sopInstance = studyUid + ".1.1";
+    const meta = Buffer.concat([
+        element(0x0002, 0x0001, 'OB', Buffer.from([0, 1])),
+        element(0x0002, 0x0002, 'UI', sopClass),
+        element(0x0002, 0x0003, 'UI', sopInstance),
+        element(0x0002, 0x0010, 'UI', "1.2.840.10008.1.2.1"),
+        element(0x0002, 0x0012, 'UI', "1.2.276.0.7230010.3.0.3.6.8"),
+    ]);
+    const groupLength = Buffer.alloc(4);
+    groupLength.writeUInt32LE(meta.length, 0);
+    return Buffer.concat([
+        Buffer.alloc(128),
+        Buffer.from('DICM', 'latin1'),
+        element(0x0002, 0x0000, 'UL', groupLength),
+        meta,
+        element(0x0008, 0x0016, 'UI', sopClass),
+        element(0x0008, 0x0018, 'UI', sopInstance),
+        element(0x0008, 0x0060, 'CS', "OT"),
+        element(0x0010, 0x0010, 'PN', patientName),
+        element(0x0010, 0x0020, 'LO', patientId),
+        element(0x0020, 0x000D, 'UI', studyUid),
+        element(0x0020, 0x000E, 'UI', studyUid + ".1"),
+    ]);
+}
+
+test('find with a universal patient name should return patients without a name', async () => {
+    const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'dimse-'));
+    const storagePath = path.join(dir, 'storage');
+    fs.mkdirSync(storagePath);
+    const studyUid = "1.2.826.0.1.3680043.2.1143.4711";
+    fs.writeFileSync(path.join(dir, 'noname.dcm'), dicomFile("", "NONAME", studyUid));
+
+    const scpNode = { aet: "FINDTEST", ip: "127.0.0.1", port: 9998 };
+    let stopped: (code: number) => void = () => {};
+    const whenStopped = new Promise<number>((resolve) => { stopped = resolve; });
+    const scp = startStoreScp({ source: scpNode, peers: [options.source], storagePath }, (result) => {
+        const parsed = JSON.parse(result);
+        if (parsed.code !== 1) {
+            stopped(parsed.code);
+        }
+    });
+    await new Promise((resolve) => setTimeout(resolve, 500));
+
+    try {
+        const stored = await new Promise<any>((resolve) => {
+            storeScu({ ...options, target: scpNode, sourcePath: path.join(dir, 'noname.dcm') }, (result) => {
+                const parsed = JSON.parse(result);
+                if (parsed.code !== 1) {
+                    resolve(parsed);
+                }
+            });
+        });
+        expect(stored.code).toBe(0);
+
+        const found = await new Promise<any>((resolve) => {
+            findScu({
+                ...options,
+                target: scpNode,
+                tags: [
+                    { key: "00080052", value: "STUDY" },
+                    { key: "00100010", value: "*" },
+                    { key: "0020000D", value: "" },
+                ],
+            }, (result) => {
+                const parsed = JSON.parse(result);
+                if (parsed.code !== 1) {
+                    resolve(parsed);
+                }
+            });
+        });
+        expect(found.code).toBe(0);
+        const studies = JSON.parse(found.container).map((match: any) => match["0020000D"].Value[0]);
+        expect(studies).toContain(studyUid);
+    } finally {
+        scp.stop();
+        expect(await whenStopped).toBe(0);
+        fs.rmSync(dir, { recursive: true, force: true });
+    }
+}, 30000);